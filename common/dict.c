@@ -24,8 +24,6 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <ctype.h>
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
 #endif /* HAVE_STDINT_H */
@@ -34,126 +32,228 @@
 
 /*
    This module uses a hashtable to store its key to value mappings. The
-   structure is basically as follows:
+   hashtable uses open addressing with Robin Hood insertion: an entry that
+   is further away from its preferred slot may take the place of an entry
+   that is closer to its own slot. This keeps probe sequences short and
+   allows lookups of absent keys to stop early. Removal shifts the
+   following entries back so no tombstones are needed.
 
-   [struct dictionary]
-     \- holds an array of pointers to a linked list of [struct dict_entry]
-          \- each entry has a key/value mapping
+   Short keys are stored in the slot itself, longer keys are copied into a
+   separately allocated buffer. The size of the hashtable is a power of two
+   and it is grown when it becomes more than three quarters full.
 
-   The hashmap can be resized when the total number of elements in the hashmap
-   exceeds a certain load factor.
-
-   All the keys are copied in a separate linked list of buffers where each new
-   buffer that is allocated is larger than the previous one. The first buffer
-   in the linked list is always the current one.
+   A dictionary can be created that compares keys case-insensitively (only
+   for ASCII characters, which is what is used for attribute names and
+   DNs).
 */
 
-/* an entry stores one key/value pair */
-struct dict_entry {
+/* the maximum length of keys (including the terminating nul) that are
+   stored in the slot itself */
+#define DICT_INLINEKEY 24
+
+/* a slot stores one key/value pair, a NULL value marks an empty slot */
+struct dict_slot {
   uint32_t hash;      /* used for quick matching and rehashing */
-  const char *key;    /* a reference to a copy of the key */
+  uint32_t keylen;    /* the length of the key */
   void *value;        /* the stored value */
-  struct dict_entry *next;
+  union {
+    char str[DICT_INLINEKEY]; /* the key if it is short enough */
+    char *ptr;                /* a copy of the key otherwise */
+  } key;
 };
 
-/* the initial size of the hashtable */
-#define DICT_INITSIZE 7
-
-/* load factor at which point to grow hashtable */
-#define DICT_LOADPERCENTAGE 400
+/* the initial size of the hashtable (should be a power of two) */
+#define DICT_INITSIZE 8
 
 /* the dictionary is a hashtable */
 struct dictionary {
-  int size;                      /* size of the hashtable */
-  int num;                       /* total number of keys stored */
-  struct dict_entry **table;     /* the hashtable */
+  uint32_t size;                 /* size of the hashtable */
+  uint32_t num;                  /* total number of keys stored */
+  int ignorecase;                /* whether to ignore case of keys */
+  struct dict_slot *table;       /* the hashtable */
 };
 
-/* Simple hash function that computes the hash value of a string. */
-static uint32_t stringhash(const char *str)
+#define DICT_KEY(slot)                                                      \
+  (((slot)->keylen < DICT_INLINEKEY) ? (slot)->key.str : (slot)->key.ptr)
+
+/* the distance of the slot at index i from its preferred position */
+#define DICT_DIST(dict, i)                                                  \
+  (((i) - (dict)->table[i].hash) & ((dict)->size - 1))
+
+/* the constants used for hashing */
+#define HASH_SEED 0x2545f4914f6cdd1dULL
+#define HASH_MUL  0x9e3779b97f4a7c15ULL
+
+/* convert the ASCII upper case letters in the 8 bytes to lower case */
+static inline uint64_t lowercase64(uint64_t w)
 {
-  uint32_t hash = 5381;
-  uint32_t c;
-  while ((c = *str++) != '\0')
-    hash = 33 * hash + c;
-  return hash;
+  uint64_t low7 = w & 0x7f7f7f7f7f7f7f7fULL;
+  /* the high bit is set for bytes that are >= 'A' and for bytes > 'Z' */
+  uint64_t ge_a = low7 + 0x3f3f3f3f3f3f3f3fULL;
+  uint64_t gt_z = low7 + 0x2525252525252525ULL;
+  uint64_t upper = (ge_a ^ gt_z) & ~w & 0x8080808080808080ULL;
+  return w | (upper >> 2);
+}
+
+/* Hash function that consumes the string 8 bytes at a time. */
+static uint32_t stringhash(const char *str, size_t len, int ignorecase)
+{
+  uint64_t hash = HASH_SEED ^ (uint64_t)len;
+  uint64_t w;
+  size_t i;
+  while (len > 0)
+  {
+    if (len >= sizeof(uint64_t))
+    {
+      memcpy(&w, str, sizeof(uint64_t));
+      str += sizeof(uint64_t);
+      len -= sizeof(uint64_t);
+    }
+    else
+    {
+      /* collect the remaining bytes */
+      for (w = 0, i = 0; i < len; i++)
+        w |= ((uint64_t)(uint8_t)str[i]) << (8 * i);
+      len = 0;
+    }
+    if (ignorecase)
+      w = lowercase64(w);
+    hash = (hash ^ w) * HASH_MUL;
+    hash ^= hash >> 29;
+  }
+  /* mix the bits so the lower bits can be used as index */
+  hash ^= hash >> 32;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return (uint32_t)hash;
+}
+
+/* Compare the strings of the same length ignoring case of ASCII
+   letters, 8 bytes at a time. */
+static int strequal_ignorecase(const char *a, const char *b, size_t len)
+{
+  uint64_t wa, wb;
+  size_t i;
+  for (; len >= sizeof(uint64_t); a += sizeof(uint64_t), b += sizeof(uint64_t),
+       len -= sizeof(uint64_t))
+  {
+    memcpy(&wa, a, sizeof(uint64_t));
+    memcpy(&wb, b, sizeof(uint64_t));
+    if ((wa != wb) && (lowercase64(wa) != lowercase64(wb)))
+      return 0;
+  }
+  /* compare the remaining bytes */
+  for (wa = 0, wb = 0, i = 0; i < len; i++)
+  {
+    wa |= ((uint64_t)(uint8_t)a[i]) << (8 * i);
+    wb |= ((uint64_t)(uint8_t)b[i]) << (8 * i);
+  }
+  return lowercase64(wa) == lowercase64(wb);
+}
+
+/* Find the index of the slot with the key, returns -1 if it is not
+   present. */
+static int dict_find(DICT *dict, const char *key, uint32_t hash, size_t len)
+{
+  uint32_t i, dist;
+  struct dict_slot *slot;
+  for (i = hash & (dict->size - 1), dist = 0; dict->table[i].value != NULL;
+       i = (i + 1) & (dict->size - 1), dist++)
+  {
+    slot = &dict->table[i];
+    /* the key would have been placed here if it was present */
+    if (DICT_DIST(dict, i) < dist)
+      return -1;
+    if ((slot->hash == hash) && (slot->keylen == len) &&
+        (dict->ignorecase ? strequal_ignorecase(DICT_KEY(slot), key, len)
+                          : (memcmp(DICT_KEY(slot), key, len) == 0)))
+      return (int)i;
+  }
+  return -1;
+}
+
+/* Put the slot in the table, moving entries that are closer to their
+   preferred position out of the way. There should be room in the table. */
+static void dict_place(DICT *dict, struct dict_slot *slot)
+{
+  struct dict_slot tmp;
+  uint32_t i, dist, d;
+  for (i = slot->hash & (dict->size - 1), dist = 0;
+       dict->table[i].value != NULL;
+       i = (i + 1) & (dict->size - 1), dist++)
+  {
+    d = DICT_DIST(dict, i);
+    if (d < dist)
+    {
+      tmp = dict->table[i];
+      dict->table[i] = *slot;
+      *slot = tmp;
+      dist = d;
+    }
+  }
+  dict->table[i] = *slot;
 }
 
 /* Grow the hashtable. */
 static void growhashtable(DICT *dict)
 {
-  int i;
-  int newsize;
-  struct dict_entry **newtable;
-  struct dict_entry *entry, *tmp;
-  newsize = dict->size * 3 + 1;
+  uint32_t i, oldsize;
+  struct dict_slot *oldtable, *newtable;
   /* allocate room for new hashtable */
-  newtable = (struct dict_entry **)malloc(newsize * sizeof(struct dict_entry *));
+  newtable = (struct dict_slot *)calloc(dict->size * 2, sizeof(struct dict_slot));
   if (newtable == NULL)
     return; /* allocating memory failed continue to fill the existing table */
-  /* clear new table */
-  for (i = 0; i < newsize; i++)
-    newtable[i] = NULL;
+  oldtable = dict->table;
+  oldsize = dict->size;
+  dict->table = newtable;
+  dict->size = oldsize * 2;
   /* copy old hashtable into new table */
-  for (i = 0; i < dict->size; i++)
-  {
-    /* go over elements in linked list */
-    entry = dict->table[i];
-    while (entry != NULL)
-    {
-      tmp = entry;
-      entry = entry->next;
-      /* put in new position */
-      tmp->next = newtable[tmp->hash % newsize];
-      newtable[tmp->hash % newsize] = tmp;
-    }
-  }
+  for (i = 0; i < oldsize; i++)
+    if (oldtable[i].value != NULL)
+      dict_place(dict, &oldtable[i]);
   /* free the old hashtable */
-  free(dict->table);
-  /* put new hashtable in place */
-  dict->size = newsize;
-  dict->table = newtable;
+  free(oldtable);
 }
 
-DICT *dict_new(void)
+static DICT *dict_create(int ignorecase)
 {
   struct dictionary *dict;
-  int i;
   /* allocate room for dictionary information */
   dict = (struct dictionary *)malloc(sizeof(struct dictionary));
   if (dict == NULL)
     return NULL;
   dict->size = DICT_INITSIZE;
   dict->num = 0;
-  /* allocate initial hashtable */
-  dict->table = (struct dict_entry **)malloc(DICT_INITSIZE * sizeof(struct dict_entry *));
+  dict->ignorecase = ignorecase;
+  /* allocate initial (cleared) hashtable */
+  dict->table = (struct dict_slot *)calloc(DICT_INITSIZE, sizeof(struct dict_slot));
   if (dict->table == NULL)
   {
     free(dict);
     return NULL;
   }
-  /* clear the hashtable */
-  for (i = 0; i < DICT_INITSIZE; i++)
-    dict->table[i] = NULL;
   /* we're done */
   return dict;
 }
 
+DICT *dict_new(void)
+{
+  return dict_create(0);
+}
+
+DICT *dict_new_ignorecase(void)
+{
+  return dict_create(1);
+}
+
 void dict_free(DICT *dict)
 {
-  struct dict_entry *entry, *etmp;
-  int i;
-  /* free hashtable entries */
+  uint32_t i;
+  /* free the copies of long keys */
   for (i = 0; i < dict->size; i++)
-  {
-    entry = dict->table[i];
-    while (entry != NULL)
-    {
-      etmp = entry;
-      entry = entry->next;
-      free(etmp);
-    }
-  }
+    if ((dict->table[i].value != NULL) &&
+        (dict->table[i].keylen >= DICT_INLINEKEY))
+      free(dict->table[i].key.ptr);
   /* free the hashtable */
   free(dict->table);
   /* free dictionary struct itself */
@@ -162,84 +262,79 @@ void dict_free(DICT *dict)
 
 void *dict_get(DICT *dict, const char *key)
 {
-  uint32_t hash;
-  struct dict_entry *entry;
-  /* calculate the hash */
-  hash = stringhash(key);
-  /* loop over the linked list in the hashtable */
-  for (entry = dict->table[hash % dict->size]; entry != NULL; entry = entry->next)
-  {
-    if ((entry->hash == hash) && (strcmp(entry->key, key) == 0))
-      return entry->value;
-  }
-  /* no matches found */
-  return NULL;
+  size_t len;
+  int i;
+  len = strlen(key);
+  i = dict_find(dict, key, stringhash(key, len, dict->ignorecase), len);
+  return (i < 0) ? NULL : dict->table[i].value;
 }
 
 const char *dict_getany(DICT *dict)
 {
-  int i;
-  /* loop over the linked list in the hashtable */
+  uint32_t i;
+  /* find the first used slot */
   for (i = 0; i < dict->size; i++)
-    if (dict->table[i])
-      return dict->table[i]->key;
+    if (dict->table[i].value != NULL)
+      return DICT_KEY(&dict->table[i]);
   /* no matches found */
   return NULL;
 }
 
 int dict_put(DICT *dict, const char *key, void *value)
 {
-  uint32_t hash;
-  int l;
-  char *buf;
-  int idx;
-  struct dict_entry *entry, *prev;
-  /* check if we should grow the hashtable */
-  if (dict->num >= ((dict->size * DICT_LOADPERCENTAGE) / 100))
-    growhashtable(dict);
-  /* calculate the hash and position in the hashtable */
-  hash = stringhash(key);
-  idx = hash % dict->size;
-  /* check if the entry is already present */
-  for (entry = dict->table[idx], prev = NULL; entry != NULL; prev = entry, entry = entry->next)
+  uint32_t hash, j, next;
+  size_t len;
+  int i;
+  struct dict_slot slot;
+  /* calculate the hash and find the key */
+  len = strlen(key);
+  hash = stringhash(key, len, dict->ignorecase);
+  i = dict_find(dict, key, hash, len);
+  if (i >= 0)
   {
-    if ((entry->hash == hash) && (strcmp(entry->key, key) == 0))
+    /* just set the new value */
+    if (value != NULL)
     {
-      /* check if we should unset the entry */
-      if (value == NULL)
-      {
-        /* remove from linked list */
-        if (prev == NULL)
-          dict->table[idx] = entry->next;
-        else
-          prev->next = entry->next;
-        /* free entry memory and register removal */
-        free(entry);
-        dict->num--;
-        return 0;
-      }
-      /* just set the new value */
-      entry->value = value;
+      dict->table[i].value = value;
       return 0;
     }
+    /* remove the entry (the key may point into the slot so do not use it
+       after this) */
+    if (dict->table[i].keylen >= DICT_INLINEKEY)
+      free(dict->table[i].key.ptr);
+    /* shift following entries back until one is in its preferred slot */
+    for (j = (uint32_t)i, next = (j + 1) & (dict->size - 1);
+         (dict->table[next].value != NULL) && (DICT_DIST(dict, next) != 0);
+         j = next, next = (next + 1) & (dict->size - 1))
+      dict->table[j] = dict->table[next];
+    dict->table[j].value = NULL;
+    dict->num--;
+    return 0;
   }
   /* if entry should be unset we're done */
   if (value == NULL)
     return 0;
-  /* entry is not present, make new entry */
-  l = strlen(key) + 1;
-  buf = (char *)malloc(sizeof(struct dict_entry) + l);
-  if (buf == NULL)
+  if (len > UINT32_MAX - 1)
+    return -1;
+  /* check if we should grow the hashtable */
+  if ((dict->num + 1) * 4 > dict->size * 3)
+    growhashtable(dict);
+  if (dict->num + 1 >= dict->size)
     return -1;
-  entry = (struct dict_entry *)(void *)buf;
-  buf += sizeof(struct dict_entry);
-  strcpy(buf, key);
-  entry->hash = hash;
-  entry->key = buf;
-  entry->value = value;
-  /* insert into hashtable/linked list */
-  entry->next = dict->table[idx];
-  dict->table[idx] = entry;
+  /* entry is not present, make new entry */
+  slot.hash = hash;
+  slot.keylen = (uint32_t)len;
+  slot.value = value;
+  if (len < DICT_INLINEKEY)
+    memcpy(slot.key.str, key, len + 1);
+  else
+  {
+    slot.key.ptr = (char *)malloc(len + 1);
+    if (slot.key.ptr == NULL)
+      return -1;
+    memcpy(slot.key.ptr, key, len + 1);
+  }
+  dict_place(dict, &slot);
   /* increment number of stored items */
   dict->num++;
   return 0;
@@ -247,8 +342,7 @@ int dict_put(DICT *dict, const char *key, void *value)
 
 const char **dict_keys(DICT *dict)
 {
-  int i;
-  struct dict_entry *entry;
+  uint32_t i;
   char *buf;
   const char **values;
   size_t sz;
@@ -258,12 +352,10 @@ const char **dict_keys(DICT *dict)
   sz = 0;
   for (i = 0; i < dict->size; i++)
   {
-    entry = dict->table[i];
-    while (entry != NULL)
+    if (dict->table[i].value != NULL)
     {
       num++;
-      sz += strlen(entry->key) + 1;
-      entry = entry->next;
+      sz += dict->table[i].keylen + 1;
     }
   }
   /* allocate the needed memory */
@@ -276,13 +368,11 @@ const char **dict_keys(DICT *dict)
   num = 0;
   for (i = 0; i < dict->size; i++)
   {
-    entry = dict->table[i];
-    while (entry != NULL)
+    if (dict->table[i].value != NULL)
     {
-      strcpy(buf, entry->key);
+      memcpy(buf, DICT_KEY(&dict->table[i]), dict->table[i].keylen + 1);
       values[num++] = buf;
-      buf += strlen(buf) + 1;
-      entry = entry->next;
+      buf += dict->table[i].keylen + 1;
     }
   }
   values[num] = NULL;
@@ -35,22 +35,30 @@ typedef struct dictionary DICT;
 DICT *dict_new(void)
   LIKE_MALLOC MUST_USE;
 
+/* Create a new instance of a dictionary that compares keys ignoring
+   the case of (ASCII) letters. Returns NULL in case of memory allocation
+   errors. */
+DICT *dict_new_ignorecase(void)
+  LIKE_MALLOC MUST_USE;
+
 /* Add a relation in the dictionary. The key is duplicated
    and can be reused by the caller. The pointer is just stored.
    This function returns non-zero in case of memory allocation
    errors. If the key was previously in use the value
-   is replaced. All key comparisons are case sensitive. */
+   is replaced. All key comparisons are case sensitive unless the
+   dictionary was created with dict_new_ignorecase(). */
 int dict_put(DICT *dict, const char *key, void *value);
 
 /* Look up a key in the dictionary and return the associated
    value. NULL is returned if the key is not found in the dictionary.
-   All key comparisons are case sensitive. */
+   All key comparisons are case sensitive unless the dictionary was
+   created with dict_new_ignorecase(). */
 void *dict_get(DICT *dict, const char *key)
   MUST_USE;
 
 /* Get a key from the dictionary that has a value set. The caller does
    not need to free the returned value (it is freed when dict_free()
-   is called). */
+   is called) but it is only valid until the dictionary is modified. */
 const char *dict_getany(DICT *dict);
 
 /* Delete a key-value association from the dictionary.
@@ -364,3 +364,387 @@ SET *expr_vars(const char *str, SET *set)
   }
   return set;
 }
+
+/* the maximum number of different variables in a compiled expression */
+#define EXPR_MAXVARS 16
+
+/* the types of nodes in a compiled expression */
+#define EXPR_TEXT        1 /* literal text */
+#define EXPR_VAR         2 /* $var or ${var} */
+#define EXPR_DEFAULT     3 /* ${var:-word} */
+#define EXPR_ALTERNATIVE 4 /* ${var:+word} */
+#define EXPR_SUBSTRING   5 /* ${var:offset:length} */
+#define EXPR_MATCH       6 /* ${var#word} */
+
+/* a node in the list that makes up a compiled expression */
+struct expr_node {
+  int type;
+  int var;                  /* the index of the variable */
+  struct expr_node *sub;    /* the word of default and alternative nodes */
+  unsigned long int offset; /* the offset for substring nodes */
+  unsigned long int length; /* the length for substring nodes */
+  char *text;               /* literal (unescaped) text or match pattern */
+  size_t len;               /* the length of text */
+  struct expr_node *next;
+};
+
+/* the compiled expression, the variable names are stored only once and
+   nodes refer to them by index */
+struct expr {
+  struct expr_node *first;
+  int numvars;
+  char vars[EXPR_MAXVARS][MAXVARLENGTH];
+};
+
+/* allocate a new node with room for text of the specified length */
+static struct expr_node *compile_node(int type, size_t len)
+{
+  struct expr_node *node;
+  node = (struct expr_node *)malloc(sizeof(struct expr_node) + len + 1);
+  if (node == NULL)
+    return NULL;
+  node->type = type;
+  node->var = -1;
+  node->sub = NULL;
+  node->offset = 0;
+  node->length = 0;
+  node->text = (char *)(node + 1);
+  node->text[0] = '\0';
+  node->len = len;
+  node->next = NULL;
+  return node;
+}
+
+static void compile_free(struct expr_node *node)
+{
+  struct expr_node *tmp;
+  while (node != NULL)
+  {
+    tmp = node->next;
+    if (node->sub != NULL)
+      compile_free(node->sub);
+    free(node);
+    node = tmp;
+  }
+}
+
+/* return the index of the variable in the expression, adding it if
+   needed */
+static int compile_var(EXPR *expr, const char *name)
+{
+  int i;
+  for (i = 0; i < expr->numvars; i++)
+    if (strcmp(expr->vars[i], name) == 0)
+      return i;
+  if (expr->numvars >= EXPR_MAXVARS)
+    return -1;
+  strcpy(expr->vars[expr->numvars], name);
+  return expr->numvars++;
+}
+
+/* definition of the compile functions (they call each other) */
+static int compile_expression(EXPR *expr, const char *str, int *ptr,
+                              int endat, struct expr_node **list);
+
+/* compile the part after the $ and append a node to the list,
+   returns non-zero on errors */
+static int compile_dollar_expression(EXPR *expr, const char *str, int *ptr,
+                                     struct expr_node **tail)
+{
+  char varname[MAXVARLENGTH];
+  struct expr_node *node;
+  char *tmp;
+  int start;
+  if (str[*ptr] == '{')
+  {
+    (*ptr)++;
+    /* the first part is always a variable name */
+    if (parse_name(str, ptr, varname, sizeof(varname)) == NULL)
+      return -1;
+    if (str[*ptr] == '}')
+    {
+      /* simple substitute */
+      if ((node = *tail = compile_node(EXPR_VAR, 0)) == NULL)
+        return -1;
+    }
+    else if ((strncmp(str + *ptr, ":-", 2) == 0) ||
+             (strncmp(str + *ptr, ":+", 2) == 0))
+    {
+      /* default or alternative value */
+      node = *tail = compile_node((str[*ptr + 1] == '-') ? EXPR_DEFAULT
+                                                         : EXPR_ALTERNATIVE, 0);
+      if (node == NULL)
+        return -1;
+      (*ptr) += 2;
+      if (compile_expression(expr, str, ptr, '}', &node->sub))
+        return -1;
+    }
+    else if (str[*ptr] == ':')
+    {
+      /* substring of variable */
+      if ((node = *tail = compile_node(EXPR_SUBSTRING, 0)) == NULL)
+        return -1;
+      tmp = (char *)str + *ptr + 1;
+      if (!my_isdigit(*tmp))
+        return -1;
+      errno = 0;
+      node->offset = strtoul(tmp, &tmp, 10);
+      if ((*tmp != ':') || (errno != 0))
+        return -1;
+      tmp += 1;
+      errno = 0;
+      node->length = strtoul(tmp, &tmp, 10);
+      if ((*tmp != '}') || (errno != 0))
+        return -1;
+      *ptr = tmp - str;
+    }
+    else if (str[*ptr] == '#')
+    {
+      /* match against the (still escaped) pattern */
+      (*ptr)++;
+      start = *ptr;
+      while ((str[*ptr] != '\0') && (str[*ptr] != '}'))
+      {
+        if ((str[*ptr] == '\\') && (str[++(*ptr)] == '\0'))
+          return -1;
+        (*ptr)++;
+      }
+      if (str[*ptr] == '\0')
+        return -1;
+      if ((node = *tail = compile_node(EXPR_MATCH, *ptr - start)) == NULL)
+        return -1;
+      memcpy(node->text, str + start, node->len);
+      node->text[node->len] = '\0';
+    }
+    else
+      return -1;
+    (*ptr)++; /* skip closing } */
+  }
+  else
+  {
+    /* it is a simple reference to a variable, like $uidNumber */
+    if (parse_name(str, ptr, varname, sizeof(varname)) == NULL)
+      return -1;
+    if ((node = *tail = compile_node(EXPR_VAR, 0)) == NULL)
+      return -1;
+  }
+  node->var = compile_var(expr, varname);
+  return (node->var < 0) ? -1 : 0;
+}
+
+/* compile the expression up to endat into the list of nodes, returns
+   non-zero on errors (the list may then be partially filled) */
+static int compile_expression(EXPR *expr, const char *str, int *ptr,
+                              int endat, struct expr_node **list)
+{
+  struct expr_node *node;
+  int i;
+  size_t len;
+  *list = NULL;
+  while ((str[*ptr] != endat) && (str[*ptr] != '\0'))
+  {
+    if (str[*ptr] == '$')
+    {
+      (*ptr)++;
+      if (compile_dollar_expression(expr, str, ptr, list))
+        return -1;
+    }
+    else
+    {
+      /* find the end of the literal text */
+      for (i = *ptr, len = 0;
+           (str[i] != endat) && (str[i] != '\0') && (str[i] != '$'); i++, len++)
+        if ((str[i] == '\\') && (str[++i] == '\0'))
+          return -1;
+      if ((node = *list = compile_node(EXPR_TEXT, len)) == NULL)
+        return -1;
+      /* copy the unescaped text */
+      for (len = 0; *ptr < i; (*ptr)++)
+      {
+        if (str[*ptr] == '\\')
+          (*ptr)++;
+        node->text[len++] = str[*ptr];
+      }
+      node->text[len] = '\0';
+    }
+    list = &((*list)->next);
+  }
+  /* the closing brace should be present */
+  return (str[*ptr] != endat) ? -1 : 0;
+}
+
+EXPR *expr_compile(const char *str)
+{
+  EXPR *expr;
+  int i = 0;
+  expr = (EXPR *)malloc(sizeof(EXPR));
+  if (expr == NULL)
+    return NULL;
+  expr->numvars = 0;
+  if (compile_expression(expr, str, &i, '\0', &expr->first))
+  {
+    expr_free(expr);
+    return NULL;
+  }
+  return expr;
+}
+
+void expr_free(EXPR *expr)
+{
+  compile_free(expr->first);
+  free(expr);
+}
+
+const char *expr_var(const EXPR *expr, int var)
+{
+  if ((var < 0) || (var >= expr->numvars))
+    return NULL;
+  return expr->vars[var];
+}
+
+/* return the part of varvalue that remains after stripping the pattern
+   (see parse_dollar_match()) */
+static const char *eval_match(const char *pattern, const char *varvalue)
+{
+  char c;
+  const char *cp = pattern, *vp = varvalue;
+  int ismatch = 1;
+  while ((c = *cp++) != '\0')
+  {
+    if (ismatch && (*vp == '\0'))
+      ismatch = 0; /* varvalue shorter than trim string */
+    if (c == '?')
+    {
+      /* match any one character */
+      vp++;
+      continue;
+    }
+    if (c == '\\')
+      c = *cp++; /* escape the next character */
+    if (ismatch && (*vp != c))
+      ismatch = 0; /* they differ */
+    vp++;
+  }
+  return ismatch ? vp : varvalue;
+}
+
+/* append the evaluated nodes to the buffer at *pos, the values of variables
+   are looked up once and stored in values, returns non-zero if the result
+   does not fit */
+static int eval_nodes(const EXPR *expr, const struct expr_node *node,
+                      char *buffer, size_t buflen, size_t *pos,
+                      const char **values,
+                      expr_slot_expander_func expander, void *expander_arg)
+{
+  const char *str = NULL;
+  size_t len = 0;
+  for (; node != NULL; node = node->next)
+  {
+    if (node->type == EXPR_TEXT)
+    {
+      str = node->text;
+      len = node->len;
+    }
+    else
+    {
+      /* look up the value of the variable */
+      if (values[node->var] == NULL)
+      {
+        values[node->var] = expander(node->var, expander_arg);
+        if (values[node->var] == NULL)
+          values[node->var] = "";
+      }
+      str = values[node->var];
+      switch (node->type)
+      {
+        case EXPR_VAR:
+          len = strlen(str);
+          break;
+        case EXPR_DEFAULT:
+          if (*str == '\0')
+          {
+            if (eval_nodes(expr, node->sub, buffer, buflen, pos, values,
+                           expander, expander_arg))
+              return -1;
+            continue;
+          }
+          len = strlen(str);
+          break;
+        case EXPR_ALTERNATIVE:
+          if ((*str != '\0') &&
+              (eval_nodes(expr, node->sub, buffer, buflen, pos, values,
+                          expander, expander_arg)))
+            return -1;
+          continue;
+        case EXPR_SUBSTRING:
+          len = strlen(str);
+          if (node->offset < len)
+          {
+            str += node->offset;
+            len -= node->offset;
+          }
+          else
+          {
+            str += len;
+            len = 0;
+          }
+          if (node->length < len)
+            len = node->length;
+          break;
+        case EXPR_MATCH:
+          str = eval_match(node->text, str);
+          len = strlen(str);
+          break;
+      }
+    }
+    if (*pos + len >= buflen)
+      return -1;
+    memcpy(buffer + *pos, str, len);
+    *pos += len;
+  }
+  return 0;
+}
+
+MUST_USE const char *expr_eval_slots(const EXPR *expr,
+                                     char *buffer, size_t buflen,
+                                     expr_slot_expander_func expander,
+                                     void *expander_arg)
+{
+  const char *values[EXPR_MAXVARS];
+  size_t pos = 0;
+  int i;
+  if ((buffer == NULL) || (buflen <= 0))
+    return NULL;
+  for (i = 0; i < expr->numvars; i++)
+    values[i] = NULL;
+  if (eval_nodes(expr, expr->first, buffer, buflen, &pos, values,
+                 expander, expander_arg))
+    return NULL;
+  buffer[pos] = '\0';
+  return buffer;
+}
+
+/* the information needed to call a name based expander from
+   expr_eval_slots() */
+struct eval_byname {
+  const EXPR *expr;
+  expr_expander_func expander;
+  void *expander_arg;
+};
+
+static const char *eval_byname_expander(int var, void *expander_arg)
+{
+  struct eval_byname *byname = (struct eval_byname *)expander_arg;
+  return byname->expander(byname->expr->vars[var], byname->expander_arg);
+}
+
+MUST_USE const char *expr_eval(const EXPR *expr, char *buffer, size_t buflen,
+                               expr_expander_func expander, void *expander_arg)
+{
+  struct eval_byname byname;
+  byname.expr = expr;
+  byname.expander = expander;
+  byname.expander_arg = expander_arg;
+  return expr_eval_slots(expr, buffer, buflen, eval_byname_expander,
+                         &byname);
+}
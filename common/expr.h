@@ -38,4 +38,36 @@ MUST_USE const char *expr_parse(const char *expr, char *buffer, size_t buflen,
    is allocated, otherwise the passed set is added to. */
 SET *expr_vars(const char *expr, SET *set);
 
+/* A compiled version of an expression. */
+typedef struct expr EXPR;
+
+/* Parse the expression once into a form that can be evaluated quickly.
+   Returns NULL if the expression is invalid (or cannot be compiled) or in
+   case of memory allocation errors. */
+MUST_USE EXPR *expr_compile(const char *expr);
+
+/* Evaluate the compiled expression in the same way as expr_parse(). The
+   expander function is called at most once for each variable so the
+   returned values should remain valid during the evaluation. */
+MUST_USE const char *expr_eval(const EXPR *expr, char *buffer, size_t buflen,
+                               expr_expander_func expander, void *expander_arg);
+
+/* Return the name of the variable with the specified index in the compiled
+   expression or NULL if the expression has fewer variables. Each variable
+   is listed only once. */
+const char *expr_var(const EXPR *expr, int var);
+
+typedef const char *(*expr_slot_expander_func) (int var, void *expander_arg);
+
+/* The same as expr_eval() but the expander is called with the index of the
+   variable (see expr_var()) instead of its name, so callers can resolve
+   the variables once after compiling the expression. */
+MUST_USE const char *expr_eval_slots(const EXPR *expr,
+                                     char *buffer, size_t buflen,
+                                     expr_slot_expander_func expander,
+                                     void *expander_arg);
+
+/* Free the memory of the compiled expression. */
+void expr_free(EXPR *expr);
+
 #endif /* not _COMMON__ */
@@ -41,6 +41,11 @@ SET *set_new(void)
   return (SET *)dict_new();
 }
 
+SET *set_new_ignorecase(void)
+{
+  return (SET *)dict_new_ignorecase();
+}
+
 int set_add(SET *set, const char *value)
 {
   return dict_put((DICT *)set, value, set);
@@ -36,14 +36,21 @@ typedef struct set SET;
 SET *set_new(void)
   LIKE_MALLOC MUST_USE;
 
+/* Create a new instance of a set that compares values ignoring the case
+   of (ASCII) letters. Returns NULL in case of memory allocation errors. */
+SET *set_new_ignorecase(void)
+  LIKE_MALLOC MUST_USE;
+
 /* Add a string in the set. The value is duplicated
    and can be reused by the caller.
    This function returns non-zero in case of memory allocation
-   errors. All value comparisons are case sensitive. */
+   errors. All value comparisons are case sensitive unless the set was
+   created with set_new_ignorecase(). */
 int set_add(SET *set, const char *value);
 
 /* Return non-zero if the value is in the set.
-   All value comparisons are case sensitive. */
+   All value comparisons are case sensitive unless the set was created
+   with set_new_ignorecase(). */
 int set_contains(SET *set, const char *value)
   MUST_USE;
 
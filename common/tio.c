@@ -30,6 +30,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
@@ -45,6 +46,11 @@
 #define ETIME ETIMEDOUT
 #endif /* ETIME */
 
+/* writes of at least this size that do not fit in the write buffer are
+   sent straight from the caller's memory together with the buffered data
+   instead of being copied into the buffer first */
+#define TIO_DIRECT_WRITE_MIN 1024
+
 /* structure that holds a buffer
    the buffer contains the data that is between the application and the
    file descriptor that is used for efficient transfer
@@ -55,6 +61,7 @@
 struct tio_buffer {
   uint8_t *buffer;
   size_t size;      /* the size of the buffer */
+  size_t initsize;  /* the initial size of the buffer */
   size_t maxsize;   /* the maximum size of the buffer */
   size_t start;     /* the start of the data (before start is unused) */
   size_t len;       /* size of the data (from the start) */
@@ -68,6 +75,7 @@ struct tio_fileinfo {
   int readtimeout;
   int writetimeout;
   int read_resettable; /* whether the tio_reset() function can be called */
+  int tryfirst;        /* whether to read or write before polling */
 #ifdef DEBUG_TIO_STATS
   /* this is used to collect statistics on the use of the streams
      and can be used to tune the buffer sizes */
@@ -126,6 +134,7 @@ TFILE *tio_fdopen(int fd, int readtimeout, int writetimeout,
     return NULL;
   }
   fp->readbuffer.size = initreadsize;
+  fp->readbuffer.initsize = initreadsize;
   fp->readbuffer.maxsize = maxreadsize;
   fp->readbuffer.start = 0;
   fp->readbuffer.len = 0;
@@ -138,6 +147,7 @@ TFILE *tio_fdopen(int fd, int readtimeout, int writetimeout,
     return NULL;
   }
   fp->writebuffer.size = initwritesize;
+  fp->writebuffer.initsize = initwritesize;
   fp->writebuffer.maxsize = maxwritesize;
   fp->writebuffer.start = 0;
   fp->writebuffer.len = 0;
@@ -145,6 +155,11 @@ TFILE *tio_fdopen(int fd, int readtimeout, int writetimeout,
   fp->readtimeout = readtimeout;
   fp->writetimeout = writetimeout;
   fp->read_resettable = 0;
+#ifdef MSG_DONTWAIT
+  fp->tryfirst = 1;
+#else /* not MSG_DONTWAIT */
+  fp->tryfirst = 0;
+#endif /* not MSG_DONTWAIT */
 #ifdef DEBUG_TIO_STATS
   fp->byteswritten = 0;
   fp->bytesread = 0;
@@ -190,6 +205,32 @@ static int tio_wait(int fd, short events, int timeout,
   }
 }
 
+/* read data from the file descriptor into the buffer, first trying a
+   read that does not block and only waiting for input if no data was
+   available (this saves a poll() and clock_gettime() call if the data
+   is already there) */
+static int tio_readnow(TFILE *fp, uint8_t *buf, size_t len,
+                       struct timespec *deadline)
+{
+#ifdef MSG_DONTWAIT
+  int rv;
+  if (fp->tryfirst)
+  {
+    rv = recv(fp->fd, buf, len, MSG_DONTWAIT);
+    if ((rv >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+                      (errno != EINTR) && (errno != ENOTSOCK)))
+      return rv;
+    /* not a socket, always poll from now on */
+    if (errno == ENOTSOCK)
+      fp->tryfirst = 0;
+  }
+#endif /* MSG_DONTWAIT */
+  /* wait until we have input */
+  if (tio_wait(fp->fd, POLLIN, fp->readtimeout, deadline))
+    return -1;
+  return read(fp->fd, buf, len);
+}
+
 /* do a read on the file descriptor, returning the data in the buffer
    if no data was read in the specified time an error is returned */
 int tio_read(TFILE *fp, void *buf, size_t count)
@@ -258,16 +299,14 @@ int tio_read(TFILE *fp, void *buf, size_t count)
         fp->read_resettable = 0;
       }
     }
-    /* wait until we have input */
-    if (tio_wait(fp->fd, POLLIN, fp->readtimeout, &deadline))
-      return -1;
     /* read the input in the buffer */
     len = fp->readbuffer.size - fp->readbuffer.start;
 #ifdef SSIZE_MAX
     if (len > SSIZE_MAX)
       len = SSIZE_MAX;
 #endif /* SSIZE_MAX */
-    rv = read(fp->fd, fp->readbuffer.buffer + fp->readbuffer.start, len);
+    rv = tio_readnow(fp, fp->readbuffer.buffer + fp->readbuffer.start, len,
+                     &deadline);
     /* check for errors */
     if (rv == 0)
     {
@@ -322,15 +361,33 @@ int tio_skipall(TFILE *fp, int timeout)
   }
 }
 
+/* whether writes can be done without waiting first because they will not
+   block */
+static inline int tio_cantryfirst(TFILE *fp)
+{
+#if defined(MSG_NOSIGNAL) && defined(MSG_DONTWAIT)
+  return fp->tryfirst;
+#else /* not (MSG_NOSIGNAL && MSG_DONTWAIT) */
+  (void)fp;
+  return 0;
+#endif /* not (MSG_NOSIGNAL && MSG_DONTWAIT) */
+}
+
 /* the caller has assured us that we can write to the file descriptor
-   and we give it a shot */
+   (or that the write will not block) and we give it a shot */
 static int tio_writebuf(TFILE *fp)
 {
   int rv;
   /* write the buffer */
 #ifdef MSG_NOSIGNAL
+#ifdef MSG_DONTWAIT
+  rv = send(fp->fd, fp->writebuffer.buffer + fp->writebuffer.start,
+            fp->writebuffer.len,
+            fp->tryfirst ? (MSG_NOSIGNAL | MSG_DONTWAIT) : MSG_NOSIGNAL);
+#else /* not MSG_DONTWAIT */
   rv = send(fp->fd, fp->writebuffer.buffer + fp->writebuffer.start,
             fp->writebuffer.len, MSG_NOSIGNAL);
+#endif /* not MSG_DONTWAIT */
 #else /* not MSG_NOSIGNAL */
   /* on platforms that cannot use send() with masked signals, we change the
      signal mask and change it back after the write (note that there is a
@@ -353,7 +410,8 @@ static int tio_writebuf(TFILE *fp)
     return -1; /* error restoring signal handler */
 #endif
   /* check for errors */
-  if ((rv == 0) || ((rv < 0) && (errno != EINTR) && (errno != EAGAIN)))
+  if ((rv == 0) || ((rv < 0) && (errno != EINTR) && (errno != EAGAIN) &&
+                    (errno != EWOULDBLOCK)))
     return -1; /* something went wrong with the write */
   /* skip the written part in the buffer */
   if (rv > 0)
@@ -382,15 +440,21 @@ static int tio_writebuf(TFILE *fp)
 int tio_flush(TFILE *fp)
 {
   struct timespec deadline = {0, 0};
+  size_t len;
+  /* only wait before the first write if it could block */
+  int mustwait = !tio_cantryfirst(fp);
   /* loop until we have written our buffer */
   while (fp->writebuffer.len > 0)
   {
     /* wait until we can write */
-    if (tio_wait(fp->fd, POLLOUT, fp->writetimeout, &deadline))
+    if (mustwait && tio_wait(fp->fd, POLLOUT, fp->writetimeout, &deadline))
       return -1;
     /* write one block */
+    len = fp->writebuffer.len;
     if (tio_writebuf(fp))
       return -1;
+    /* wait before the next write if nothing could be written */
+    mustwait = (!tio_cantryfirst(fp)) || (fp->writebuffer.len == len);
   }
   return 0;
 }
@@ -401,6 +465,9 @@ static int tio_flush_nonblock(TFILE *fp)
 {
   struct pollfd fds[1];
   int rv;
+  /* the write itself will not block */
+  if (tio_cantryfirst(fp))
+    return tio_writebuf(fp);
   /* see if we can write without blocking */
   fds[0].fd = fp->fd;
   fds[0].events = POLLOUT;
@@ -416,6 +483,74 @@ static int tio_flush_nonblock(TFILE *fp)
   return tio_writebuf(fp);
 }
 
+#ifdef MSG_NOSIGNAL
+/* send the buffered data and the provided data with a single sendmsg()
+   call without copying the data into the buffer, any part of the data
+   that was not sent is buffered once it fits */
+static int tio_writedirect(TFILE *fp, const uint8_t *ptr, size_t count)
+{
+  struct timespec deadline = {0, 0};
+  struct iovec iov[2];
+  struct msghdr msg;
+  ssize_t rv;
+  size_t done;
+  int flags = MSG_NOSIGNAL;
+  int mustwait = !tio_cantryfirst(fp);
+#ifdef MSG_DONTWAIT
+  if (tio_cantryfirst(fp))
+    flags |= MSG_DONTWAIT;
+#endif /* MSG_DONTWAIT */
+  while (count > (fp->writebuffer.size - (fp->writebuffer.start + fp->writebuffer.len)))
+  {
+    /* wait until we can write */
+    if (mustwait && tio_wait(fp->fd, POLLOUT, fp->writetimeout, &deadline))
+      return -1;
+    /* write the buffered data followed by the new data */
+    memset(&msg, 0, sizeof(struct msghdr));
+    iov[0].iov_base = fp->writebuffer.buffer + fp->writebuffer.start;
+    iov[0].iov_len = fp->writebuffer.len;
+    iov[1].iov_base = (void *)ptr;
+    iov[1].iov_len = count;
+    msg.msg_iov = (fp->writebuffer.len > 0) ? iov : iov + 1;
+    msg.msg_iovlen = (fp->writebuffer.len > 0) ? 2 : 1;
+    rv = sendmsg(fp->fd, &msg, flags);
+    if ((rv == 0) || ((rv < 0) && (errno != EINTR) && (errno != EAGAIN) &&
+                      (errno != EWOULDBLOCK)))
+      return -1; /* something went wrong with the write */
+    /* wait before the next write if nothing could be written */
+    mustwait = (!tio_cantryfirst(fp)) || (rv <= 0);
+    if (rv <= 0)
+      continue;
+#ifdef DEBUG_TIO_STATS
+    fp->byteswritten += rv;
+#endif /* DEBUG_TIO_STATS */
+    /* skip the written part in the buffer and the data */
+    done = (size_t)rv;
+    if (done >= fp->writebuffer.len)
+    {
+      done -= fp->writebuffer.len;
+      fp->writebuffer.start = 0;
+      fp->writebuffer.len = 0;
+      ptr += done;
+      count -= done;
+    }
+    else
+    {
+      fp->writebuffer.start += done;
+      fp->writebuffer.len -= done;
+    }
+  }
+  /* buffer what is left */
+  if (count > 0)
+  {
+    memcpy(fp->writebuffer.buffer + fp->writebuffer.start +
+           fp->writebuffer.len, ptr, count);
+    fp->writebuffer.len += count;
+  }
+  return 0;
+}
+#endif /* MSG_NOSIGNAL */
+
 int tio_write(TFILE *fp, const void *buf, size_t count)
 {
   size_t fr;
@@ -435,6 +570,13 @@ int tio_write(TFILE *fp, const void *buf, size_t count)
       fp->writebuffer.len += count;
       return 0;
     }
+#ifdef MSG_NOSIGNAL
+    else if (count >= TIO_DIRECT_WRITE_MIN)
+    {
+      /* avoid copying large blocks of data into the buffer */
+      return tio_writedirect(fp, ptr, count);
+    }
+#endif /* MSG_NOSIGNAL */
     else if (fr > 0)
     {
       /* fill the buffer with data that will fit */
@@ -482,7 +624,7 @@ int tio_close(TFILE *fp)
           (unsigned long)fp->bytesread, (unsigned long)fp->byteswritten);
 #endif /* DEBUG_TIO_STATS */
   /* close file descriptor */
-  if (close(fp->fd))
+  if ((fp->fd >= 0) && (close(fp->fd)))
     retv = -1;
   /* free any allocated buffers */
   memset(fp->readbuffer.buffer, 0, fp->readbuffer.size);
@@ -495,6 +637,57 @@ int tio_close(TFILE *fp)
   return retv;
 }
 
+/* clear the buffer and shrink it back to its initial size */
+static void tio_clearbuffer(struct tio_buffer *buf)
+{
+  uint8_t *tmp;
+  if (buf->size > buf->initsize)
+  {
+    tmp = (uint8_t *)malloc(buf->initsize);
+    if (tmp != NULL)
+    {
+      memset(buf->buffer, 0, buf->size);
+      free(buf->buffer);
+      buf->buffer = tmp;
+      buf->size = buf->initsize;
+    }
+  }
+  memset(buf->buffer, 0, buf->size);
+  buf->start = 0;
+  buf->len = 0;
+}
+
+int tio_closefd(TFILE *fp)
+{
+  int retv;
+  /* write any buffered data */
+  retv = tio_flush(fp);
+  /* close file descriptor */
+  if ((fp->fd >= 0) && (close(fp->fd)))
+    retv = -1;
+  fp->fd = -1;
+  /* clear the buffers but keep them for the next file descriptor */
+  tio_clearbuffer(&(fp->readbuffer));
+  tio_clearbuffer(&(fp->writebuffer));
+  fp->read_resettable = 0;
+  return retv;
+}
+
+void tio_reopen(TFILE *fp, int fd)
+{
+  fp->fd = fd;
+  fp->readbuffer.start = 0;
+  fp->readbuffer.len = 0;
+  fp->writebuffer.start = 0;
+  fp->writebuffer.len = 0;
+  fp->read_resettable = 0;
+#ifdef MSG_DONTWAIT
+  fp->tryfirst = 1;
+#else /* not MSG_DONTWAIT */
+  fp->tryfirst = 0;
+#endif /* not MSG_DONTWAIT */
+}
+
 void tio_mark(TFILE *fp)
 {
   /* move any data in the buffer to the start of the buffer */
@@ -70,6 +70,14 @@ int tio_flush(TFILE *fp);
 /* Flush the streams and closes the underlying file descriptor. */
 int tio_close(TFILE *fp);
 
+/* Flush the streams and close the underlying file descriptor but keep the
+   TFILE and its buffers so it can be used again with tio_reopen(). */
+int tio_closefd(TFILE *fp);
+
+/* Use the TFILE (that was closed with tio_closefd()) for the new file
+   descriptor. */
+void tio_reopen(TFILE *fp, int fd);
+
 /* Store the current position in the stream so that we can jump back to it
    with the tio_reset() function. */
 void tio_mark(TFILE *fp);
@@ -44,9 +44,10 @@
    If a response would return multiple values (e.g. for NSLCD_ACTION_*_ALL
    functions) each return value will be preceded by a NSLCD_RESULT_BEGIN
    value. After the last returned result the server sends
-   NSLCD_RESULT_END. If some error occurs (e.g. LDAP server unavailable,
-   error in the request, etc) the server terminates the connection to signal
-   an error condition (breaking the protocol).
+   NSLCD_RESULT_END. Lookups of a single user or group by name or number
+   only return the first matching result. If some error occurs (e.g. LDAP
+   server unavailable, error in the request, etc) the server terminates the
+   connection to signal an error condition (breaking the protocol).
 
    These are the available basic data types:
      INT32  - 32-bit integer value
@@ -100,10 +101,15 @@
      STRING       group password
      INT32        group id
      STRINGLIST   members (usernames) of the group
-     (not that the BYMEMER call returns an emtpy members list) */
+     (not that the BYMEMER call returns an emtpy members list)
+   The GIDS_BYMEMBER request only returns the group ids of the groups the
+   user is a member of in a single result entry:
+     INT32        number of group ids
+     INT32        group id (repeated for the number of group ids) */
 #define NSLCD_ACTION_GROUP_BYNAME      0x00040001
 #define NSLCD_ACTION_GROUP_BYGID       0x00040002
 #define NSLCD_ACTION_GROUP_BYMEMBER    0x00040006
+#define NSLCD_ACTION_GROUP_GIDS_BYMEMBER 0x00040007
 #define NSLCD_ACTION_GROUP_ALL         0x00040008
 
 /* Hostname (/etc/hosts) lookup NSS requests. The result values
@@ -251,6 +257,25 @@
      STRING  error message */
 #define NSLCD_ACTION_PAM_PWMOD         0x000d0005
 
+/* PAM combined login request. This performs the authentication check,
+   the authorisation check and the session open in one request so the
+   user only needs to be looked up once. The extra request values are:
+     STRING  password
+   and the result value consists of:
+     INT32   authc NSLCD_PAM_* result code
+     STRING  user name (the canonical user name)
+     INT32   authz NSLCD_PAM_* result code
+     STRING  authorisation error message
+     INT32   account NSLCD_PAM_* result code
+     STRING  account error message
+     STRING  session id
+   The authc, user name and authz values are the same as for the
+   NSLCD_ACTION_PAM_AUTHC request. The account values are those the
+   NSLCD_ACTION_PAM_AUTHZ request would return and the session id is one
+   that NSLCD_ACTION_PAM_SESS_O would return. The account values and the
+   session id are only meaningful if authentication succeeded. */
+#define NSLCD_ACTION_PAM_LOGIN         0x000d0006
+
 /* User information change request. This request allows one to change
    their full name and other information. The request parameters for this
    request are:
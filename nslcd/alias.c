@@ -59,21 +59,15 @@ const char *attmap_alias_rfc822MailMember = "rfc822MailMember";
 /* the attribute list to request with searches */
 static const char *alias_attrs[3];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE alias_byname_template;
+
 /* create a search filter for searching an alias by name,
    return -1 on errors */
 static int mkfilter_alias_byname(const char *name,
                                  char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_alias_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    alias_filter, attmap_alias_cn, safename);
+  return filter_template_build(&alias_byname_template, name, buffer, buflen);
 }
 
 void alias_init(void)
@@ -90,6 +84,8 @@ void alias_init(void)
   alias_attrs[0] = attmap_alias_cn;
   alias_attrs[1] = attmap_alias_rfc822MailMember;
   alias_attrs[2] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&alias_byname_template, alias_filter, attmap_alias_cn);
 }
 
 static int write_alias(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqalias)
@@ -97,6 +93,7 @@ static int write_alias(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqalias)
   int32_t tmpint32, tmp2int32, tmp3int32;
   const char **names, **members;
   int i;
+  int num = 0;
   /* get the name of the alias */
   names = myldap_get_values(entry, attmap_alias_cn);
   if ((names == NULL) || (names[0] == NULL))
@@ -115,9 +112,10 @@ static int write_alias(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqalias)
       WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
       WRITE_STRING(fp, names[i]);
       WRITE_STRINGLIST(fp, members);
+      num++;
     }
   }
-  return 0;
+  return num;
 }
 
 NSLCD_HANDLE(
@@ -130,7 +128,7 @@ NSLCD_HANDLE(
   write_alias(fp, entry, name)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   alias, all, NSLCD_ACTION_ALIAS_ALL,
   const char *filter;
   log_setrequest("alias(all)");,
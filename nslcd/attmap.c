@@ -176,6 +176,7 @@ const char **attmap_get_var(enum ldap_map_selector map, const char *name)
     if (strcasecmp(name, "gecos") == 0)             return &attmap_passwd_gecos;
     if (strcasecmp(name, "homeDirectory") == 0)     return &attmap_passwd_homeDirectory;
     if (strcasecmp(name, "loginShell") == 0)        return &attmap_passwd_loginShell;
+    if (strcasecmp(name, "memberOf") == 0)          return &attmap_passwd_memberOf;
   }
   else if (map == LM_PROTOCOLS)
   {
@@ -208,29 +209,47 @@ const char **attmap_get_var(enum ldap_map_selector map, const char *name)
   return NULL;
 }
 
+/* these attributes may contain an expression
+   (note that this needs to match the functionality in the specific
+   lookup module) */
+static const char **attmap_expression_vars[] = {
+  &attmap_group_userPassword,
+  &attmap_group_member,
+  &attmap_passwd_userPassword,
+  &attmap_passwd_gidNumber,
+  &attmap_passwd_gecos,
+  &attmap_passwd_homeDirectory,
+  &attmap_passwd_loginShell,
+  &attmap_shadow_userPassword,
+  &attmap_shadow_shadowLastChange,
+  &attmap_shadow_shadowMin,
+  &attmap_shadow_shadowMax,
+  &attmap_shadow_shadowWarning,
+  &attmap_shadow_shadowInactive,
+  &attmap_shadow_shadowExpire,
+  &attmap_shadow_shadowFlag,
+  NULL
+};
+
+/* the compiled versions of the expressions in the above variables, the
+   slots hold the attribute name for each variable of the expression (or
+   NULL for the DN) */
+static struct {
+  const char *source;
+  EXPR *expr;
+  const char **slots;
+} attmap_compiled[sizeof(attmap_expression_vars) / sizeof(const char **)];
+
 const char *attmap_set_mapping(const char **var, const char *value)
 {
+  int i;
   /* check if we are setting an expression */
   if (value[0] == '"')
   {
-    /* these attributes may contain an expression
-       (note that this needs to match the functionality in the specific
-       lookup module) */
-    if ((var != &attmap_group_userPassword) &&
-        (var != &attmap_group_member) &&
-        (var != &attmap_passwd_userPassword) &&
-        (var != &attmap_passwd_gidNumber) &&
-        (var != &attmap_passwd_gecos) &&
-        (var != &attmap_passwd_homeDirectory) &&
-        (var != &attmap_passwd_loginShell) &&
-        (var != &attmap_shadow_userPassword) &&
-        (var != &attmap_shadow_shadowLastChange) &&
-        (var != &attmap_shadow_shadowMin) &&
-        (var != &attmap_shadow_shadowMax) &&
-        (var != &attmap_shadow_shadowWarning) &&
-        (var != &attmap_shadow_shadowInactive) &&
-        (var != &attmap_shadow_shadowExpire) &&
-        (var != &attmap_shadow_shadowFlag))
+    for (i = 0; (attmap_expression_vars[i] != NULL) &&
+                (attmap_expression_vars[i] != var); i++)
+      /* nothing */ ;
+    if (attmap_expression_vars[i] == NULL)
       return NULL;
     /* the member attribute may only be set to an empty string */
     if ((var == &attmap_group_member) && (strcmp(value, "\"\"") != 0))
@@ -242,12 +261,70 @@ const char *attmap_set_mapping(const char **var, const char *value)
   return *var;
 }
 
-static const char *entry_expand(const char *name, void *expander_attr)
+/* look up the variables of the compiled expression once so evaluating it
+   does not need to compare the variable names, returns NULL on memory
+   allocation errors */
+static const char **attmap_compile_slots(const EXPR *expr)
+{
+  const char **slots;
+  const char *name;
+  int num;
+  for (num = 0; expr_var(expr, num) != NULL; num++)
+    /* nothing */ ;
+  /* allocate one extra to not depend on malloc(0) for constant strings */
+  slots = (const char **)malloc((num + 1) * sizeof(const char *));
+  if (slots == NULL)
+    return NULL;
+  for (num = 0; (name = expr_var(expr, num)) != NULL; num++)
+    slots[num] = (strcasecmp(name, "dn") == 0) ? NULL : name;
+  return slots;
+}
+
+void attmap_compile(void)
+{
+  int i, j = 0;
+  const char *value;
+  for (i = 0; attmap_expression_vars[i] != NULL; i++)
+  {
+    value = *attmap_expression_vars[i];
+    if ((value == NULL) || (value[0] != '"') || (strcmp(value, "\"\"") == 0))
+      continue;
+    /* invalid expressions are reported by attmap_get_value() */
+    if (attmap_compiled[j].expr != NULL)
+      expr_free(attmap_compiled[j].expr);
+    if (attmap_compiled[j].slots != NULL)
+      free(attmap_compiled[j].slots);
+    attmap_compiled[j].source = value;
+    attmap_compiled[j].expr = expr_compile(value + 1);
+    attmap_compiled[j].slots = NULL;
+    if (attmap_compiled[j].expr == NULL)
+      continue;
+    attmap_compiled[j].slots = attmap_compile_slots(attmap_compiled[j].expr);
+    if (attmap_compiled[j].slots == NULL)
+    {
+      expr_free(attmap_compiled[j].expr);
+      attmap_compiled[j].expr = NULL;
+      continue;
+    }
+    j++;
+  }
+  /* clear the remaining entries */
+  for (; attmap_compiled[j].source != NULL; j++)
+  {
+    if (attmap_compiled[j].expr != NULL)
+      expr_free(attmap_compiled[j].expr);
+    if (attmap_compiled[j].slots != NULL)
+      free(attmap_compiled[j].slots);
+    attmap_compiled[j].source = NULL;
+    attmap_compiled[j].expr = NULL;
+    attmap_compiled[j].slots = NULL;
+  }
+}
+
+/* get the single value of the attribute for use in an expression */
+static const char *entry_value(MYLDAP_ENTRY *entry, const char *name)
 {
-  MYLDAP_ENTRY *entry = (MYLDAP_ENTRY *)expander_attr;
   const char **values;
-  if (strcasecmp(name, "dn") == 0)
-    return myldap_get_dn(entry);
   values = myldap_get_values(entry, name);
   if (values == NULL)
     return "";
@@ -260,10 +337,35 @@ static const char *entry_expand(const char *name, void *expander_attr)
   return values[0];
 }
 
+static const char *entry_expand(const char *name, void *expander_attr)
+{
+  MYLDAP_ENTRY *entry = (MYLDAP_ENTRY *)expander_attr;
+  if (strcasecmp(name, "dn") == 0)
+    return myldap_get_dn(entry);
+  return entry_value(entry, name);
+}
+
+/* the entry and the resolved variables of a compiled expression */
+struct entry_slots {
+  MYLDAP_ENTRY *entry;
+  const char **slots;
+};
+
+static const char *entry_expand_slot(int var, void *expander_attr)
+{
+  struct entry_slots *arg = (struct entry_slots *)expander_attr;
+  if (arg->slots[var] == NULL)
+    return myldap_get_dn(arg->entry);
+  return entry_value(arg->entry, arg->slots[var]);
+}
+
 const char *attmap_get_value(MYLDAP_ENTRY *entry, const char *attr,
                              char *buffer, size_t buflen)
 {
   const char **values;
+  const char *res;
+  struct entry_slots arg;
+  int i;
   /* check and clear buffer */
   if ((buffer == NULL) || (buflen <= 0))
     return NULL;
@@ -285,9 +387,20 @@ const char *attmap_get_value(MYLDAP_ENTRY *entry, const char *attr,
     return buffer;
     /* TODO: maybe warn when multiple values are found */
   }
-  /* we have an expression, try to parse */
-  if ((attr[strlen(attr) - 1] != '"') ||
-      (expr_parse(attr + 1, buffer, buflen, entry_expand, (void *)entry) == NULL))
+  /* we have an expression, use the compiled version if available */
+  for (i = 0; (attmap_compiled[i].source != NULL) &&
+              (attmap_compiled[i].source != attr); i++)
+    /* nothing */ ;
+  if (attmap_compiled[i].source != NULL)
+  {
+    arg.entry = entry;
+    arg.slots = attmap_compiled[i].slots;
+    res = expr_eval_slots(attmap_compiled[i].expr, buffer, buflen,
+                          entry_expand_slot, (void *)&arg);
+  }
+  else
+    res = expr_parse(attr + 1, buffer, buflen, entry_expand, (void *)entry);
+  if ((attr[strlen(attr) - 1] != '"') || (res == NULL))
   {
     log_log(LOG_ERR, "attribute mapping %s is invalid", attr);
     buffer[0] = '\0';
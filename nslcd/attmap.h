@@ -51,6 +51,7 @@ extern const char *attmap_passwd_gidNumber;
 extern const char *attmap_passwd_gecos;
 extern const char *attmap_passwd_homeDirectory;
 extern const char *attmap_passwd_loginShell;
+extern const char *attmap_passwd_memberOf;
 extern const char *attmap_protocol_cn;
 extern const char *attmap_protocol_ipProtocolNumber;
 extern const char *attmap_rpc_cn;
@@ -86,6 +87,11 @@ const char **attmap_get_var(enum ldap_map_selector map, const char *name);
    Returns the new value on success. */
 MUST_USE const char *attmap_set_mapping(const char **var, const char *value);
 
+/* Compile the expressions that are used in attribute mappings so they
+   don't have to be parsed for every entry. This should be called after
+   the configuration is loaded. */
+void attmap_compile(void);
+
 /* Return a value for the attribute, handling the case where attr
    is an expression. On error (e.g. problem parsing expression, attribute
    value not found) it returns NULL and the buffer is made empty. */
@@ -830,6 +830,17 @@ static void handle_map(const char *filename, int lnr,
   free(newatt);
 }
 
+static const char *print_nested_groups(int nested_groups)
+{
+  switch (nested_groups)
+  {
+    case NESTED_GROUPS_OFF:          return "no";
+    case NESTED_GROUPS_ON:           return "yes";
+    case NESTED_GROUPS_SERVER_CHAIN: return "server-chain";
+    default:                         return "???";
+  }
+}
+
 #ifdef LDAP_OPT_X_TLS
 static const char *print_ssl(int ssl)
 {
@@ -896,20 +907,18 @@ static void handle_nss_initgroups_ignoreusers(
   char *username, *next;
   struct passwd *pwent;
   check_argumentcount(filename, lnr, keyword, (line != NULL) && (*line != '\0'));
-  if (cfg->nss_initgroups_ignoreusers == NULL)
-    cfg->nss_initgroups_ignoreusers = set_new();
   while (get_token(&line, token, sizeof(token)) != NULL)
   {
     if (strcasecmp(token, "alllocal") == 0)
     {
-      /* go over all users (this will work because nslcd is not yet running) */
-      setpwent();
-      while ((pwent = getpwent()) != NULL)
-        set_add(cfg->nss_initgroups_ignoreusers, pwent->pw_name);
-      endpwent();
+      /* the users are read from /etc/passwd when needed and re-read when
+         it changes (see localusers_contains()) */
+      cfg->nss_initgroups_ignorealllocal = 1;
     }
     else
     {
+      if (cfg->nss_initgroups_ignoreusers == NULL)
+        cfg->nss_initgroups_ignoreusers = set_new();
       next = token;
       while (*next != '\0')
       {
@@ -948,6 +957,8 @@ static void handle_validnames(const char *filename, int lnr,
     regfree(&cfg->validnames);
   }
   cfg->validnames_str = strdup(value);
+  /* the default expression is checked without regexec() */
+  cfg->validnames_default = (strcmp(value, DEFAULT_VALIDNAMES) == 0);
   /* check formatting and update flags */
   if (value[0] != '/')
   {
@@ -1129,6 +1140,46 @@ static void handle_cache(const char *filename, int lnr,
     cfg->cache_dn2uid_positive = value1;
     cfg->cache_dn2uid_negative = value2;
   }
+  else if (strcasecmp(cache, "uid2dn") == 0)
+  {
+    cfg->cache_uid2dn_positive = value1;
+    cfg->cache_uid2dn_negative = value2;
+  }
+  else if (strcasecmp(cache, "authz") == 0)
+  {
+    cfg->cache_authz_positive = value1;
+    cfg->cache_authz_negative = value2;
+  }
+  else if (strcasecmp(cache, "dn2gid") == 0)
+  {
+    cfg->cache_dn2gid_positive = value1;
+    cfg->cache_dn2gid_negative = value2;
+  }
+  else if (strcasecmp(cache, "notfound") == 0)
+  {
+    if (value2 != value1)
+      log_log(LOG_WARNING, "%s:%d: cache %s: second value ignored",
+              filename, lnr, cache);
+    cfg->cache_notfound = value1;
+  }
+  else if (strcasecmp(cache, "nested") == 0)
+  {
+    if (value2 != value1)
+      log_log(LOG_WARNING, "%s:%d: cache %s: second value ignored",
+              filename, lnr, cache);
+    cfg->cache_nested = value1;
+  }
+  else if (strcasecmp(cache, "authc") == 0)
+  {
+#if defined(HAVE_CRYPT) || defined(HAVE_CRYPT_R)
+    cfg->cache_authc_positive = value1;
+    cfg->cache_authc_negative = value2;
+#else /* not (HAVE_CRYPT || HAVE_CRYPT_R) */
+    log_log(LOG_ERR, "%s:%d: cache %s not supported on platform",
+            filename, lnr, cache);
+    exit(EXIT_FAILURE);
+#endif /* not (HAVE_CRYPT || HAVE_CRYPT_R) */
+  }
   else
   {
     log_log(LOG_ERR, "%s:%d: unknown cache: '%s'", filename, lnr, cache);
@@ -1228,6 +1279,9 @@ static void cfg_defaults(struct ldap_config *cfg)
 #if defined(HAVE_LDAP_SASL_BIND) && defined(LDAP_SASL_SIMPLE)
   cfg->pam_authc_ppolicy = 1;
 #endif
+  cfg->pam_authc_pool = 0;
+  cfg->pam_authc_fastbind = 0;
+  cfg->pam_authc_cache_maxfail = 3;
   cfg->bind_timelimit = 10;
   cfg->timelimit = LDAP_NO_LIMIT;
   cfg->idle_timelimit = 0;
@@ -1238,16 +1292,16 @@ static void cfg_defaults(struct ldap_config *cfg)
 #endif /* LDAP_OPT_X_TLS */
   cfg->pagesize = 0;
   cfg->nss_initgroups_ignoreusers = NULL;
+  cfg->nss_initgroups_ignorealllocal = 0;
+  cfg->nss_initgroups_memberof = NULL;
   cfg->nss_min_uid = 0;
   cfg->nss_uid_offset = 0;
   cfg->nss_gid_offset = 0;
-  cfg->nss_nested_groups = 0;
+  cfg->nss_nested_groups = NESTED_GROUPS_OFF;
   cfg->nss_getgrent_skipmembers = 0;
   cfg->nss_disable_enumeration = 0;
   cfg->validnames_str = NULL;
-  handle_validnames(__FILE__, __LINE__, "",
-                    "/^[a-z0-9._@$()]([a-z0-9._@$() \\~-]*[a-z0-9._@$()~-])?$/i",
-                    cfg);
+  handle_validnames(__FILE__, __LINE__, "", DEFAULT_VALIDNAMES, cfg);
   cfg->ignorecase = 0;
   cfg->pam_authc_search = "BASE";
   for (i = 0; i < NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES; i++)
@@ -1257,6 +1311,16 @@ static void cfg_defaults(struct ldap_config *cfg)
     cfg->reconnect_invalidate[i] = 0;
   cfg->cache_dn2uid_positive = 15 * TIME_MINUTES;
   cfg->cache_dn2uid_negative = 15 * TIME_MINUTES;
+  cfg->cache_uid2dn_positive = 15 * TIME_MINUTES;
+  cfg->cache_uid2dn_negative = 15 * TIME_MINUTES;
+  cfg->cache_dn2gid_positive = 15 * TIME_MINUTES;
+  cfg->cache_dn2gid_negative = 15 * TIME_MINUTES;
+  cfg->cache_authz_positive = 0;
+  cfg->cache_authz_negative = 0;
+  cfg->cache_authc_positive = 0;
+  cfg->cache_authc_negative = 0;
+  cfg->cache_notfound = 0;
+  cfg->cache_nested = 0;
 }
 
 static void cfg_read(const char *filename, struct ldap_config *cfg)
@@ -1457,6 +1521,27 @@ static void cfg_read(const char *filename, struct ldap_config *cfg)
               filename, lnr, value);
       exit(EXIT_FAILURE);
 #endif
+    }
+    else if (strcasecmp(keyword, "pam_authc_pool") == 0)
+    {
+      cfg->pam_authc_pool = get_int(filename, lnr, keyword, &line);
+      get_eol(filename, lnr, keyword, &line);
+    }
+    else if (strcasecmp(keyword, "pam_authc_cache_maxfail") == 0)
+    {
+      cfg->pam_authc_cache_maxfail = get_int(filename, lnr, keyword, &line);
+      get_eol(filename, lnr, keyword, &line);
+    }
+    else if (strcasecmp(keyword, "pam_authc_fastbind") == 0)
+    {
+#ifdef HAVE_LDAP_EXTENDED_OPERATION_S
+      cfg->pam_authc_fastbind = get_boolean(filename, lnr, keyword, &line);
+      get_eol(filename, lnr, keyword, &line);
+#else /* not HAVE_LDAP_EXTENDED_OPERATION_S */
+      log_log(LOG_ERR, "%s:%d: option %s not supported on platform",
+              filename, lnr, keyword);
+      exit(EXIT_FAILURE);
+#endif /* not HAVE_LDAP_EXTENDED_OPERATION_S */
     }
     /* timing/reconnect options */
     else if (strcasecmp(keyword, "bind_timelimit") == 0)
@@ -1572,6 +1657,11 @@ static void cfg_read(const char *filename, struct ldap_config *cfg)
       handle_nss_initgroups_ignoreusers(filename, lnr, keyword, line,
                                                  cfg);
     }
+    else if (strcasecmp(keyword, "nss_initgroups_memberof") == 0)
+    {
+      cfg->nss_initgroups_memberof = get_strdup(filename, lnr, keyword, &line);
+      get_eol(filename, lnr, keyword, &line);
+    }
     else if (strcasecmp(keyword, "nss_min_uid") == 0)
     {
       cfg->nss_min_uid = get_int(filename, lnr, keyword, &line);
@@ -1589,7 +1679,14 @@ static void cfg_read(const char *filename, struct ldap_config *cfg)
     }
     else if (strcasecmp(keyword, "nss_nested_groups") == 0)
     {
-      cfg->nss_nested_groups = get_boolean(filename, lnr, keyword, &line);
+      check_argumentcount(filename, lnr, keyword,
+                          (get_token(&line, token, sizeof(token)) != NULL));
+      if (strcasecmp(token, "server-chain") == 0)
+        cfg->nss_nested_groups = NESTED_GROUPS_SERVER_CHAIN;
+      else if (parse_boolean(filename, lnr, token))
+        cfg->nss_nested_groups = NESTED_GROUPS_ON;
+      else
+        cfg->nss_nested_groups = NESTED_GROUPS_OFF;
       get_eol(filename, lnr, keyword, &line);
     }
     else if (strcasecmp(keyword, "nss_getgrent_skipmembers") == 0)
@@ -1824,6 +1921,9 @@ static void cfg_dump(void)
 #if defined(HAVE_LDAP_SASL_BIND) && defined(LDAP_SASL_SIMPLE)
   log_log(LOG_DEBUG, "CFG: pam_authc_ppolicy %s", print_boolean(nslcd_cfg->pam_authc_ppolicy));
 #endif
+  log_log(LOG_DEBUG, "CFG: pam_authc_pool %d", nslcd_cfg->pam_authc_pool);
+  log_log(LOG_DEBUG, "CFG: pam_authc_fastbind %s", print_boolean(nslcd_cfg->pam_authc_fastbind));
+  log_log(LOG_DEBUG, "CFG: pam_authc_cache_maxfail %d", nslcd_cfg->pam_authc_cache_maxfail);
   log_log(LOG_DEBUG, "CFG: bind_timelimit %d", nslcd_cfg->bind_timelimit);
   log_log(LOG_DEBUG, "CFG: timelimit %d", nslcd_cfg->timelimit);
   log_log(LOG_DEBUG, "CFG: idle_timelimit %d", nslcd_cfg->idle_timelimit);
@@ -1853,6 +1953,8 @@ static void cfg_dump(void)
   LOG_LDAP_OPT_STRING("tls_key", LDAP_OPT_X_TLS_KEYFILE);
 #endif /* LDAP_OPT_X_TLS */
   log_log(LOG_DEBUG, "CFG: pagesize %d", nslcd_cfg->pagesize);
+  if (nslcd_cfg->nss_initgroups_ignorealllocal)
+    log_log(LOG_DEBUG, "CFG: nss_initgroups_ignoreusers ALLLOCAL");
   if (nslcd_cfg->nss_initgroups_ignoreusers != NULL)
   {
     /* allocate memory for a comma-separated list */
@@ -1875,10 +1977,12 @@ static void cfg_dump(void)
       strcpy(buffer + sizeof(buffer) - 4, "...");
     log_log(LOG_DEBUG, "CFG: nss_initgroups_ignoreusers %s", buffer);
   }
+  if (nslcd_cfg->nss_initgroups_memberof != NULL)
+    log_log(LOG_DEBUG, "CFG: nss_initgroups_memberof %s", nslcd_cfg->nss_initgroups_memberof);
   log_log(LOG_DEBUG, "CFG: nss_min_uid %lu", (unsigned long int)nslcd_cfg->nss_min_uid);
   log_log(LOG_DEBUG, "CFG: nss_uid_offset %lu", (unsigned long int)nslcd_cfg->nss_uid_offset);
   log_log(LOG_DEBUG, "CFG: nss_gid_offset %lu", (unsigned long int)nslcd_cfg->nss_gid_offset);
-  log_log(LOG_DEBUG, "CFG: nss_nested_groups %s", print_boolean(nslcd_cfg->nss_nested_groups));
+  log_log(LOG_DEBUG, "CFG: nss_nested_groups %s", print_nested_groups(nslcd_cfg->nss_nested_groups));
   log_log(LOG_DEBUG, "CFG: nss_getgrent_skipmembers %s", print_boolean(nslcd_cfg->nss_getgrent_skipmembers));
   log_log(LOG_DEBUG, "CFG: nss_disable_enumeration %s", print_boolean(nslcd_cfg->nss_disable_enumeration));
   log_log(LOG_DEBUG, "CFG: validnames %s", nslcd_cfg->validnames_str);
@@ -1903,6 +2007,22 @@ static void cfg_dump(void)
   print_time(nslcd_cfg->cache_dn2uid_positive, buffer, sizeof(buffer) / 2);
   print_time(nslcd_cfg->cache_dn2uid_positive, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
   log_log(LOG_DEBUG, "CFG: cache dn2uid %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_uid2dn_positive, buffer, sizeof(buffer) / 2);
+  print_time(nslcd_cfg->cache_uid2dn_negative, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
+  log_log(LOG_DEBUG, "CFG: cache uid2dn %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_dn2gid_positive, buffer, sizeof(buffer) / 2);
+  print_time(nslcd_cfg->cache_dn2gid_negative, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
+  log_log(LOG_DEBUG, "CFG: cache dn2gid %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_authz_positive, buffer, sizeof(buffer) / 2);
+  print_time(nslcd_cfg->cache_authz_negative, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
+  log_log(LOG_DEBUG, "CFG: cache authz %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_authc_positive, buffer, sizeof(buffer) / 2);
+  print_time(nslcd_cfg->cache_authc_negative, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
+  log_log(LOG_DEBUG, "CFG: cache authc %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_notfound, buffer, sizeof(buffer));
+  log_log(LOG_DEBUG, "CFG: cache notfound %s", buffer);
+  print_time(nslcd_cfg->cache_nested, buffer, sizeof(buffer));
+  log_log(LOG_DEBUG, "CFG: cache nested %s", buffer);
 }
 
 void cfg_init(const char *fname)
@@ -1949,6 +2069,17 @@ void cfg_init(const char *fname)
   }
   /* TODO: check that if some tls options are set the ssl option should be set to on (just warn) */
 #endif /* LDAP_OPT_X_TLS */
+  /* fast bind does not support bind controls or searches as the user */
+  if ((nslcd_cfg->pam_authc_fastbind) &&
+      (
+#if defined(HAVE_LDAP_SASL_BIND) && defined(LDAP_SASL_SIMPLE)
+       (nslcd_cfg->pam_authc_ppolicy) ||
+#endif /* HAVE_LDAP_SASL_BIND && LDAP_SASL_SIMPLE */
+       (strcasecmp(nslcd_cfg->pam_authc_search, "NONE") != 0)))
+  {
+    log_log(LOG_WARNING, "pam_authc_fastbind disabled because pam_authc_ppolicy or pam_authc_search is used");
+    nslcd_cfg->pam_authc_fastbind = 0;
+  }
   /* if basedn is not yet set,  get if from the rootDSE */
   if (nslcd_cfg->bases[0] == NULL)
     nslcd_cfg->bases[0] = get_base_from_rootdse();
@@ -1973,4 +2104,6 @@ void cfg_init(const char *fname)
   rpc_init();
   service_init();
   shadow_init();
+  /* compile the attribute mapping expressions */
+  attmap_compile();
 }
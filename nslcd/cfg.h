@@ -49,12 +49,23 @@
 /* maximum number of pam_authz_search options */
 #define NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES 8
 
+/* the default validnames expression (isvalidname() has a table of the
+   characters that are allowed by this expression) */
+#define DEFAULT_VALIDNAMES \
+  "/^[a-z0-9._@$()]([a-z0-9._@$() \\~-]*[a-z0-9._@$()~-])?$/i"
+
 enum ldap_ssl_options {
   SSL_OFF,
   SSL_LDAPS,
   SSL_START_TLS
 };
 
+enum nss_nested_groups_options {
+  NESTED_GROUPS_OFF,
+  NESTED_GROUPS_ON,          /* expand nested groups with extra searches */
+  NESTED_GROUPS_SERVER_CHAIN /* use LDAP_MATCHING_RULE_IN_CHAIN searches */
+};
+
 /* selectors for different maps */
 enum ldap_map_selector {
   LM_ALIASES,
@@ -110,6 +121,9 @@ struct ldap_config {
 #if defined(HAVE_LDAP_SASL_BIND) && defined(LDAP_SASL_SIMPLE)
   int pam_authc_ppolicy;    /* whether to send password policy controls on bind */
 #endif
+  int pam_authc_pool;       /* the number of authentication connections to keep open */
+  int pam_authc_fastbind;   /* whether to use Active Directory fast bind for authentication */
+  int pam_authc_cache_maxfail; /* failed offline authentications before lockout */
   int bind_timelimit;       /* bind timelimit */
   int timelimit;            /* search timelimit */
   int idle_timelimit;       /* idle timeout */
@@ -123,14 +137,17 @@ struct ldap_config {
 
   int pagesize; /* set to a greater than 0 to enable handling of paged results with the specified size */
   SET *nss_initgroups_ignoreusers;  /* the users for which no initgroups() searches should be done */
+  int nss_initgroups_ignorealllocal; /* whether to also ignore users in /etc/passwd */
+  char *nss_initgroups_memberof; /* user attribute that lists the groups of the user */
   uid_t nss_min_uid;  /* minimum uid for users retrieved from LDAP */
   uid_t nss_uid_offset; /* offset for uids retrieved from LDAP to avoid local uid clashes */
   gid_t nss_gid_offset; /* offset for gids retrieved from LDAP to avoid local gid clashes */
-  int nss_nested_groups; /* whether to expand nested groups */
+  enum nss_nested_groups_options nss_nested_groups; /* whether and how to expand nested groups */
   int nss_getgrent_skipmembers;  /* whether to skip member lookups */
   int nss_disable_enumeration;  /* enumeration turned on or off */
   regex_t validnames; /* the regular expression to determine valid names */
   char *validnames_str; /* string version of validnames regexp */
+  int validnames_default; /* whether validnames is the default expression */
   int ignorecase; /* whether or not case should be ignored in lookups */
   char *pam_authc_search; /* the search that should be performed post-authentication */
   char *pam_authz_searches[NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES]; /* the searches that should be performed to do autorisation checks */
@@ -139,6 +156,16 @@ struct ldap_config {
 
   time_t cache_dn2uid_positive;
   time_t cache_dn2uid_negative;
+  time_t cache_uid2dn_positive;
+  time_t cache_uid2dn_negative;
+  time_t cache_dn2gid_positive;
+  time_t cache_dn2gid_negative;
+  time_t cache_authz_positive;
+  time_t cache_authz_negative;
+  time_t cache_authc_positive;
+  time_t cache_authc_negative;
+  time_t cache_notfound;
+  time_t cache_nested;
 };
 
 /* this is a pointer to the global configuration, it should be available
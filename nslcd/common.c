@@ -59,6 +59,108 @@ int mysnprintf(char *buffer, size_t buflen, const char *format, ...)
   return ((res < 0) || (((size_t)res) >= buflen));
 }
 
+void filter_template_init(FILTER_TEMPLATE *tmpl, const char *filter,
+                          const char *attr)
+{
+  char buffer[BUFLEN_FILTER];
+  if (mysnprintf(buffer, sizeof(buffer), "(&%s(%s=", filter, attr))
+  {
+    log_log(LOG_ERR, "search filter too long: %s", filter);
+    exit(EXIT_FAILURE);
+  }
+  tmpl->prefix = strdup(buffer);
+  if (tmpl->prefix == NULL)
+  {
+    log_log(LOG_CRIT, "filter_template_init(): strdup() failed to allocate memory");
+    exit(EXIT_FAILURE);
+  }
+  tmpl->prefixlen = strlen(buffer);
+}
+
+/* copy the prefix and add the value followed by the closing parentheses,
+   the value is escaped if escape is set */
+static int filter_template_fill(const FILTER_TEMPLATE *tmpl,
+                                const char *value, int escape,
+                                char *buffer, size_t buflen)
+{
+  size_t pos, len;
+  int rc;
+  /* the prefix, the closing parentheses and the terminating nul */
+  if ((tmpl->prefixlen + 3) > buflen)
+    return -1;
+  memcpy(buffer, tmpl->prefix, tmpl->prefixlen);
+  pos = tmpl->prefixlen;
+  if (escape)
+  {
+    rc = myldap_escape_len(value, buffer + pos, buflen - pos - 2);
+    if (rc < 0)
+    {
+      buffer[0] = '\0';
+      return -1;
+    }
+    pos += (size_t)rc;
+  }
+  else
+  {
+    len = strlen(value);
+    if ((pos + len + 3) > buflen)
+    {
+      buffer[0] = '\0';
+      return -1;
+    }
+    memcpy(buffer + pos, value, len);
+    pos += len;
+  }
+  buffer[pos++] = ')';
+  buffer[pos++] = ')';
+  buffer[pos] = '\0';
+  return 0;
+}
+
+int filter_template_build(const FILTER_TEMPLATE *tmpl, const char *value,
+                          char *buffer, size_t buflen)
+{
+  return filter_template_fill(tmpl, value, 1, buffer, buflen);
+}
+
+/* fill in the template with the decimal representation of the number,
+   numbers do not need escaping */
+static int filter_template_fill_number(const FILTER_TEMPLATE *tmpl,
+                                       unsigned long int num, int negative,
+                                       char *buffer, size_t buflen)
+{
+  char digits[32];
+  char *ptr = digits + sizeof(digits) - 1;
+  /* write the digits from the back */
+  *ptr = '\0';
+  do
+  {
+    *--ptr = '0' + (char)(num % 10);
+    num /= 10;
+  }
+  while (num > 0);
+  if (negative)
+    *--ptr = '-';
+  return filter_template_fill(tmpl, ptr, 0, buffer, buflen);
+}
+
+int filter_template_build_int(const FILTER_TEMPLATE *tmpl, long int value,
+                              char *buffer, size_t buflen)
+{
+  if (value < 0)
+    return filter_template_fill_number(tmpl, -(unsigned long int)value, 1,
+                                       buffer, buflen);
+  return filter_template_fill_number(tmpl, (unsigned long int)value, 0,
+                                     buffer, buflen);
+}
+
+int filter_template_build_uint(const FILTER_TEMPLATE *tmpl,
+                               unsigned long int value,
+                               char *buffer, size_t buflen)
+{
+  return filter_template_fill_number(tmpl, value, 0, buffer, buflen);
+}
+
 /* get a name of a signal with a given signal number */
 const char *signame(int signum)
 {
@@ -201,10 +303,38 @@ const char *get_userpassword(MYLDAP_ENTRY *entry, const char *attr,
      (any code for this is more than welcome) */
 }
 
+/* the characters that are allowed by DEFAULT_VALIDNAMES at the start, in
+   the middle and at the end of a name */
+#define VALIDNAME_FIRST  1
+#define VALIDNAME_MIDDLE 2
+#define VALIDNAME_LAST   4
+static const uint8_t validname_chars[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  2, 0, 0, 0, 7, 0, 0, 0, 7, 7, 0, 0, 0, 6, 7, 0,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 0, 0, 0, 0, 0,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 2, 0, 0, 7,
+  0, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 0, 0, 6, 0,
+  /* no characters above 0x7f are allowed */
+};
+
 /* Checks if the specified name seems to be a valid user or group name. */
 int isvalidname(const char *name)
 {
-  return regexec(&nslcd_cfg->validnames, name, 0, NULL, 0) == 0;
+  const uint8_t *ptr = (const uint8_t *)name;
+  if (!nslcd_cfg->validnames_default)
+    return regexec(&nslcd_cfg->validnames, name, 0, NULL, 0) == 0;
+  /* the table lookup is equivalent to the default expression */
+  if (!(validname_chars[ptr[0]] & VALIDNAME_FIRST))
+    return 0;
+  if (ptr[1] == '\0')
+    return 1;
+  for (ptr++; ptr[1] != '\0'; ptr++)
+    if (!(validname_chars[ptr[0]] & VALIDNAME_MIDDLE))
+      return 0;
+  return (validname_chars[ptr[0]] & VALIDNAME_LAST) != 0;
 }
 
 /* this writes a single address to the stream */
@@ -34,6 +34,7 @@
 #include "nslcd.h"
 #include "common/nslcd-prot.h"
 #include "common/tio.h"
+#include "common/set.h"
 #include "compat/attrs.h"
 #include "myldap.h"
 #include "cfg.h"
@@ -64,6 +65,34 @@
 int mysnprintf(char *buffer, size_t buflen, const char *format, ...)
   LIKE_PRINTF(3, 4);
 
+/* A search filter of the form (&FILTER(ATTRIBUTE=value)) where the part
+   before the value is built once when the map is set up so that for each
+   request only the value has to be added. */
+typedef struct filter_template {
+  char *prefix;
+  size_t prefixlen;
+} FILTER_TEMPLATE;
+
+/* set up the template from the map filter and the attribute name,
+   this exits on errors because it is only used at startup */
+void filter_template_init(FILTER_TEMPLATE *tmpl, const char *filter,
+                          const char *attr);
+
+/* build the search filter with the value escaped directly into the
+   buffer, returns 0 if ok, -1 if the buffer is too small */
+MUST_USE int filter_template_build(const FILTER_TEMPLATE *tmpl,
+                                   const char *value,
+                                   char *buffer, size_t buflen);
+
+/* build the search filter with the number as value,
+   returns 0 if ok, -1 if the buffer is too small */
+MUST_USE int filter_template_build_int(const FILTER_TEMPLATE *tmpl,
+                                       long int value,
+                                       char *buffer, size_t buflen);
+MUST_USE int filter_template_build_uint(const FILTER_TEMPLATE *tmpl,
+                                        unsigned long int value,
+                                        char *buffer, size_t buflen);
+
 /* get a name of a signal with a given signal number */
 const char *signame(int signum);
 
@@ -118,12 +147,43 @@ MUST_USE char *lookup_dn2uid(MYLDAP_SESSION *session, const char *dn,
 MUST_USE char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf,
                       size_t buflen);
 
+/* a compact list of unique member names that is kept in the encoding
+   that is used to write it to the client */
+typedef struct memberlist MEMBERLIST;
+
+/* create a new empty member list (returns NULL on allocation errors) */
+MUST_USE MEMBERLIST *memberlist_new(void);
+
+/* free all memory used by the member list */
+void memberlist_free(MEMBERLIST *list);
+
+/* add the name to the member list if it is not already present,
+   returns -1 on allocation errors */
+int memberlist_add(MEMBERLIST *list, const char *name);
+
+/* add all names from the other member list */
+int memberlist_addall(MEMBERLIST *list, MEMBERLIST *other);
+
+/* return the number of names in the member list */
+MUST_USE int memberlist_size(MEMBERLIST *list);
+
+/* write the member list to the stream in the same format as
+   WRITE_STRINGLIST() (NULL is written as an empty list) */
+int memberlist_write(TFILE *fp, MEMBERLIST *list);
+
+/* add the names of all users that are (possibly nested) members of the
+   group with the specified DN to the list, letting the server resolve the
+   chain of group memberships, returns -1 on errors */
+int groupdn2uids(MYLDAP_SESSION *session, const char *groupdn,
+                 MEMBERLIST *members);
+
 /* use the user id to lookup an LDAP entry */
 MYLDAP_ENTRY *uid2entry(MYLDAP_SESSION *session, const char *uid, int *rcp);
 
-/* transforms the uid into a DN by doing an LDAP lookup */
+/* transforms the uid into a DN by doing an LDAP lookup (or by using
+   the cache), rcp is set to LDAP_NO_SUCH_OBJECT for unknown users */
 MUST_USE char *uid2dn(MYLDAP_SESSION *session, const char *uid, char *buf,
-                      size_t buflen);
+                      size_t buflen, int *rcp);
 
 /* use the user id to lookup an LDAP entry with the shadow attributes
    requested */
@@ -140,6 +200,21 @@ void get_shadow_properties(MYLDAP_ENTRY *entry, long *lastchangedate,
 /* check whether the nsswitch file should be reloaded */
 void nsswitch_check_reload(void);
 
+/* check whether the lookup is known to not return any results */
+int negcache_get(int32_t action, const char *filter);
+
+/* remember that the lookup did not return any results */
+void negcache_put(int32_t action, const char *filter);
+
+/* remove all entries from the cache of lookups without results */
+void negcache_clear(void);
+
+/* check whether /etc/passwd changed and reload the local users */
+void localusers_check_reload(void);
+
+/* check whether the user is listed in /etc/passwd */
+int localusers_contains(const char *name);
+
 /* check whether the nsswitch.conf file has LDAP as a naming source for db */
 int nsswitch_shadow_uses_ldap(void);
 
@@ -150,6 +225,9 @@ int invalidator_start(void);
 /* signal invalidator to invalidate the selected external cache */
 void invalidator_do(enum ldap_map_selector map);
 
+/* clear the cache of pam_authz_search decisions */
+void pam_authz_cache_clear(void);
+
 /* common buffer lengths */
 #define BUFLEN_NAME         256  /* user, group names and such */
 #define BUFLEN_SAFENAME     300  /* escaped name */
@@ -217,6 +295,7 @@ int nslcd_ether_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_bygid(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session);
+int nslcd_group_gids_bymember(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_host_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_host_byaddr(TFILE *fp, MYLDAP_SESSION *session);
@@ -245,23 +324,45 @@ int nslcd_pam_authz(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_pam_sess_o(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_pam_sess_c(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_pam_pwmod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
+int nslcd_pam_login(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_usermod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
 
-/* macros for generating service handling code */
+/* macros for generating service handling code, the writefn should return
+   a negative value on errors and the number of written results otherwise */
 #define NSLCD_HANDLE(db, fn, action, readfn, mkfilter, writefn)             \
   int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session)                 \
-  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn)
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn, 0, 1)
 #define NSLCD_HANDLE_UID(db, fn, action, readfn, mkfilter, writefn)         \
   int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid) \
-  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn)
-#define NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn)        \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn, 0, 1)
+/* variants of the above for enumerations, which are never stored in the
+   cache of lookups without results */
+#define NSLCD_HANDLE_ALL(db, fn, action, readfn, mkfilter, writefn)         \
+  int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session)                 \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn, 0, 0)
+#define NSLCD_HANDLE_UID_ALL(db, fn, action, readfn, mkfilter, writefn)     \
+  int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid) \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn, 0, 0)
+/* variants of the above for single-result lookups (e.g. by name or by id)
+   where the clients only use the first returned result: the search is
+   abandoned after the first entry that produced a result and any remaining
+   search bases are skipped */
+#define NSLCD_HANDLE_FIRST(db, fn, action, readfn, mkfilter, writefn)       \
+  int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session)                 \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn, 1, 1)
+#define NSLCD_HANDLE_UID_FIRST(db, fn, action, readfn, mkfilter, writefn)   \
+  int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid) \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn, 1, 1)
+#define NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn,        \
+                          firstonly, cacheable)                             \
   {                                                                         \
     /* define common variables */                                           \
     int32_t tmpint32;                                                       \
     MYLDAP_SEARCH *search;                                                  \
     MYLDAP_ENTRY *entry;                                                    \
     const char *base;                                                       \
-    int rc, i;                                                              \
+    int rc = LDAP_SUCCESS, i, num;                                          \
+    int found = 0, results = 0, failed = 0;                                 \
     /* read request parameters */                                           \
     readfn;                                                                 \
     /* write the response header */                                         \
@@ -274,8 +375,16 @@ int nslcd_usermod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
               "(): filter buffer too small");                               \
       return -1;                                                            \
     }                                                                       \
+    /* check whether the lookup is known to not return anything */          \
+    if ((cacheable) && (negcache_get(action, filter)))                      \
+    {                                                                       \
+      log_log(LOG_DEBUG, "nslcd_" __STRING(db) "_" __STRING(fn)             \
+              "(): not found (cached)");                                    \
+      WRITE_INT32(fp, NSLCD_RESULT_END);                                    \
+      return 0;                                                             \
+    }                                                                       \
     /* perform a search for each search base */                             \
-    for (i = 0; (base = db##_bases[i]) != NULL; i++)                        \
+    for (i = 0; (!found) && ((base = db##_bases[i]) != NULL); i++)          \
     {                                                                       \
       /* do the LDAP search */                                              \
       search = myldap_search(session, base, db##_scope, filter,             \
@@ -285,10 +394,23 @@ int nslcd_usermod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
       /* go over results */                                                 \
       while ((entry = myldap_get_entry(search, &rc)) != NULL)               \
       {                                                                     \
-        if (writefn)                                                        \
+        if ((num = (writefn)) < 0)                                          \
           return -1;                                                        \
+        results += num;                                                     \
+        if ((firstonly) && (num > 0))                                       \
+        {                                                                   \
+          /* we have our result, abandon the rest of the search */          \
+          myldap_search_close(search);                                      \
+          found = 1;                                                        \
+          break;                                                            \
+        }                                                                   \
       }                                                                     \
+      if (rc != LDAP_SUCCESS)                                               \
+        failed = 1;                                                         \
     }                                                                       \
+    /* remember lookups that completed without results */                   \
+    if ((cacheable) && (results == 0) && (!failed))                         \
+      negcache_put(action, filter);                                         \
     /* write the final result code */                                       \
     if (rc == LDAP_SUCCESS)                                                 \
     {                                                                       \
@@ -61,21 +61,15 @@ const char *attmap_ether_macAddress = "macAddress";
 /* the attribute list to request with searches */
 static const char *ether_attrs[3];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE ether_byname_template;
+
 /* create a search filter for searching an ethernet address
    by name, return -1 on errors */
 static int mkfilter_ether_byname(const char *name,
                                  char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_HOSTNAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_ether_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    ether_filter, attmap_ether_cn, safename);
+  return filter_template_build(&ether_byname_template, name, buffer, buflen);
 }
 
 static void my_ether_ntoa(const uint8_t *addr, char *buffer, int compact)
@@ -116,6 +110,8 @@ void ether_init(void)
   ether_attrs[0] = attmap_ether_cn;
   ether_attrs[1] = attmap_ether_macAddress;
   ether_attrs[2] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&ether_byname_template, ether_filter, attmap_ether_cn);
 }
 
 /* TODO: check for errors in aton() */
@@ -131,6 +127,7 @@ static int write_ether(TFILE *fp, MYLDAP_ENTRY *entry,
   const char *tmparr[2];
   const char **names, **ethers;
   int i, j;
+  int num = 0;
   /* get the name of the ether entry */
   names = myldap_get_values(entry, attmap_ether_cn);
   if ((names == NULL) || (names[0] == NULL))
@@ -165,8 +162,9 @@ static int write_ether(TFILE *fp, MYLDAP_ENTRY *entry,
         WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
         WRITE_STRING(fp, names[i]);
         WRITE_ETHER(fp, ethers[j]);
+        num++;
       }
-  return 0;
+  return num;
 }
 
 NSLCD_HANDLE(
@@ -191,7 +189,7 @@ NSLCD_HANDLE(
   write_ether(fp, entry, NULL, addrstr)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   ether, all, NSLCD_ACTION_ETHER_ALL,
   const char *filter;
   log_setrequest("ether(all)");,
@@ -29,10 +29,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
 /* for gid_t */
 #include <grp.h>
 
 #include "common/set.h"
+#include "common/dict.h"
 #include "common.h"
 #include "log.h"
 #include "myldap.h"
@@ -48,8 +52,10 @@
  * apart from the above a member attribute is also supported that
  * may contains a DN of a user
  *
- * nested groups (groups that are member of a group) are currently
- * not supported
+ * nested groups (groups that are member of a group) are expanded
+ * depending on the nss_nested_groups option, either by doing extra
+ * searches for every subgroup or by having the server resolve the
+ * membership chain using LDAP_MATCHING_RULE_IN_CHAIN
  */
 
 /* the search base for searches */
@@ -86,21 +92,21 @@ static const char **group_attrs = NULL;
 /* the attribute list for bymember searches (without member attributes) */
 static const char **group_bymember_attrs = NULL;
 
+/* the attribute list for gid-only bymember searches */
+static const char **group_gids_attrs = NULL;
+
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE group_byname_template;
+static FILTER_TEMPLATE group_bygid_template;
+static FILTER_TEMPLATE group_bymemberuid_template;
+static FILTER_TEMPLATE group_bymemberdn_template;
+
 /* create a search filter for searching a group entry
    by name, return -1 on errors */
 static int mkfilter_group_byname(const char *name,
                                  char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_group_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    group_filter, attmap_group_cn, safename);
+  return filter_template_build(&group_byname_template, name, buffer, buflen);
 }
 
 /* create a search filter for searching a group entry
@@ -124,8 +130,8 @@ static int mkfilter_group_bygid(gid_t gid, char *buffer, size_t buflen)
   }
   else
   {
-    return mysnprintf(buffer, buflen, "(&%s(%s=%lu))",
-                      group_filter, attmap_group_gidNumber, (unsigned long int)gid);
+    return filter_template_build_uint(&group_bygid_template,
+                                      (unsigned long int)gid, buffer, buflen);
   }
 }
 
@@ -138,23 +144,30 @@ static int mkfilter_group_bymember(MYLDAP_SESSION *session,
   char dn[BUFLEN_DN];
   char safeuid[BUFLEN_SAFENAME];
   char safedn[BUFLEN_SAFEDN];
+  /* try to translate uid to DN */
+  if ((strcasecmp(attmap_group_member, "\"\"") == 0) ||
+      (uid2dn(session, uid, dn, sizeof(dn), NULL) == NULL))
+    return filter_template_build(&group_bymemberuid_template, uid,
+                                 buffer, buflen);
   /* escape attribute */
   if (myldap_escape(uid, safeuid, sizeof(safeuid)))
   {
     log_log(LOG_ERR, "mkfilter_group_bymember(): safeuid buffer too small");
     return -1;
   }
-  /* try to translate uid to DN */
-  if ((strcasecmp(attmap_group_member, "\"\"") == 0) ||
-      (uid2dn(session, uid, dn, sizeof(dn)) == NULL))
-    return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                      group_filter, attmap_group_memberUid, safeuid);
   /* escape DN */
   if (myldap_escape(dn, safedn, sizeof(safedn)))
   {
     log_log(LOG_ERR, "mkfilter_group_bymember(): safedn buffer too small");
     return -1;
   }
+  /* have the server find all groups the user is (indirectly) member of */
+  if (nslcd_cfg->nss_nested_groups == NESTED_GROUPS_SERVER_CHAIN)
+    return mysnprintf(buffer, buflen, "(&%s(|(%s=%s)(%s:%s:=%s)))",
+                      group_filter,
+                      attmap_group_memberUid, safeuid,
+                      attmap_group_member, LDAP_MATCHING_RULE_IN_CHAIN,
+                      safedn);
   /* also lookup using user DN */
   return mysnprintf(buffer, buflen, "(&%s(|(%s=%s)(%s=%s)))",
                     group_filter,
@@ -165,17 +178,7 @@ static int mkfilter_group_bymember(MYLDAP_SESSION *session,
 static int mkfilter_group_bymemberdn(const char *dn,
                                      char *buffer, size_t buflen)
 {
-  char safedn[BUFLEN_SAFEDN];
-  /* escape DN */
-  if (myldap_escape(dn, safedn, sizeof(safedn)))
-  {
-    log_log(LOG_ERR, "mkfilter_group_bymemberdn(): safedn buffer too small");
-    return -1;
-  }
-  return mysnprintf(buffer, buflen,
-                    "(&%s(%s=%s))",
-                    group_filter,
-                    attmap_group_member, safedn);
+  return filter_template_build(&group_bymemberdn_template, dn, buffer, buflen);
 }
 
 void group_init(void)
@@ -205,6 +208,10 @@ void group_init(void)
   {
     attmap_add_attributes(set, attmap_group_memberUid);
     attmap_add_attributes(set, attmap_group_member);
+    /* used to check whether cached nested group expansions are current */
+    if ((nslcd_cfg->cache_nested > 0) &&
+        (nslcd_cfg->nss_nested_groups == NESTED_GROUPS_ON))
+      set_add(set, "modifyTimestamp");
   }
   group_attrs = set_tolist(set);
   if (group_attrs == NULL)
@@ -225,15 +232,78 @@ void group_init(void)
     exit(EXIT_FAILURE);
   }
   set_free(set);
+  /* set up gid-only bymember attribute list */
+  set = set_new();
+  attmap_add_attributes(set, attmap_group_gidNumber);
+  group_gids_attrs = set_tolist(set);
+  if (group_gids_attrs == NULL)
+  {
+    log_log(LOG_CRIT, "malloc() failed to allocate memory");
+    exit(EXIT_FAILURE);
+  }
+  set_free(set);
+  /* set up the search filter templates */
+  filter_template_init(&group_byname_template, group_filter, attmap_group_cn);
+  filter_template_init(&group_bygid_template,
+                       group_filter, attmap_group_gidNumber);
+  filter_template_init(&group_bymemberuid_template,
+                       group_filter, attmap_group_memberUid);
+  filter_template_init(&group_bymemberdn_template,
+                       group_filter, attmap_group_member);
+}
+
+/* the maximum number of gidNumber attributes per entry */
+#define MAXGIDS_PER_ENTRY 5
+
+/* get the group ids of the entry (up to MAXGIDS_PER_ENTRY) and return
+   the number of found ids, returns 0 if the attribute is missing or
+   contains invalid values */
+static int get_gids(MYLDAP_ENTRY *entry, gid_t gids[])
+{
+  const char **gidvalues;
+  char *tmp;
+  int numgids;
+  gidvalues = myldap_get_values_len(entry, attmap_group_gidNumber);
+  if ((gidvalues == NULL) || (gidvalues[0] == NULL))
+  {
+    log_log(LOG_WARNING, "%s: %s: missing",
+            myldap_get_dn(entry), attmap_group_gidNumber);
+    return 0;
+  }
+  for (numgids = 0; (numgids < MAXGIDS_PER_ENTRY) && (gidvalues[numgids] != NULL); numgids++)
+  {
+    if (gidSid != NULL)
+      gids[numgids] = (gid_t)binsid2id(gidvalues[numgids]);
+    else
+    {
+      errno = 0;
+      gids[numgids] = strtogid(gidvalues[numgids], &tmp, 10);
+      if ((*(gidvalues[numgids]) == '\0') || (*tmp != '\0'))
+      {
+        log_log(LOG_WARNING, "%s: %s: non-numeric",
+                myldap_get_dn(entry), attmap_group_gidNumber);
+        return 0;
+      }
+      else if ((errno != 0) || (strchr(gidvalues[numgids], '-') != NULL))
+      {
+        log_log(LOG_WARNING, "%s: %s: out of range",
+                myldap_get_dn(entry), attmap_group_gidNumber);
+        return 0;
+      }
+    }
+    gids[numgids] += nslcd_cfg->nss_gid_offset;
+  }
+  return numgids;
 }
 
 static int do_write_group(TFILE *fp, MYLDAP_ENTRY *entry,
                           const char **names, gid_t gids[], int numgids,
-                          const char *passwd, const char **members,
+                          const char *passwd, MEMBERLIST *members,
                           const char *reqname)
 {
-  int32_t tmpint32, tmp2int32, tmp3int32;
+  int32_t tmpint32;
   int i, j;
+  int num = 0;
   /* write entries for all names and gids */
   for (i = 0; names[i] != NULL; i++)
   {
@@ -250,20 +320,19 @@ static int do_write_group(TFILE *fp, MYLDAP_ENTRY *entry,
         WRITE_STRING(fp, names[i]);
         WRITE_STRING(fp, passwd);
         WRITE_INT32(fp, gids[j]);
-        WRITE_STRINGLIST(fp, members);
+        if (memberlist_write(fp, members))
+          return -1;
+        num++;
       }
     }
   }
-  return 0;
+  return num;
 }
 
-static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
-                       SET *members, SET *seen, SET *subgroups)
+static void getmemberuids(MYLDAP_ENTRY *entry, MEMBERLIST *members)
 {
-  char buf[BUFLEN_NAME];
   int i;
   const char **values;
-  const char ***derefs;
   /* add the memberUid values */
   values = myldap_get_values(entry, attmap_group_memberUid);
   if (values != NULL)
@@ -271,8 +340,19 @@ static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
     {
       /* only add valid usernames */
       if (isvalidname(values[i]))
-        set_add(members, values[i]);
+        memberlist_add(members, values[i]);
     }
+}
+
+static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
+                       MEMBERLIST *members, SET *seen, SET *subgroups)
+{
+  char buf[BUFLEN_NAME];
+  int i;
+  const char **values;
+  const char ***derefs;
+  /* add the memberUid values */
+  getmemberuids(entry, members);
   /* skip rest if attmap_group_member is blank */
   if (strcasecmp(attmap_group_member, "\"\"") == 0)
     return;
@@ -282,7 +362,7 @@ static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
   {
     /* add deref'd uid attributes */
     for (i = 0; derefs[0][i] != NULL; i++)
-      set_add(members, derefs[0][i]);
+      memberlist_add(members, derefs[0][i]);
     /* add non-deref'd attribute values as subgroups */
     for (i = 0; derefs[1][i] != NULL; i++)
     {
@@ -307,7 +387,7 @@ static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
           set_add(seen, values[i]);
         /* transform the DN into a uid (dn2uid() already checks validity) */
         if (dn2uid(session, values[i], buf, sizeof(buf)) != NULL)
-          set_add(members, buf);
+          memberlist_add(members, buf);
         /* wasn't a UID - try handling it as a nested group */
         else if (subgroups != NULL)
           set_add(subgroups, values[i]);
@@ -315,23 +395,282 @@ static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
     }
 }
 
-/* the maximum number of gidNumber attributes per entry */
-#define MAXGIDS_PER_ENTRY 5
+/* the cache of flattened nested group memberships, keyed on group DN */
+static pthread_mutex_t nested_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *nested_cache = NULL;
+static int nested_cache_num = 0;
+struct nested_cache_entry {
+  time_t timestamp;       /* when the expansion was built */
+  char *modifytimestamp;  /* modifyTimestamp of the group entry */
+  MEMBERLIST *members;    /* all members of the group and nested groups */
+  const char **children;  /* DNs of the nested groups that were used */
+};
+
+/* the maximum number of groups to keep in the cache */
+#define NESTED_CACHE_MAX_ENTRIES 1024
+
+/* the maximum depth of nested groups that is expanded */
+#define NESTED_MAX_DEPTH 64
+
+static void nested_cache_entry_free(struct nested_cache_entry *cacheentry)
+{
+  if (cacheentry->modifytimestamp != NULL)
+    free(cacheentry->modifytimestamp);
+  if (cacheentry->members != NULL)
+    memberlist_free(cacheentry->members);
+  if (cacheentry->children != NULL)
+    free(cacheentry->children);
+  free(cacheentry);
+}
+
+/* check that the cache entry has not expired and that none of the nested
+   groups it was built from expired or were rebuilt since,
+   nested_cache_mutex should be held */
+static int do_nested_cache_valid(struct nested_cache_entry *cacheentry,
+                                 time_t now, int depth)
+{
+  struct nested_cache_entry *child;
+  int i;
+  if ((depth >= NESTED_MAX_DEPTH) ||
+      (now >= (cacheentry->timestamp + nslcd_cfg->cache_nested)))
+    return 0;
+  for (i = 0; cacheentry->children[i] != NULL; i++)
+  {
+    child = dict_get(nested_cache, cacheentry->children[i]);
+    if ((child == NULL) || (child->timestamp > cacheentry->timestamp) ||
+        (!do_nested_cache_valid(child, now, depth + 1)))
+      return 0;
+  }
+  return 1;
+}
+
+/* remove all entries from the cache, nested_cache_mutex should be held */
+static void do_nested_cache_clear(void)
+{
+  const char **keys;
+  int i;
+  if (nested_cache == NULL)
+    return;
+  keys = dict_keys(nested_cache);
+  if (keys != NULL)
+  {
+    for (i = 0; keys[i] != NULL; i++)
+      nested_cache_entry_free(dict_get(nested_cache, keys[i]));
+    free(keys);
+  }
+  dict_free(nested_cache);
+  nested_cache = NULL;
+  nested_cache_num = 0;
+}
+
+/* add the members of the group from the cache to the set, modifytimestamp
+   is compared with the cached value if it is set, returns non-zero if the
+   cache was used */
+static int nested_cache_get(const char *dn, const char *modifytimestamp,
+                            MEMBERLIST *members)
+{
+  struct nested_cache_entry *cacheentry;
+  int found = 0;
+  if (nslcd_cfg->cache_nested == 0)
+    return 0;
+  pthread_mutex_lock(&nested_cache_mutex);
+  if ((nested_cache != NULL) &&
+      ((cacheentry = dict_get(nested_cache, dn)) != NULL) &&
+      ((modifytimestamp == NULL) || (cacheentry->modifytimestamp == NULL) ||
+       (strcmp(modifytimestamp, cacheentry->modifytimestamp) == 0)) &&
+      (do_nested_cache_valid(cacheentry, time(NULL), 0)))
+  {
+    found = (memberlist_addall(members, cacheentry->members) == 0);
+  }
+  pthread_mutex_unlock(&nested_cache_mutex);
+  return found;
+}
+
+/* store the flattened members of the group in the cache */
+static void nested_cache_put(const char *dn, const char *modifytimestamp,
+                             MEMBERLIST *members, SET *children)
+{
+  struct nested_cache_entry *cacheentry, *oldentry;
+  if (nslcd_cfg->cache_nested == 0)
+    return;
+  /* build the new entry outside of the lock */
+  cacheentry = (struct nested_cache_entry *)malloc(sizeof(struct nested_cache_entry));
+  if (cacheentry == NULL)
+  {
+    log_log(LOG_CRIT, "nested_cache_put(): malloc() failed to allocate memory");
+    return;
+  }
+  cacheentry->timestamp = time(NULL);
+  cacheentry->modifytimestamp = (modifytimestamp != NULL) ? strdup(modifytimestamp) : NULL;
+  cacheentry->members = memberlist_new();
+  cacheentry->children = set_tolist(children);
+  if ((cacheentry->members == NULL) || (cacheentry->children == NULL) ||
+      (memberlist_addall(cacheentry->members, members) != 0) ||
+      ((modifytimestamp != NULL) && (cacheentry->modifytimestamp == NULL)))
+  {
+    log_log(LOG_CRIT, "nested_cache_put(): malloc() failed to allocate memory");
+    nested_cache_entry_free(cacheentry);
+    return;
+  }
+  pthread_mutex_lock(&nested_cache_mutex);
+  /* start over if the cache grows too big */
+  if (nested_cache_num >= NESTED_CACHE_MAX_ENTRIES)
+    do_nested_cache_clear();
+  if (nested_cache == NULL)
+    nested_cache = dict_new_ignorecase();
+  oldentry = (nested_cache != NULL) ? dict_get(nested_cache, dn) : NULL;
+  if ((nested_cache == NULL) || (dict_put(nested_cache, dn, cacheentry) != 0))
+    nested_cache_entry_free(cacheentry);
+  else if (oldentry != NULL)
+    nested_cache_entry_free(oldentry);
+  else
+    nested_cache_num++;
+  pthread_mutex_unlock(&nested_cache_mutex);
+}
+
+/* get the modifyTimestamp value of the entry (may be NULL) */
+static const char *get_modifytimestamp(MYLDAP_ENTRY *entry)
+{
+  const char **values;
+  if (nslcd_cfg->cache_nested == 0)
+    return NULL;
+  values = myldap_get_values(entry, "modifyTimestamp");
+  if ((values == NULL) || (values[0] == NULL))
+    return NULL;
+  return values[0];
+}
+
+static int expand_subgroups(MYLDAP_SESSION *session, const char *dn,
+                            const char *modifytimestamp, MEMBERLIST *members,
+                            SET *subgroups, const char **path, int depth);
+
+/* look up the group with the specified DN and add its members and the
+   members of its nested groups to members, isgroup is set if the DN
+   refers to a group, the return value is as for expand_subgroups() */
+static int expand_group(MYLDAP_SESSION *session, const char *dn,
+                        MEMBERLIST *members, const char **path, int depth,
+                        int *isgroup)
+{
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  MEMBERLIST *own;
+  SET *subgroups;
+  char *modifytimestamp = NULL;
+  const char *tmp;
+  int rc, lowcut;
+  *isgroup = 0;
+  /* get the group entry */
+  search = myldap_search(session, dn, LDAP_SCOPE_BASE, group_filter,
+                         group_attrs, &rc);
+  if (search == NULL)
+    return -1;
+  entry = myldap_get_entry(search, &rc);
+  if (entry == NULL)
+    return (rc == LDAP_SUCCESS) ? INT_MAX : -1;
+  *isgroup = 1;
+  own = memberlist_new();
+  subgroups = set_new_ignorecase();
+  if ((own == NULL) || (subgroups == NULL))
+  {
+    myldap_search_close(search);
+    if (own != NULL)
+      memberlist_free(own);
+    if (subgroups != NULL)
+      set_free(subgroups);
+    return -1;
+  }
+  /* collect the direct members and close the search before recursing so
+     we do not run out of searches on the session */
+  getmembers(entry, session, own, NULL, subgroups);
+  if ((tmp = get_modifytimestamp(entry)) != NULL)
+    modifytimestamp = strdup(tmp);
+  myldap_search_close(search);
+  /* add the members of the nested groups */
+  lowcut = expand_subgroups(session, dn, modifytimestamp, own, subgroups,
+                            path, depth);
+  if (memberlist_addall(members, own))
+    lowcut = -1;
+  memberlist_free(own);
+  set_free(subgroups);
+  if (modifytimestamp != NULL)
+    free(modifytimestamp);
+  return lowcut;
+}
+
+/* add the members of the nested groups of the group with the specified DN
+   (at the specified depth in path) to members, using and filling the
+   nested group cache, returns the lowest depth of a group on the current
+   path that was skipped to break a loop (INT_MAX if there were none) or
+   -1 on errors */
+static int expand_subgroups(MYLDAP_SESSION *session, const char *dn,
+                            const char *modifytimestamp, MEMBERLIST *members,
+                            SET *subgroups, const char **path, int depth)
+{
+  const char **list;
+  SET *children;
+  int i, j, cut, isgroup;
+  int lowcut = INT_MAX;
+  path[depth] = dn;
+  list = set_tolist(subgroups);
+  children = set_new_ignorecase();
+  if ((list == NULL) || (children == NULL))
+  {
+    if (list != NULL)
+      free(list);
+    if (children != NULL)
+      set_free(children);
+    return -1;
+  }
+  for (i = 0; list[i] != NULL; i++)
+  {
+    /* check if the group is already being expanded */
+    for (j = 0; (j <= depth) && (strcasecmp(path[j], list[i]) != 0); j++)
+      /* nothing */ ;
+    if (j <= depth)
+      cut = j;
+    else if (depth + 1 >= NESTED_MAX_DEPTH)
+    {
+      log_log(LOG_WARNING, "%s: nested groups too deep", list[i]);
+      cut = -1;
+    }
+    else if (nested_cache_get(list[i], NULL, members))
+    {
+      set_add(children, list[i]);
+      cut = INT_MAX;
+    }
+    else
+    {
+      cut = expand_group(session, list[i], members, path, depth + 1, &isgroup);
+      if (isgroup)
+        set_add(children, list[i]);
+    }
+    if (cut < lowcut)
+      lowcut = cut;
+  }
+  free(list);
+  /* the result is only complete if no group above us was skipped */
+  if (lowcut >= depth)
+    nested_cache_put(dn, modifytimestamp, members, children);
+  set_free(children);
+  return lowcut;
+}
 
 static int write_group(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname,
                        const gid_t *reqgid, int wantmembers,
                        MYLDAP_SESSION *session)
 {
-  const char **names, **gidvalues;
+  const char **names;
   const char *passwd;
-  const char **members = NULL;
-  SET *set, *seen=NULL, *subgroups=NULL;
+  MEMBERLIST *members = NULL;
+  SET *seen=NULL, *subgroups=NULL;
   gid_t gids[MAXGIDS_PER_ENTRY];
   int numgids;
   char *tmp;
   char passbuffer[BUFLEN_PASSWORDHASH];
   MYLDAP_SEARCH *search;
   MYLDAP_ENTRY *entry2;
+  const char *modifytimestamp;
+  const char *path[NESTED_MAX_DEPTH];
   int rc;
   /* get group name (cn) */
   names = myldap_get_values(entry, attmap_group_cn);
@@ -347,57 +686,53 @@ static int write_group(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname,
     gids[0] = *reqgid;
     numgids = 1;
   }
-  else
+  else if ((numgids = get_gids(entry, gids)) == 0)
+    return 0;
+  /* get group passwd (userPassword) (use only first entry) */
+  passwd = get_userpassword(entry, attmap_group_userPassword,
+                            passbuffer, sizeof(passbuffer));
+  if (passwd == NULL)
+    passwd = default_group_userPassword;
+  /* get group members (memberUid&member) */
+  if (wantmembers)
   {
-    gidvalues = myldap_get_values_len(entry, attmap_group_gidNumber);
-    if ((gidvalues == NULL) || (gidvalues[0] == NULL))
+    members = memberlist_new();
+    if ((members != NULL) &&
+        (nslcd_cfg->nss_nested_groups == NESTED_GROUPS_SERVER_CHAIN) &&
+        (strcasecmp(attmap_group_member, "\"\"") != 0))
     {
-      log_log(LOG_WARNING, "%s: %s: missing",
-              myldap_get_dn(entry), attmap_group_gidNumber);
-      return 0;
+      /* let the server find the users in this group and any nested
+         groups, falling back to a normal lookup on errors */
+      getmemberuids(entry, members);
+      if (groupdn2uids(session, myldap_get_dn(entry), members))
+        getmembers(entry, session, members, NULL, NULL);
     }
-    for (numgids = 0; (numgids < MAXGIDS_PER_ENTRY) && (gidvalues[numgids] != NULL); numgids++)
+    else if ((members != NULL) && (nslcd_cfg->cache_nested > 0) &&
+             (nslcd_cfg->nss_nested_groups == NESTED_GROUPS_ON))
     {
-      if (gidSid != NULL)
-        gids[numgids] = (gid_t)binsid2id(gidvalues[numgids]);
-      else
+      /* expand the nested groups using the cache */
+      modifytimestamp = get_modifytimestamp(entry);
+      if (!nested_cache_get(myldap_get_dn(entry), modifytimestamp, members))
       {
-        errno = 0;
-        gids[numgids] = strtogid(gidvalues[numgids], &tmp, 10);
-        if ((*(gidvalues[numgids]) == '\0') || (*tmp != '\0'))
-        {
-          log_log(LOG_WARNING, "%s: %s: non-numeric",
-                  myldap_get_dn(entry), attmap_group_gidNumber);
-          return 0;
-        }
-        else if ((errno != 0) || (strchr(gidvalues[numgids], '-') != NULL))
+        subgroups = set_new_ignorecase();
+        getmembers(entry, session, members, NULL, subgroups);
+        if (subgroups != NULL)
         {
-          log_log(LOG_WARNING, "%s: %s: out of range",
-                  myldap_get_dn(entry), attmap_group_gidNumber);
-          return 0;
+          (void)expand_subgroups(session, myldap_get_dn(entry),
+                                 modifytimestamp, members, subgroups, path, 0);
+          set_free(subgroups);
         }
       }
-      gids[numgids] += nslcd_cfg->nss_gid_offset;
     }
-  }
-  /* get group passwd (userPassword) (use only first entry) */
-  passwd = get_userpassword(entry, attmap_group_userPassword,
-                            passbuffer, sizeof(passbuffer));
-  if (passwd == NULL)
-    passwd = default_group_userPassword;
-  /* get group members (memberUid&member) */
-  if (wantmembers)
-  {
-    set = set_new();
-    if (set != NULL)
+    else if (members != NULL)
     {
-      if (nslcd_cfg->nss_nested_groups)
+      if (nslcd_cfg->nss_nested_groups == NESTED_GROUPS_ON)
       {
-        seen = set_new();
-        subgroups = set_new();
+        seen = set_new_ignorecase();
+        subgroups = set_new_ignorecase();
       }
       /* collect the members from this group */
-      getmembers(entry, session, set, seen, subgroups);
+      getmembers(entry, session, members, seen, subgroups);
       /* add the members of any nested groups */
       if (subgroups != NULL)
       {
@@ -406,12 +741,10 @@ static int write_group(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname,
           search = myldap_search(session, tmp, LDAP_SCOPE_BASE, group_filter, group_attrs, NULL);
           if (search != NULL)
             while ((entry2 = myldap_get_entry(search, NULL)) != NULL)
-              getmembers(entry2, session, set, seen, subgroups);
+              getmembers(entry2, session, members, seen, subgroups);
           free(tmp);
         }
       }
-      members = set_tolist(set);
-      set_free(set);
       if (seen != NULL)
         set_free(seen);
       if (subgroups != NULL)
@@ -419,16 +752,16 @@ static int write_group(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname,
     }
   }
   /* write entries (split to a separate function so we can ensure the call
-     to free() below in case a write fails) */
+     to memberlist_free() below in case a write fails) */
   rc = do_write_group(fp, entry, names, gids, numgids, passwd, members,
                       reqname);
   /* free and return */
   if (members != NULL)
-    free(members);
+    memberlist_free(members);
   return rc;
 }
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_FIRST(
   group, byname, NSLCD_ACTION_GROUP_BYNAME,
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
@@ -443,7 +776,7 @@ NSLCD_HANDLE(
   write_group(fp, entry, name, NULL, 1, session)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_FIRST(
   group, bygid, NSLCD_ACTION_GROUP_BYGID,
   gid_t gid;
   char filter[BUFLEN_FILTER];
@@ -453,78 +786,92 @@ NSLCD_HANDLE(
   write_group(fp, entry, NULL, &gid, 1, session)
 )
 
-int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
+/* a growing list of group ids, used for the gid-only membership lookup */
+struct gidlist {
+  gid_t *gids;
+  int num;
+  int size;
+};
+
+/* add the specified group ids to the list, returns -1 on errors */
+static int gidlist_addgids(struct gidlist *list, const gid_t gids[],
+                           int numgids)
+{
+  gid_t *tmp;
+  int i;
+  for (i = 0; i < numgids; i++)
+  {
+    /* grow the list if needed */
+    if (list->num >= list->size)
+    {
+      tmp = (gid_t *)realloc(list->gids, (list->size * 2 + 16) * sizeof(gid_t));
+      if (tmp == NULL)
+      {
+        log_log(LOG_CRIT, "gidlist_addgids(): realloc() failed to allocate memory");
+        return -1;
+      }
+      list->gids = tmp;
+      list->size = list->size * 2 + 16;
+    }
+    list->gids[list->num++] = gids[i];
+  }
+  return 0;
+}
+
+/* add the group ids of the entry to the list, returns -1 on errors */
+static int gidlist_add(struct gidlist *list, MYLDAP_ENTRY *entry)
+{
+  gid_t gids[MAXGIDS_PER_ENTRY];
+  return gidlist_addgids(list, gids, get_gids(entry, gids));
+}
+
+/* write the list of group ids as a single result */
+static int write_gidlist(TFILE *fp, struct gidlist *list)
 {
-  /* define common variables */
   int32_t tmpint32;
+  int i;
+  WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+  WRITE_INT32(fp, list->num);
+  for (i = 0; i < list->num; i++)
+  {
+    WRITE_INT32(fp, list->gids[i]);
+  }
+  return 0;
+}
+
+/* handle a single group found in a bymember search, the group is either
+   written to the stream or, if gidlist is set, its gid is collected */
+static int handle_bymember_entry(TFILE *fp, MYLDAP_ENTRY *entry,
+                                 MYLDAP_SESSION *session,
+                                 struct gidlist *gidlist)
+{
+  if (gidlist != NULL)
+    return gidlist_add(gidlist, entry);
+  return write_group(fp, entry, NULL, NULL, 0, session);
+}
+
+/* perform the searches for the groups the user is a member of (split to a
+   separate function so the caller can ensure the sets are freed) */
+static int do_group_bymember(TFILE *fp, MYLDAP_SESSION *session,
+                             const char *filter, const char **attrs,
+                             SET *seen, SET *tocheck,
+                             struct gidlist *gidlist, int *rcp)
+{
   MYLDAP_SEARCH *search;
   MYLDAP_ENTRY *entry;
   const char *dn;
   const char *base;
-  int rc, i;
-  char name[BUFLEN_NAME];
-  char filter[BUFLEN_FILTER];
-  SET *seen=NULL, *tocheck=NULL;
-  /* read request parameters */
-  READ_STRING(fp, name);
-  log_setrequest("group/member=\"%s\"", name);
-  /* validate request */
-  if (!isvalidname(name))
-  {
-    log_log(LOG_WARNING, "request denied by validnames option");
-    return -1;
-  }
-  if ((nslcd_cfg->nss_initgroups_ignoreusers != NULL) &&
-      set_contains(nslcd_cfg->nss_initgroups_ignoreusers, name))
-  {
-    log_log(LOG_DEBUG, "ignored group member");
-    /* just end the request, returning no results */
-    WRITE_INT32(fp, NSLCD_VERSION);
-    WRITE_INT32(fp, NSLCD_ACTION_GROUP_BYMEMBER);
-    WRITE_INT32(fp, NSLCD_RESULT_END);
-    return 0;
-  }
-  /* write the response header */
-  WRITE_INT32(fp, NSLCD_VERSION);
-  WRITE_INT32(fp, NSLCD_ACTION_GROUP_BYMEMBER);
-  /* prepare the search filter */
-  if (mkfilter_group_bymember(session, name, filter, sizeof(filter)))
-  {
-    log_log(LOG_WARNING, "nslcd_group_bymember(): filter buffer too small");
-    return -1;
-  }
-  if ((nslcd_cfg->nss_nested_groups) && (strcasecmp(attmap_group_member, "\"\"") != 0))
-  {
-    seen = set_new();
-    tocheck = set_new();
-    if ((seen != NULL) && (tocheck == NULL))
-    {
-      set_free(seen);
-      seen = NULL;
-    }
-    else if ((tocheck != NULL) && (seen == NULL))
-    {
-      set_free(tocheck);
-      tocheck = NULL;
-    }
-  }
+  char parentfilter[BUFLEN_FILTER];
+  int i;
   /* perform a search for each search base */
   for (i = 0; (base = group_bases[i]) != NULL; i++)
   {
     /* do the LDAP search */
-    search = myldap_search(session, base, group_scope, filter,
-                           group_bymember_attrs, NULL);
+    search = myldap_search(session, base, group_scope, filter, attrs, NULL);
     if (search == NULL)
-    {
-      if (seen != NULL)
-      {
-        set_free(seen);
-        set_free(tocheck);
-      }
       return -1;
-    }
     /* go over results */
-    while ((entry = myldap_get_entry(search, &rc)) != NULL)
+    while ((entry = myldap_get_entry(search, rcp)) != NULL)
     {
       if ((seen == NULL) || (!set_contains(seen, dn = myldap_get_dn(entry))))
       {
@@ -533,15 +880,8 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
           set_add(seen, dn);
           set_add(tocheck, dn);
         }
-        if (write_group(fp, entry, NULL, NULL, 0, session))
-        {
-          if (seen != NULL)
-          {
-            set_free(seen);
-            set_free(tocheck);
-          }
+        if (handle_bymember_entry(fp, entry, session, gidlist) < 0)
           return -1;
-        }
       }
     }
   }
@@ -551,19 +891,18 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
     while ((dn = set_pop(tocheck)) != NULL)
     {
       /* make filter for finding groups with our group as member */
-      if (mkfilter_group_bymemberdn(dn, filter, sizeof(filter)))
+      if (mkfilter_group_bymemberdn(dn, parentfilter, sizeof(parentfilter)))
       {
         log_log(LOG_WARNING, "nslcd_group_bymember(): filter buffer too small");
         free((void *)dn);
-        set_free(seen);
-        set_free(tocheck);
         return -1;
       }
       free((void *)dn);
       /* do the LDAP searches */
       for (i = 0; (base = group_bases[i]) != NULL; i++)
       {
-        search = myldap_search(session, base, group_scope, filter, group_bymember_attrs, NULL);
+        search = myldap_search(session, base, group_scope, parentfilter,
+                               attrs, NULL);
         if (search != NULL)
         {
           while ((entry = myldap_get_entry(search, NULL)) != NULL)
@@ -573,20 +912,253 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
             {
               set_add(seen, dn);
               set_add(tocheck, dn);
-              if (write_group(fp, entry, NULL, NULL, 0, session))
-              {
-                set_free(seen);
-                set_free(tocheck);
+              if (handle_bymember_entry(fp, entry, session, gidlist) < 0)
                 return -1;
-              }
             }
           }
         }
       }
     }
-    set_free(seen);
-    set_free(tocheck);
   }
+  return 0;
+}
+
+/* the cache that is used in groupref2gids() */
+static pthread_mutex_t groupref_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *groupref_cache = NULL;
+struct groupref_cache_entry {
+  time_t timestamp;
+  int numgids;
+  gid_t gids[MAXGIDS_PER_ENTRY];
+};
+
+/* escape the binary SID of binlen bytes for use in a search filter,
+   returns -1 on errors */
+static int binsid2search(const char *binsid, size_t binlen,
+                         char *buffer, size_t buflen)
+{
+  int i, len;
+  /* the SID holds a revision, a count, a 6 byte authority and up to
+     15 sub-authorities of 4 bytes each */
+  if (binlen < 8)
+    return -1;
+  i = ((unsigned int)binsid[1]) & 0xff;
+  if ((i < 1) || (i > 15))
+    return -1;
+  len = 8 + i * 4;
+  if (((size_t)len > binlen) || ((size_t)(len * 3) >= buflen))
+    return -1;
+  for (i = 0; i < len; i++)
+    sprintf(buffer + i * 3, "\\%02x", ((unsigned int)binsid[i]) & 0xff);
+  return 0;
+}
+
+/* look up the group that is referenced by DN or by escaped binary SID and
+   return the number of group ids found (0 if the group was not found) */
+static int lookup_groupref_gids(MYLDAP_SESSION *session, const char *ref,
+                                int issid, gid_t gids[], int *rcp)
+{
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  const char *base;
+  char filter[BUFLEN_FILTER];
+  int i, numgids;
+  *rcp = LDAP_SUCCESS;
+  /* a DN can be looked up directly */
+  if (!issid)
+  {
+    search = myldap_search(session, ref, LDAP_SCOPE_BASE, group_filter,
+                           group_gids_attrs, rcp);
+    if (search == NULL)
+      return 0;
+    entry = myldap_get_entry(search, rcp);
+    if (entry == NULL)
+    {
+      /* a missing entry is not an error */
+      if (*rcp == LDAP_NO_SUCH_OBJECT)
+        *rcp = LDAP_SUCCESS;
+      return 0;
+    }
+    numgids = get_gids(entry, gids);
+    myldap_search_close(search);
+    return numgids;
+  }
+  /* a SID needs to be searched for */
+  if (mysnprintf(filter, sizeof(filter), "(&%s(objectSid=%s))",
+                 group_filter, ref))
+  {
+    log_log(LOG_ERR, "lookup_groupref_gids(): filter buffer too small");
+    *rcp = LDAP_OTHER;
+    return 0;
+  }
+  for (i = 0; (base = group_bases[i]) != NULL; i++)
+  {
+    search = myldap_search(session, base, group_scope, filter,
+                           group_gids_attrs, rcp);
+    if (search == NULL)
+      return 0;
+    entry = myldap_get_entry(search, rcp);
+    if (entry != NULL)
+    {
+      numgids = get_gids(entry, gids);
+      myldap_search_close(search);
+      return numgids;
+    }
+    if (*rcp != LDAP_SUCCESS)
+      return 0;
+  }
+  return 0;
+}
+
+/* translate a group reference (a DN or an escaped binary SID) into the
+   group ids, returns the number of group ids, using a cache if configured */
+static int groupref2gids(MYLDAP_SESSION *session, const char *ref,
+                         int issid, gid_t gids[], int *rcp)
+{
+  struct groupref_cache_entry *cacheentry = NULL;
+  time_t ttl;
+  int numgids;
+  /* if we don't use the cache, just lookup and return */
+  if ((nslcd_cfg->cache_dn2gid_positive == 0) && (nslcd_cfg->cache_dn2gid_negative == 0))
+    return lookup_groupref_gids(session, ref, issid, gids, rcp);
+  /* see if we have a cached entry */
+  pthread_mutex_lock(&groupref_cache_mutex);
+  if (groupref_cache == NULL)
+    groupref_cache = dict_new_ignorecase();
+  if ((groupref_cache != NULL) && ((cacheentry = dict_get(groupref_cache, ref)) != NULL))
+  {
+    ttl = (cacheentry->numgids > 0) ? nslcd_cfg->cache_dn2gid_positive
+                                    : nslcd_cfg->cache_dn2gid_negative;
+    if ((ttl > 0) && (time(NULL) < (cacheentry->timestamp + ttl)))
+    {
+      numgids = cacheentry->numgids;
+      memcpy(gids, cacheentry->gids, numgids * sizeof(gid_t));
+      pthread_mutex_unlock(&groupref_cache_mutex);
+      *rcp = LDAP_SUCCESS;
+      return numgids;
+    }
+  }
+  pthread_mutex_unlock(&groupref_cache_mutex);
+  /* look up the group using an LDAP query */
+  numgids = lookup_groupref_gids(session, ref, issid, gids, rcp);
+  /* do not remember failed lookups */
+  if (*rcp != LDAP_SUCCESS)
+    return numgids;
+  /* store the result in the cache */
+  pthread_mutex_lock(&groupref_cache_mutex);
+  if (groupref_cache != NULL)
+  {
+    cacheentry = dict_get(groupref_cache, ref);
+    if (cacheentry == NULL)
+    {
+      /* allocate a new entry in the cache */
+      cacheentry = (struct groupref_cache_entry *)malloc(sizeof(struct groupref_cache_entry));
+      if ((cacheentry != NULL) && (dict_put(groupref_cache, ref, cacheentry) != 0))
+      {
+        free(cacheentry);
+        cacheentry = NULL;
+      }
+    }
+    /* update the cache entry */
+    if (cacheentry != NULL)
+    {
+      cacheentry->timestamp = time(NULL);
+      cacheentry->numgids = numgids;
+      memcpy(cacheentry->gids, gids, numgids * sizeof(gid_t));
+    }
+  }
+  pthread_mutex_unlock(&groupref_cache_mutex);
+  return numgids;
+}
+
+/* collect the group ids of the groups that are listed in the
+   nss_initgroups_memberof attribute of the user entry (split to a separate
+   function so the caller can ensure the list is freed) */
+static int do_group_gids_bymemberof(MYLDAP_SESSION *session,
+                                    const char *name,
+                                    struct gidlist *gidlist, int *rcp)
+{
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  const char *attrs[2];
+  const char **values;
+  const size_t *lens = NULL;
+  char dn[BUFLEN_DN];
+  char ref[BUFLEN_SAFEDN];
+  gid_t gids[MAXGIDS_PER_ENTRY];
+  int issid, numgids, i;
+  /* find the DN of the user */
+  if (uid2dn(session, name, dn, sizeof(dn), rcp) == NULL)
+  {
+    /* an unknown user is just not a member of any group */
+    if (*rcp == LDAP_NO_SUCH_OBJECT)
+      *rcp = LDAP_SUCCESS;
+    return (*rcp == LDAP_SUCCESS) ? 0 : -1;
+  }
+  /* tokenGroups is only returned by base searches and lists binary SIDs */
+  issid = (strcasecmp(nslcd_cfg->nss_initgroups_memberof, "tokenGroups") == 0);
+  attrs[0] = nslcd_cfg->nss_initgroups_memberof;
+  attrs[1] = NULL;
+  search = myldap_search(session, dn, LDAP_SCOPE_BASE, "(objectClass=*)",
+                         attrs, rcp);
+  if (search == NULL)
+    return -1;
+  /* myldap_get_entry() closes the search if no entry is returned */
+  entry = myldap_get_entry(search, rcp);
+  if (entry == NULL)
+    return 0;
+  if (issid)
+    values = myldap_get_binvalues(entry, attrs[0], &lens);
+  else
+    values = myldap_get_values(entry, attrs[0]);
+  if (values == NULL)
+  {
+    myldap_search_close(search);
+    return 0;
+  }
+  /* translate every group reference into group ids (the values remain
+     valid until the search is closed) */
+  for (i = 0; values[i] != NULL; i++)
+  {
+    if (issid)
+    {
+      if (binsid2search(values[i], lens[i], ref, sizeof(ref)))
+      {
+        log_log(LOG_WARNING, "%s: %s: invalid SID", dn, attrs[0]);
+        continue;
+      }
+      numgids = groupref2gids(session, ref, 1, gids, rcp);
+    }
+    else
+      numgids = groupref2gids(session, values[i], 0, gids, rcp);
+    if (*rcp != LDAP_SUCCESS)
+      break;
+    if (gidlist_addgids(gidlist, gids, numgids))
+    {
+      myldap_search_close(search);
+      return -1;
+    }
+  }
+  myldap_search_close(search);
+  return 0;
+}
+
+/* write the collected group ids (if any) and the final result code, the
+   list is freed */
+static int finish_bymember(TFILE *fp, struct gidlist *gidlist, int rc)
+{
+  int32_t tmpint32;
+  int i;
+  /* write the collected group ids as a single result */
+  if ((rc == LDAP_SUCCESS) && (gidlist->num > 0))
+  {
+    i = write_gidlist(fp, gidlist);
+    free(gidlist->gids);
+    if (i != 0)
+      return -1;
+  }
+  else if (gidlist->gids != NULL)
+    free(gidlist->gids);
   /* write the final result code */
   if (rc == LDAP_SUCCESS)
   {
@@ -595,7 +1167,105 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
   return 0;
 }
 
-NSLCD_HANDLE(
+/* common implementation of the NSLCD_ACTION_GROUP_BYMEMBER and
+   NSLCD_ACTION_GROUP_GIDS_BYMEMBER requests */
+static int group_bymember(TFILE *fp, MYLDAP_SESSION *session, int32_t action)
+{
+  int32_t tmpint32;
+  int rc = LDAP_SUCCESS, i;
+  char name[BUFLEN_NAME];
+  char filter[BUFLEN_FILTER];
+  SET *seen=NULL, *tocheck=NULL;
+  struct gidlist gidlist = { NULL, 0, 0 };
+  /* read request parameters */
+  READ_STRING(fp, name);
+  log_setrequest("group/member=\"%s\"", name);
+  /* validate request */
+  if (!isvalidname(name))
+  {
+    log_log(LOG_WARNING, "request denied by validnames option");
+    return -1;
+  }
+  if (((nslcd_cfg->nss_initgroups_ignoreusers != NULL) &&
+       set_contains(nslcd_cfg->nss_initgroups_ignoreusers, name)) ||
+      ((nslcd_cfg->nss_initgroups_ignorealllocal) && localusers_contains(name)))
+  {
+    log_log(LOG_DEBUG, "ignored group member");
+    /* just end the request, returning no results */
+    WRITE_INT32(fp, NSLCD_VERSION);
+    WRITE_INT32(fp, action);
+    WRITE_INT32(fp, NSLCD_RESULT_END);
+    return 0;
+  }
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, action);
+  /* read the group references from the user entry if configured */
+  if ((action == NSLCD_ACTION_GROUP_GIDS_BYMEMBER) &&
+      (nslcd_cfg->nss_initgroups_memberof != NULL))
+  {
+    if (do_group_gids_bymemberof(session, name, &gidlist, &rc))
+    {
+      if (gidlist.gids != NULL)
+        free(gidlist.gids);
+      return -1;
+    }
+    return finish_bymember(fp, &gidlist, rc);
+  }
+  /* prepare the search filter */
+  if (mkfilter_group_bymember(session, name, filter, sizeof(filter)))
+  {
+    log_log(LOG_WARNING, "nslcd_group_bymember(): filter buffer too small");
+    return -1;
+  }
+  if ((nslcd_cfg->nss_nested_groups == NESTED_GROUPS_ON) &&
+      (strcasecmp(attmap_group_member, "\"\"") != 0))
+  {
+    seen = set_new_ignorecase();
+    tocheck = set_new_ignorecase();
+    if ((seen != NULL) && (tocheck == NULL))
+    {
+      set_free(seen);
+      seen = NULL;
+    }
+    else if ((tocheck != NULL) && (seen == NULL))
+    {
+      set_free(tocheck);
+      tocheck = NULL;
+    }
+  }
+  /* do the searches and write or collect the results */
+  if (action == NSLCD_ACTION_GROUP_GIDS_BYMEMBER)
+    i = do_group_bymember(fp, session, filter, group_gids_attrs,
+                          seen, tocheck, &gidlist, &rc);
+  else
+    i = do_group_bymember(fp, session, filter, group_bymember_attrs,
+                          seen, tocheck, NULL, &rc);
+  if (seen != NULL)
+  {
+    set_free(seen);
+    set_free(tocheck);
+  }
+  if (i != 0)
+  {
+    if (gidlist.gids != NULL)
+      free(gidlist.gids);
+    return -1;
+  }
+  return finish_bymember(fp, &gidlist, rc);
+}
+
+int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
+{
+  return group_bymember(fp, session, NSLCD_ACTION_GROUP_BYMEMBER);
+}
+
+int nslcd_group_gids_bymember(TFILE *fp, MYLDAP_SESSION *session)
+{
+  return group_bymember(fp, session, NSLCD_ACTION_GROUP_GIDS_BYMEMBER);
+}
+
+NSLCD_HANDLE_ALL(
   group, all, NSLCD_ACTION_GROUP_ALL,
   const char *filter;
   log_setrequest("group(all)");,
@@ -62,35 +62,21 @@ const char *attmap_host_ipHostNumber = "ipHostNumber";
 /* the attribute list to request with searches */
 static const char *host_attrs[3];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE host_byname_template;
+static FILTER_TEMPLATE host_byaddr_template;
+
 /* create a search filter for searching a host entry
    by name, return -1 on errors */
 static int mkfilter_host_byname(const char *name, char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_HOSTNAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_host_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    host_filter, attmap_host_cn, safename);
+  return filter_template_build(&host_byname_template, name, buffer, buflen);
 }
 
 static int mkfilter_host_byaddr(const char *addrstr,
                                 char *buffer, size_t buflen)
 {
-  char safeaddr[64];
-  /* escape attribute */
-  if (myldap_escape(addrstr, safeaddr, sizeof(safeaddr)))
-  {
-    log_log(LOG_ERR, "mkfilter_host_byaddr(): safeaddr buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    host_filter, attmap_host_ipHostNumber, safeaddr);
+  return filter_template_build(&host_byaddr_template, addrstr, buffer, buflen);
 }
 
 void host_init(void)
@@ -107,6 +93,10 @@ void host_init(void)
   host_attrs[0] = attmap_host_cn;
   host_attrs[1] = attmap_host_ipHostNumber;
   host_attrs[2] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&host_byname_template, host_filter, attmap_host_cn);
+  filter_template_init(&host_byaddr_template,
+                       host_filter, attmap_host_ipHostNumber);
 }
 
 /* write a single host entry to the stream */
@@ -149,7 +139,7 @@ static int write_host(TFILE *fp, MYLDAP_ENTRY *entry)
   {
     WRITE_ADDRESS(fp, entry, attmap_host_ipHostNumber, addresses[i]);
   }
-  return 0;
+  return 1;
 }
 
 NSLCD_HANDLE(
@@ -182,7 +172,7 @@ NSLCD_HANDLE(
 )
 
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   host, all, NSLCD_ACTION_HOST_ALL,
   const char *filter;
   log_setrequest("host(all)");,
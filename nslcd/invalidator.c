@@ -248,6 +248,9 @@ void invalidator_do(enum ldap_map_selector map)
 {
   uint8_t c;
   int rc;
+  /* our own authorisation decisions may also be outdated */
+  if (map == LM_NONE)
+    pam_authz_cache_clear();
   if (signalfd < 0)
     return;
   /* LM_NONE is used to signal all maps condigured in reconnect_invalidate */
@@ -0,0 +1,215 @@
+/*
+   memberlist.c - compact list of unique group member names
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "log.h"
+
+/*
+   The names are stored back to back in a single buffer in the format that
+   is used in the protocol (a 32-bit length in network byte order followed
+   by the name without terminating nul) so the whole list can be written to
+   the stream with a single call.
+
+   Duplicates are found through an open addressing hashtable that only
+   stores the hash and the offset of each name in the buffer, which is a lot
+   smaller than keeping a copy and a hashtable entry for every name.
+*/
+
+/* the initial sizes of the buffer and the hashtable */
+#define MEMBERLIST_INITBUFFER 256
+#define MEMBERLIST_INITSLOTS 32
+
+/* one slot in the hashtable, offset is the position in the buffer plus
+   one (zero marks an empty slot) */
+struct memberlist_slot {
+  uint32_t hash;
+  uint32_t offset;
+};
+
+struct memberlist {
+  uint8_t *buffer;               /* the encoded names */
+  size_t len;                    /* the used part of the buffer */
+  size_t size;                   /* the allocated size of the buffer */
+  int32_t num;                   /* the number of names in the buffer */
+  struct memberlist_slot *slots; /* the hashtable */
+  size_t numslots;               /* size of the hashtable (power of two) */
+};
+
+static uint32_t namehash(const char *name, size_t len)
+{
+  uint32_t hash = 5381;
+  size_t i;
+  for (i = 0; i < len; i++)
+    hash = 33 * hash + (uint8_t)name[i];
+  return hash;
+}
+
+MEMBERLIST *memberlist_new(void)
+{
+  MEMBERLIST *list;
+  list = (MEMBERLIST *)malloc(sizeof(MEMBERLIST));
+  if (list == NULL)
+    return NULL;
+  list->buffer = (uint8_t *)malloc(MEMBERLIST_INITBUFFER);
+  list->slots = (struct memberlist_slot *)calloc(MEMBERLIST_INITSLOTS,
+                                                 sizeof(struct memberlist_slot));
+  if ((list->buffer == NULL) || (list->slots == NULL))
+  {
+    memberlist_free(list);
+    return NULL;
+  }
+  list->len = 0;
+  list->size = MEMBERLIST_INITBUFFER;
+  list->num = 0;
+  list->numslots = MEMBERLIST_INITSLOTS;
+  return list;
+}
+
+void memberlist_free(MEMBERLIST *list)
+{
+  if (list->buffer != NULL)
+    free(list->buffer);
+  if (list->slots != NULL)
+    free(list->slots);
+  free(list);
+}
+
+/* double the size of the hashtable */
+static int memberlist_grow(MEMBERLIST *list)
+{
+  struct memberlist_slot *newslots;
+  size_t newnum, i, j;
+  newnum = list->numslots * 2;
+  newslots = (struct memberlist_slot *)calloc(newnum,
+                                              sizeof(struct memberlist_slot));
+  if (newslots == NULL)
+    return -1;
+  for (i = 0; i < list->numslots; i++)
+  {
+    if (list->slots[i].offset == 0)
+      continue;
+    for (j = list->slots[i].hash & (newnum - 1); newslots[j].offset != 0;
+         j = (j + 1) & (newnum - 1))
+      /* nothing */ ;
+    newslots[j] = list->slots[i];
+  }
+  free(list->slots);
+  list->slots = newslots;
+  list->numslots = newnum;
+  return 0;
+}
+
+/* add the name with the specified length to the list */
+static int memberlist_addn(MEMBERLIST *list, const char *name, size_t len)
+{
+  uint32_t hash, tmp;
+  size_t i, newsz;
+  uint8_t *ptr;
+  /* keep the hashtable at most half full */
+  if (((size_t)(list->num + 1) * 2 > list->numslots) && memberlist_grow(list))
+  {
+    log_log(LOG_CRIT, "memberlist_add(): calloc() failed to allocate memory");
+    return -1;
+  }
+  /* look for the name in the hashtable */
+  hash = namehash(name, len);
+  for (i = hash & (list->numslots - 1); list->slots[i].offset != 0;
+       i = (i + 1) & (list->numslots - 1))
+  {
+    if (list->slots[i].hash != hash)
+      continue;
+    ptr = list->buffer + list->slots[i].offset - 1;
+    memcpy(&tmp, ptr, sizeof(uint32_t));
+    if ((ntohl(tmp) == len) && (memcmp(ptr + sizeof(uint32_t), name, len) == 0))
+      return 0; /* already present */
+  }
+  /* make room in the buffer */
+  if ((list->len + sizeof(uint32_t) + len) > list->size)
+  {
+    newsz = list->size * 2;
+    while ((list->len + sizeof(uint32_t) + len) > newsz)
+      newsz *= 2;
+    ptr = (uint8_t *)realloc(list->buffer, newsz);
+    if (ptr == NULL)
+    {
+      log_log(LOG_CRIT, "memberlist_add(): realloc() failed to allocate memory");
+      return -1;
+    }
+    list->buffer = ptr;
+    list->size = newsz;
+  }
+  /* append the name and register it in the hashtable */
+  list->slots[i].hash = hash;
+  list->slots[i].offset = (uint32_t)list->len + 1;
+  tmp = htonl((uint32_t)len);
+  memcpy(list->buffer + list->len, &tmp, sizeof(uint32_t));
+  memcpy(list->buffer + list->len + sizeof(uint32_t), name, len);
+  list->len += sizeof(uint32_t) + len;
+  list->num++;
+  return 0;
+}
+
+int memberlist_add(MEMBERLIST *list, const char *name)
+{
+  return memberlist_addn(list, name, strlen(name));
+}
+
+int memberlist_addall(MEMBERLIST *list, MEMBERLIST *other)
+{
+  size_t pos = 0;
+  uint32_t tmp;
+  while (pos < other->len)
+  {
+    memcpy(&tmp, other->buffer + pos, sizeof(uint32_t));
+    tmp = ntohl(tmp);
+    if (memberlist_addn(list, (const char *)other->buffer + pos + sizeof(uint32_t),
+                        (size_t)tmp))
+      return -1;
+    pos += sizeof(uint32_t) + tmp;
+  }
+  return 0;
+}
+
+int memberlist_size(MEMBERLIST *list)
+{
+  return (int)list->num;
+}
+
+int memberlist_write(TFILE *fp, MEMBERLIST *list)
+{
+  int32_t tmpint32;
+  if (list == NULL)
+  {
+    WRITE_INT32(fp, 0);
+    return 0;
+  }
+  WRITE_INT32(fp, list->num);
+  if (list->len > 0)
+  {
+    WRITE(fp, list->buffer, list->len);
+  }
+  return 0;
+}
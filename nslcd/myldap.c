@@ -70,7 +70,6 @@
 #include "common.h"
 #include "log.h"
 #include "cfg.h"
-#include "common/set.h"
 #include "compat/ldap_compat.h"
 #include "attmap.h"
 
@@ -80,6 +79,12 @@
 /* the maximum number of dn's to log to the debug log for each search */
 #define MAX_DEBUG_LOG_DNS 10
 
+/* the Active Directory extended operation to only verify credentials on
+   bind operations */
+#ifndef LDAP_SERVER_FAST_BIND_OID
+#define LDAP_SERVER_FAST_BIND_OID "1.2.840.113556.1.4.1781"
+#endif /* not LDAP_SERVER_FAST_BIND_OID */
+
 /* a fake scope that is used to not perform an actual search but only
    simulate the handling of the search (used for authentication) */
 #define MYLDAP_SCOPE_BINDONLY 0x1972  /* magic number: should never be a real scope */
@@ -103,6 +108,15 @@ struct ldap_session {
   int policy_response;
   /* the authentication message */
   char policy_message[BUFLEN_MESSAGE];
+  /* whether user binds should use Active Directory fast bind mode */
+  int fastbind;
+  /* whether the current connection is in fast bind mode */
+  int fastbind_active;
+  /* memory of closed searches and entries that is kept for re-use */
+  struct myldap_search *freesearches[MAX_SEARCHES_IN_SESSION];
+  struct myldap_entry *freeentry;
+  struct myldap_chunk *freechunks;
+  int numfreechunks;
 };
 
 /* A search description set as returned by myldap_search(). */
@@ -125,19 +139,52 @@ struct myldap_search {
   LDAPMessage *msg;
   /* cookie for paged searches */
   struct berval *cookie;
+  /* whether the search is done with the paged results control */
+  int paged;
+  /* the messages of the page of a paged search that is being read or
+     processed (msg points into this list), the number of messages, the
+     allocated size and the next message to process (-1 while the page is
+     still being read) */
+  LDAPMessage **pagemsgs;
+  int pagenum;
+  int pagemax;
+  int pagepos;
   /* to indicate that we can retry the search from myldap_get_entry() */
   int may_retry_search;
   /* the number of results returned so far */
   int count;
+  /* the allocated size of the memory block holding the search */
+  size_t size;
+};
+
+/* The attribute values of entries are stored in chunks of memory of this
+   size. Chunks are kept in the session so following entries and requests
+   can re-use them without calling malloc(). */
+#define ENTRY_CHUNK_SIZE 4096
+
+/* The maximum number of unused chunks to keep in the session. */
+#define MAX_FREE_CHUNKS 16
+
+/* A chunk of memory, the data follows the header. */
+struct myldap_chunk {
+  struct myldap_chunk *next;
+  size_t size;
+  size_t used;
 };
 
-/* The maximum number of calls to myldap_get_values() that may be
-   done per returned entry. */
-#define MAX_ATTRIBUTES_PER_ENTRY 16
+/* Whether attribute values can be found in the LDAP message without
+   having the LDAP library copy them first. */
+#if defined(HAVE_LDAP_GET_DN_BER) && defined(HAVE_LDAP_GET_ATTRIBUTE_BER) && defined(HAVE_BER_MEMFREE)
+#define USE_BER_VALUES 1
+#endif
 
-/* The maximum number of buffers (used for ranged attribute values and
-   values returned by bervalues_to_values()) that may be stored per entry. */
-#define MAX_BUFFERS_PER_ENTRY 8
+/* An attribute with its values in the index of an entry, the name and
+   values are stored in a single block of memory. */
+struct myldap_attr {
+  const char *name;
+  uint32_t hash;
+  char **values;
+};
 
 /* A single entry from the LDAP database as returned by
    myldap_get_entry(). */
@@ -149,10 +196,22 @@ struct myldap_entry {
   const char *dn;
   /* a cached version of the exploded rdn */
   char **exploded_rdn;
-  /* a cache of attribute to value list */
-  char **attributevalues[MAX_ATTRIBUTES_PER_ENTRY];
-  /* a reference to buffers so we can free() them later on */
-  char **buffers[MAX_BUFFERS_PER_ENTRY];
+  /* whether the attributes were decoded into the index */
+  int decoded;
+  /* the result of decoding the attributes */
+  int decoderc;
+  /* whether any attribute names have options (e.g. ranges) */
+  int hasoptions;
+  /* hashtable of attribute names to values (open addressing) */
+  struct myldap_attr *attrs;
+  int numattrs;
+  int maxattrs;
+  /* the chunks of memory that hold the attribute values */
+  struct myldap_chunk *chunks;
+  /* other buffers that should be free()d with the entry */
+  void **buffers;
+  int numbuffers;
+  int maxbuffers;
 };
 
 /* Flag to record first search operation */
@@ -194,31 +253,102 @@ static void myldap_err(int pri, LDAP *ld, int rc, const char *format, ...)
 
 static MYLDAP_ENTRY *myldap_entry_new(MYLDAP_SEARCH *search)
 {
+  MYLDAP_SESSION *session = search->session;
   MYLDAP_ENTRY *entry;
-  int i;
-  /* Note: as an alternative we could embed the myldap_entry into the
-     myldap_search struct to save on malloc() and free() calls. */
-  /* allocate new entry */
-  entry = (MYLDAP_ENTRY *)malloc(sizeof(struct myldap_entry));
-  if (entry == NULL)
+  if (session->freeentry != NULL)
   {
-    log_log(LOG_CRIT, "myldap_entry_new(): malloc() failed to allocate memory");
-    exit(EXIT_FAILURE);
+    /* re-use the entry (and its index) of a previous result */
+    entry = session->freeentry;
+    session->freeentry = NULL;
+    if (entry->attrs != NULL)
+      memset(entry->attrs, 0, entry->maxattrs * sizeof(struct myldap_attr));
+  }
+  else
+  {
+    /* allocate new entry */
+    entry = (MYLDAP_ENTRY *)malloc(sizeof(struct myldap_entry));
+    if (entry == NULL)
+    {
+      log_log(LOG_CRIT, "myldap_entry_new(): malloc() failed to allocate memory");
+      exit(EXIT_FAILURE);
+    }
+    entry->attrs = NULL;
+    entry->maxattrs = 0;
+    entry->buffers = NULL;
+    entry->maxbuffers = 0;
   }
   /* fill in fields */
   entry->search = search;
   entry->dn = NULL;
   entry->exploded_rdn = NULL;
-  for (i = 0; i < MAX_ATTRIBUTES_PER_ENTRY; i++)
-    entry->attributevalues[i] = NULL;
-  for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
-    entry->buffers[i] = NULL;
+  entry->decoded = 0;
+  entry->decoderc = LDAP_SUCCESS;
+  entry->hasoptions = 0;
+  entry->numattrs = 0;
+  entry->chunks = NULL;
+  entry->numbuffers = 0;
   /* return the fresh entry */
   return entry;
 }
 
+/* Free the last message that was returned for the search, messages that
+   are part of a page that was read ahead are freed with the page. */
+static void myldap_search_msgfree(MYLDAP_SEARCH *search)
+{
+  if ((search->msg != NULL) && (search->pagenum == 0))
+    ldap_msgfree(search->msg);
+  search->msg = NULL;
+}
+
+/* Free the messages of the page that was read ahead (the list itself is
+   kept for the next page). */
+static void myldap_search_pagefree(MYLDAP_SEARCH *search)
+{
+  int i;
+  for (i = 0; i < search->pagenum; i++)
+    ldap_msgfree(search->pagemsgs[i]);
+  search->pagenum = 0;
+  search->pagepos = -1;
+}
+
+/* Add the message to the page that is being read, returns -1 if memory
+   could not be allocated. */
+static int myldap_search_pageadd(MYLDAP_SEARCH *search, LDAPMessage *msg)
+{
+  LDAPMessage **tmp;
+  int newmax;
+  if (search->pagenum >= search->pagemax)
+  {
+    newmax = (search->pagemax == 0) ? nslcd_cfg->pagesize + 2
+                                    : search->pagemax * 2;
+    tmp = (LDAPMessage **)realloc(search->pagemsgs,
+                                  newmax * sizeof(LDAPMessage *));
+    if (tmp == NULL)
+    {
+      log_log(LOG_CRIT, "myldap_search_pageadd(): realloc() failed to allocate memory");
+      return -1;
+    }
+    search->pagemsgs = tmp;
+    search->pagemax = newmax;
+  }
+  search->pagemsgs[search->pagenum++] = msg;
+  return 0;
+}
+
+/* Free the entry struct itself, including the index. */
+static void myldap_entry_destroy(MYLDAP_ENTRY *entry)
+{
+  if (entry->attrs != NULL)
+    free(entry->attrs);
+  if (entry->buffers != NULL)
+    free(entry->buffers);
+  free(entry);
+}
+
 static void myldap_entry_free(MYLDAP_ENTRY *entry)
 {
+  MYLDAP_SESSION *session = entry->search->session;
+  struct myldap_chunk *chunk;
   int i;
   /* free the DN */
   if (entry->dn != NULL)
@@ -226,19 +356,114 @@ static void myldap_entry_free(MYLDAP_ENTRY *entry)
   /* free the exploded RDN */
   if (entry->exploded_rdn != NULL)
     ldap_value_free(entry->exploded_rdn);
-  /* free all attribute values */
-  for (i = 0; i < MAX_ATTRIBUTES_PER_ENTRY; i++)
-    if (entry->attributevalues[i] != NULL)
-      ldap_value_free(entry->attributevalues[i]);
+  /* return the chunks with attribute values to the session */
+  while (entry->chunks != NULL)
+  {
+    chunk = entry->chunks;
+    entry->chunks = chunk->next;
+    if ((chunk->size == ENTRY_CHUNK_SIZE) &&
+        (session->numfreechunks < MAX_FREE_CHUNKS))
+    {
+      chunk->next = session->freechunks;
+      session->freechunks = chunk;
+      session->numfreechunks++;
+    }
+    else
+      free(chunk);
+  }
   /* free all buffers */
-  for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
-    if (entry->buffers[i] != NULL)
-      free(entry->buffers[i]);
+  for (i = 0; i < entry->numbuffers; i++)
+    free(entry->buffers[i]);
+  entry->numbuffers = 0;
   /* we don't need the result anymore, ditch it. */
-  ldap_msgfree(entry->search->msg);
-  entry->search->msg = NULL;
-  /* free the actual memory for the struct */
-  free(entry);
+  myldap_search_msgfree(entry->search);
+  /* keep the struct for the next entry or free it */
+  if (session->freeentry == NULL)
+    session->freeentry = entry;
+  else
+    myldap_entry_destroy(entry);
+}
+
+/* Allocate memory for attribute values that is released together with the
+   entry. Small allocations are carved out of chunks that are kept in the
+   session for re-use. */
+static void *myldap_entry_alloc(MYLDAP_ENTRY *entry, size_t sz)
+{
+  MYLDAP_SESSION *session = entry->search->session;
+  struct myldap_chunk *chunk = entry->chunks;
+  void *ptr;
+  /* keep the returned memory aligned for storing pointers */
+  sz = (sz + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  if ((chunk == NULL) || ((chunk->size - chunk->used) < sz))
+  {
+    if (sz > ENTRY_CHUNK_SIZE)
+    {
+      /* large values get a chunk of their own */
+      chunk = (struct myldap_chunk *)malloc(sizeof(struct myldap_chunk) + sz);
+      if (chunk == NULL)
+      {
+        log_log(LOG_CRIT, "myldap_entry_alloc(): malloc() failed to allocate memory");
+        return NULL;
+      }
+      chunk->size = sz;
+      chunk->used = sz;
+      /* keep the current chunk in front so its remaining space is used */
+      if (entry->chunks != NULL)
+      {
+        chunk->next = entry->chunks->next;
+        entry->chunks->next = chunk;
+      }
+      else
+      {
+        chunk->next = NULL;
+        entry->chunks = chunk;
+      }
+      return (char *)chunk + sizeof(struct myldap_chunk);
+    }
+    if (session->freechunks != NULL)
+    {
+      chunk = session->freechunks;
+      session->freechunks = chunk->next;
+      session->numfreechunks--;
+    }
+    else
+    {
+      chunk = (struct myldap_chunk *)malloc(sizeof(struct myldap_chunk) + ENTRY_CHUNK_SIZE);
+      if (chunk == NULL)
+      {
+        log_log(LOG_CRIT, "myldap_entry_alloc(): malloc() failed to allocate memory");
+        return NULL;
+      }
+      chunk->size = ENTRY_CHUNK_SIZE;
+    }
+    chunk->used = 0;
+    chunk->next = entry->chunks;
+    entry->chunks = chunk;
+  }
+  ptr = (char *)chunk + sizeof(struct myldap_chunk) + chunk->used;
+  chunk->used += sz;
+  return ptr;
+}
+
+/* Register the buffer with the entry so it is free()d with the entry. */
+static int myldap_entry_keep(MYLDAP_ENTRY *entry, void *buffer)
+{
+  void **tmp;
+  int newmax;
+  if (entry->numbuffers >= entry->maxbuffers)
+  {
+    newmax = (entry->maxbuffers == 0) ? 4 : entry->maxbuffers * 2;
+    tmp = (void **)realloc(entry->buffers, newmax * sizeof(void *));
+    if (tmp == NULL)
+    {
+      log_log(LOG_CRIT, "myldap_entry_keep(): realloc() failed to allocate memory");
+      return -1;
+    }
+    entry->buffers = tmp;
+    entry->maxbuffers = newmax;
+  }
+  entry->buffers[entry->numbuffers++] = buffer;
+  return 0;
 }
 
 static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
@@ -246,9 +471,9 @@ static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
                                         const char *filter,
                                         const char **attrs)
 {
-  char *buffer;
+  char *buffer = NULL;
   MYLDAP_SEARCH *search;
-  int i;
+  int i, j;
   size_t sz;
   /* figure out size for new memory block to allocate
      this has the advantage that we can free the whole lot with one call */
@@ -257,8 +482,21 @@ static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
   for (i = 0; attrs[i] != NULL; i++)
     sz += strlen(attrs[i]) + 1;
   sz += (i + 1) * sizeof(char *);
+  /* re-use the memory of a closed search if it is large enough */
+  for (j = 0; j < MAX_SEARCHES_IN_SESSION; j++)
+  {
+    if ((session->freesearches[j] != NULL) &&
+        (session->freesearches[j]->size >= sz))
+    {
+      sz = session->freesearches[j]->size;
+      buffer = (char *)session->freesearches[j];
+      session->freesearches[j] = NULL;
+      break;
+    }
+  }
   /* allocate new results memory region */
-  buffer = (char *)malloc(sz);
+  if (buffer == NULL)
+    buffer = (char *)malloc(sz);
   if (buffer == NULL)
   {
     log_log(LOG_CRIT, "myldap_search_new(): malloc() failed to allocate memory");
@@ -267,6 +505,7 @@ static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
   /* initialize struct */
   search = (MYLDAP_SEARCH *)(void *)(buffer);
   buffer += sizeof(struct myldap_search);
+  search->size = sz;
   /* save pointer to session */
   search->session = session;
   /* flag as valid search */
@@ -295,6 +534,11 @@ static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
   /* initialize context */
   search->cookie = NULL;
   search->msg = NULL;
+  search->paged = 0;
+  search->pagemsgs = NULL;
+  search->pagenum = 0;
+  search->pagemax = 0;
+  search->pagepos = -1;
   search->msgid = -1;
   search->may_retry_search = 1;
   /* clear result entry */
@@ -320,12 +564,20 @@ static MYLDAP_SESSION *myldap_session_new(void)
   session->lastactivity = 0;
   session->current_uri = 0;
   for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
+  {
     session->searches[i] = NULL;
+    session->freesearches[i] = NULL;
+  }
+  session->freeentry = NULL;
+  session->freechunks = NULL;
+  session->numfreechunks = 0;
   session->binddn[0] = '\0';
   memset(session->bindpw, 0, sizeof(session->bindpw));
   session->bindpw[0] = '\0';
   session->policy_response = NSLCD_PAM_SUCCESS;
   session->policy_message[0] = '\0';
+  session->fastbind = 0;
+  session->fastbind_active = 0;
   /* return the new session */
   return session;
 }
@@ -663,36 +915,50 @@ static int do_ppolicy_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
 }
 #endif /* no SASL, so no ppolicy */
 
-/* This function performs the authentication phase of opening a connection.
-   The binddn and bindpw parameters may be used to override the authentication
-   mechanism defined in the configuration.  This returns an LDAP result
-   code. */
-static int do_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
+#ifdef HAVE_LDAP_EXTENDED_OPERATION_S
+/* switch the connection to fast bind mode, in this mode the server only
+   verifies the credentials on bind and the connection is not
+   authenticated afterwards */
+static void do_enable_fastbind(MYLDAP_SESSION *session, LDAP *ld,
+                               const char *uri)
 {
   int rc;
+  log_log(LOG_DEBUG, "ldap_extended_operation_s(LDAP_SERVER_FAST_BIND_OID) (uri=\"%s\")",
+          uri);
+  rc = ldap_extended_operation_s(ld, LDAP_SERVER_FAST_BIND_OID, NULL,
+                                 NULL, NULL, NULL, NULL);
+  if (rc == LDAP_SUCCESS)
+    session->fastbind_active = 1;
+  else
+  {
+    /* do not try again on this session */
+    myldap_err(LOG_WARNING, ld, rc, "failed to enable fast bind (uri=%s)", uri);
+    session->fastbind = 0;
+  }
+}
+#endif /* HAVE_LDAP_EXTENDED_OPERATION_S */
+
+/* This function sends the credentials to the server, either the ones
+   stored in the session or the ones from the configuration. This can also
+   be used to bind again on an already open connection. This returns an
+   LDAP result code. */
+static int do_bind_credentials(MYLDAP_SESSION *session, LDAP *ld,
+                               const char *uri)
+{
 #ifdef HAVE_LDAP_SASL_INTERACTIVE_BIND_S
+  int rc;
 #ifndef HAVE_SASL_INTERACT_T
   struct berval cred;
 #endif /* not HAVE_SASL_INTERACT_T */
 #endif /* HAVE_LDAP_SASL_INTERACTIVE_BIND_S */
-#ifdef LDAP_OPT_X_TLS
-  /* check if StartTLS is requested */
-  if (nslcd_cfg->ssl == SSL_START_TLS)
-  {
-    log_log(LOG_DEBUG, "ldap_start_tls_s()");
-    errno = 0;
-    rc = ldap_start_tls_s(ld, NULL, NULL);
-    if (rc != LDAP_SUCCESS)
-    {
-      myldap_err(LOG_WARNING, ld, rc, "ldap_start_tls_s() failed (uri=%s)",
-                 uri);
-      return rc;
-    }
-  }
-#endif /* LDAP_OPT_X_TLS */
   /* check if the binddn and bindpw are overwritten in the session */
   if (session->binddn[0] != '\0')
   {
+#ifdef HAVE_LDAP_EXTENDED_OPERATION_S
+    /* the fast bind mode stays in effect until the connection is closed */
+    if ((session->fastbind) && (!session->fastbind_active))
+      do_enable_fastbind(session, ld, uri);
+#endif /* HAVE_LDAP_EXTENDED_OPERATION_S */
 #if defined(HAVE_LDAP_SASL_BIND) && defined(LDAP_SASL_SIMPLE)
     return do_ppolicy_bind(session, ld, uri);
 #else /* no SASL, so no ppolicy */
@@ -762,6 +1028,31 @@ static int do_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
   return ldap_simple_bind_s(ld, nslcd_cfg->binddn, nslcd_cfg->bindpw);
 }
 
+/* This function performs the authentication phase of opening a connection.
+   The binddn and bindpw parameters may be used to override the authentication
+   mechanism defined in the configuration.  This returns an LDAP result
+   code. */
+static int do_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
+{
+#ifdef LDAP_OPT_X_TLS
+  int rc;
+  /* check if StartTLS is requested */
+  if (nslcd_cfg->ssl == SSL_START_TLS)
+  {
+    log_log(LOG_DEBUG, "ldap_start_tls_s()");
+    errno = 0;
+    rc = ldap_start_tls_s(ld, NULL, NULL);
+    if (rc != LDAP_SUCCESS)
+    {
+      myldap_err(LOG_WARNING, ld, rc, "ldap_start_tls_s() failed (uri=%s)",
+                 uri);
+      return rc;
+    }
+  }
+#endif /* LDAP_OPT_X_TLS */
+  return do_bind_credentials(session, ld, uri);
+}
+
 #ifdef HAVE_LDAP_SET_REBIND_PROC
 /* This function is called by the LDAP library when chasing referrals.
    It is configured with the ldap_set_rebind_proc() below. */
@@ -986,11 +1277,8 @@ static void do_close(MYLDAP_SESSION *session)
       if (session->searches[i] != NULL)
       {
         /* free any messages (because later ld is no longer valid) */
-        if (session->searches[i]->msg != NULL)
-        {
-          ldap_msgfree(session->searches[i]->msg);
-          session->searches[i]->msg = NULL;
-        }
+        myldap_search_msgfree(session->searches[i]);
+        myldap_search_pagefree(session->searches[i]);
         /* abandon the search if there were more results to fetch */
         if (session->searches[i]->msgid != -1)
         {
@@ -1012,6 +1300,7 @@ static void do_close(MYLDAP_SESSION *session)
     log_log(LOG_DEBUG, "ldap_unbind()");
     rc = ldap_unbind(session->ld);
     session->ld = NULL;
+    session->fastbind_active = 0;
     if (rc != LDAP_SUCCESS)
       myldap_err(LOG_WARNING, session->ld, rc, "ldap_unbind() failed");
   }
@@ -1125,6 +1414,34 @@ static int do_open(MYLDAP_SESSION *session)
   return LDAP_SUCCESS;
 }
 
+/* check whether the result of a bind on an open connection indicates that
+   the connection can no longer be used */
+static int is_connection_error(int rc)
+{
+  return (rc == LDAP_SERVER_DOWN) || (rc == LDAP_UNAVAILABLE) ||
+         (rc == LDAP_CONNECT_ERROR) || (rc == LDAP_TIMEOUT) ||
+         (rc == LDAP_BUSY) || (rc == LDAP_LOCAL_ERROR) ||
+         (rc == LDAP_OPERATIONS_ERROR) || (rc == LDAP_PROTOCOL_ERROR);
+}
+
+/* bind again with the credentials from the session on the already open
+   connection, the connection is closed if it is no longer usable */
+static int do_rebind_open(MYLDAP_SESSION *session)
+{
+  int rc;
+  errno = 0;
+  rc = do_bind_credentials(session, session->ld,
+                           nslcd_cfg->uris[session->current_uri].uri);
+  if (rc == LDAP_SUCCESS)
+    time(&(session->lastactivity));
+  else if (is_connection_error(rc))
+  {
+    myldap_err(LOG_DEBUG, session->ld, rc, "failed to bind on open connection");
+    do_close(session);
+  }
+  return rc;
+}
+
 /* Perform a simple bind operation and return the ppolicy results. */
 int myldap_bind(MYLDAP_SESSION *session, const char *dn, const char *password,
                 int *response, const char **message)
@@ -1150,13 +1467,23 @@ int myldap_bind(MYLDAP_SESSION *session, const char *dn, const char *password,
   session->binddn[sizeof(session->binddn) - 1] = '\0';
   strncpy(session->bindpw, password, sizeof(session->bindpw));
   session->bindpw[sizeof(session->bindpw) - 1] = '\0';
-  /* construct a fake search to trigger the BIND operation */
-  attrs[0] = "dn";
-  attrs[1] = NULL;
-  search = myldap_search(session, session->binddn, MYLDAP_SCOPE_BINDONLY,
-                         "(objectClass=*)", attrs, &rc);
-  if (search != NULL)
-    myldap_search_close(search);
+  /* clear results of any previous bind on this session */
+  session->policy_response = NSLCD_PAM_SUCCESS;
+  session->policy_message[0] = '\0';
+  /* re-use the connection if it is still open (e.g. a pooled session) */
+  rc = LDAP_UNAVAILABLE;
+  if (session->ld != NULL)
+    rc = do_rebind_open(session);
+  if ((session->ld == NULL) || (is_connection_error(rc)))
+  {
+    /* construct a fake search to trigger the BIND operation */
+    attrs[0] = "dn";
+    attrs[1] = NULL;
+    search = myldap_search(session, session->binddn, MYLDAP_SCOPE_BINDONLY,
+                           "(objectClass=*)", attrs, &rc);
+    if (search != NULL)
+      myldap_search_close(search);
+  }
   /* return ppolicy results */
   if (response != NULL)
     *response = session->policy_response;
@@ -1165,6 +1492,29 @@ int myldap_bind(MYLDAP_SESSION *session, const char *dn, const char *password,
   return rc;
 }
 
+/* Bind the session with the credentials from the configuration again. */
+int myldap_reset_bind(MYLDAP_SESSION *session)
+{
+  /* forget the credentials that were set with myldap_bind() */
+  session->binddn[0] = '\0';
+  memset(session->bindpw, 0, sizeof(session->bindpw));
+  session->policy_response = NSLCD_PAM_SUCCESS;
+  session->policy_message[0] = '\0';
+  /* without a connection there is nothing to re-bind */
+  if (session->ld == NULL)
+    return LDAP_UNAVAILABLE;
+  /* a connection in fast bind mode is never authenticated */
+  if (session->fastbind_active)
+    return LDAP_SUCCESS;
+  return do_rebind_open(session);
+}
+
+/* Set whether binds on the session use Active Directory fast bind mode. */
+void myldap_set_fastbind(MYLDAP_SESSION *session, int fastbind)
+{
+  session->fastbind = fastbind;
+}
+
 /* perform a search operation, the connection is assumed to be open */
 static int do_try_search(MYLDAP_SEARCH *search)
 {
@@ -1178,12 +1528,16 @@ static int do_try_search(MYLDAP_SEARCH *search)
 #endif /* HAVE_LDAP_CREATE_DEREF_CONTROL */
   int msgid;
   /* if we're using paging, build a page control */
+  search->paged = 0;
   if ((nslcd_cfg->pagesize > 0) && (search->scope != LDAP_SCOPE_BASE))
   {
     rc = ldap_create_page_control(search->session->ld, nslcd_cfg->pagesize,
                                   search->cookie, 0, &serverctrls[ctrlidx]);
     if (rc == LDAP_SUCCESS)
+    {
       ctrlidx++;
+      search->paged = 1;
+    }
     else
     {
       myldap_err(LOG_WARNING, search->session->ld, rc,
@@ -1279,6 +1633,8 @@ void myldap_session_cleanup(MYLDAP_SESSION *session)
 
 void myldap_session_close(MYLDAP_SESSION *session)
 {
+  struct myldap_chunk *chunk;
+  int i;
   /* check parameter */
   if (session == NULL)
   {
@@ -1289,6 +1645,18 @@ void myldap_session_close(MYLDAP_SESSION *session)
   myldap_session_cleanup(session);
   /* close any open connections */
   do_close(session);
+  /* free memory that was kept for re-use */
+  for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
+    if (session->freesearches[i] != NULL)
+      free(session->freesearches[i]);
+  if (session->freeentry != NULL)
+    myldap_entry_destroy(session->freeentry);
+  while (session->freechunks != NULL)
+  {
+    chunk = session->freechunks;
+    session->freechunks = chunk->next;
+    free(chunk);
+  }
   /* free allocated memory */
   memset(session->bindpw, 0, sizeof(session->bindpw));
   free(session);
@@ -1497,17 +1865,27 @@ MYLDAP_SEARCH *myldap_search(MYLDAP_SESSION *session,
   return search;
 }
 
+int myldap_search_slots(MYLDAP_SESSION *session)
+{
+  int i, num = 0;
+  for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
+    if (session->searches[i] == NULL)
+      num++;
+  return num;
+}
+
 void myldap_search_close(MYLDAP_SEARCH *search)
 {
   int i;
   if (search == NULL)
     return;
   /* free any messages */
-  if (search->msg != NULL)
-  {
-    ldap_msgfree(search->msg);
-    search->msg = NULL;
-  }
+  myldap_search_msgfree(search);
+  myldap_search_pagefree(search);
+  if (search->pagemsgs != NULL)
+    free(search->pagemsgs);
+  search->pagemsgs = NULL;
+  search->pagemax = 0;
   /* abandon the search if there were more results to fetch */
   if ((search->session->ld != NULL) && (search->msgid != -1))
   {
@@ -1523,23 +1901,112 @@ void myldap_search_close(MYLDAP_SEARCH *search)
   /* free any search entries */
   if (search->entry != NULL)
     myldap_entry_free(search->entry);
+  search->entry = NULL;
   /* clean up cookie */
   if (search->cookie != NULL)
     ber_bvfree(search->cookie);
   /* free read messages */
   if (search->msg != NULL)
     ldap_msgfree(search->msg);
-  /* free the storage we allocated */
+  /* keep the storage for a following search or free it */
+  for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
+  {
+    if (search->session->freesearches[i] == NULL)
+    {
+      search->session->freesearches[i] = search;
+      return;
+    }
+  }
   free(search);
 }
 
-MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
+/* Parse the result message at the end of the search (or of a page of a
+   paged search) and keep the cookie for the next page. The message is
+   freed if freeit is set. Returns an LDAP status code. */
+static int myldap_parse_search_result(MYLDAP_SEARCH *search,
+                                      LDAPMessage *msg, int freeit)
 {
   int rc;
   int parserc;
-  struct timeval tv, *tvp;
-  LDAPControl **resultcontrols;
+  LDAPControl **resultcontrols = NULL;
   ber_int_t count;
+  if (search->cookie != NULL)
+  {
+    ber_bvfree(search->cookie);
+    search->cookie = NULL;
+  }
+  parserc = ldap_parse_result(search->session->ld, msg, &rc,
+                              NULL, NULL, NULL, &resultcontrols, freeit);
+  /* check for errors during parsing */
+  if ((parserc != LDAP_SUCCESS) && (parserc != LDAP_MORE_RESULTS_TO_RETURN))
+  {
+    if (resultcontrols != NULL)
+      ldap_controls_free(resultcontrols);
+    myldap_err(LOG_ERR, search->session->ld, parserc, "ldap_parse_result() failed");
+    return parserc;
+  }
+  /* check for errors in message */
+  if ((rc != LDAP_SUCCESS) && (rc != LDAP_MORE_RESULTS_TO_RETURN))
+  {
+    if (resultcontrols != NULL)
+      ldap_controls_free(resultcontrols);
+    myldap_err(LOG_ERR, search->session->ld, rc, "ldap_result() failed");
+    return rc;
+  }
+  /* handle result controls */
+  if (resultcontrols != NULL)
+  {
+    /* see if there are any more pages to come */
+    rc = ldap_parse_page_control(search->session->ld, resultcontrols,
+                                 &count, &(search->cookie));
+    if (rc != LDAP_SUCCESS)
+    {
+      if (rc != LDAP_CONTROL_NOT_FOUND)
+        myldap_err(LOG_WARNING, search->session->ld, rc, "ldap_parse_page_control() failed");
+      /* clear error flag */
+      rc = LDAP_SUCCESS;
+      if (ldap_set_option(search->session->ld, LDAP_OPT_ERROR_NUMBER,
+                          &rc) != LDAP_SUCCESS)
+        log_log(LOG_WARNING, "failed to clear the error flag");
+    }
+    /* TODO: handle the above return code?? */
+    ldap_controls_free(resultcontrols);
+  }
+  search->msgid = -1;
+  return LDAP_SUCCESS;
+}
+
+PURE static inline int has_more_pages(MYLDAP_SEARCH *search)
+{
+  return (search->cookie != NULL) && (search->cookie->bv_len > 0);
+}
+
+/* Handle a complete page of a paged search that was read into
+   search->pagemsgs (the last message is the search result). The next page
+   is requested before the entries of this page are returned so the server
+   can prepare it while this page is processed (the cookie that is needed
+   for the request is only available at the end of the page). Returns an
+   LDAP status code. */
+static int myldap_handle_page(MYLDAP_SEARCH *search)
+{
+  int rc;
+  rc = myldap_parse_search_result(search,
+                                  search->pagemsgs[search->pagenum - 1], 0);
+  if (rc != LDAP_SUCCESS)
+    return rc;
+  /* request the next page, if this fails it is tried again after the
+     current page has been processed */
+  if (has_more_pages(search) && (do_try_search(search) != LDAP_SUCCESS))
+    log_log(LOG_DEBUG, "myldap_get_entry(): requesting next page failed");
+  /* return the messages of the page from the start */
+  search->pagepos = 0;
+  return LDAP_SUCCESS;
+}
+
+MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
+{
+  int rc;
+  struct timeval tv, *tvp;
   /* check parameters */
   if ((search == NULL) || (search->session == NULL) || (search->session->ld == NULL))
   {
@@ -1585,14 +2052,88 @@ MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
   while (1)
   {
     /* free the previous message if there was any */
-    if (search->msg != NULL)
+    myldap_search_msgfree(search);
+    /* free the page that was read ahead if all messages were processed */
+    if ((search->pagenum > 0) && (search->pagepos >= search->pagenum))
+      myldap_search_pagefree(search);
+    /* check whether the search is done or the next page should be
+       requested */
+    if ((search->pagenum == 0) && (search->msgid == -1))
     {
-      ldap_msgfree(search->msg);
-      search->msg = NULL;
+      if (!has_more_pages(search))
+      {
+        if (search->count > MAX_DEBUG_LOG_DNS)
+          log_log(LOG_DEBUG, "ldap_result(): ... %d more results",
+                  search->count - MAX_DEBUG_LOG_DNS);
+        log_log(LOG_DEBUG, "ldap_result(): end of results (%d total)",
+                search->count);
+        /* we are at the end of the search, no more results */
+        myldap_search_close(search);
+        if (rcp != NULL)
+          *rcp = LDAP_SUCCESS;
+        return NULL;
+      }
+      /* try the next page */
+      rc = do_try_search(search);
+      if (rc != LDAP_SUCCESS)
+      {
+        /* close connection on connection problems */
+        if ((rc == LDAP_UNAVAILABLE) || (rc == LDAP_SERVER_DOWN))
+          do_close(search->session);
+        myldap_search_close(search);
+        if (rcp != NULL)
+          *rcp = rc;
+        return NULL;
+      }
     }
     /* get the next result */
-    rc = ldap_result(search->session->ld, search->msgid, LDAP_MSG_ONE, tvp,
-                     &(search->msg));
+    if (search->pagepos >= 0)
+    {
+      /* take the next message from the page that was read ahead */
+      search->msg = search->pagemsgs[search->pagepos++];
+      rc = ldap_msgtype(search->msg);
+      /* the search result was already handled when the page was read */
+      if (rc == LDAP_RES_SEARCH_RESULT)
+        continue;
+    }
+    else if (search->paged)
+    {
+      /* read the complete page so the next page can be requested, the
+         messages are read one at a time so the timelimit applies to every
+         message and not to the page as a whole */
+      rc = ldap_result(search->session->ld, search->msgid, LDAP_MSG_ONE, tvp,
+                       &(search->msg));
+      if (rc > 0)
+      {
+        /* update the last activity on the connection */
+        time(&(search->session->lastactivity));
+        if (myldap_search_pageadd(search, search->msg))
+          rc = LDAP_NO_MEMORY;
+        else
+        {
+          search->msg = NULL;
+          if (rc != LDAP_RES_SEARCH_RESULT)
+            continue;
+          rc = myldap_handle_page(search);
+        }
+        if (rc != LDAP_SUCCESS)
+        {
+          myldap_search_pagefree(search);
+          myldap_search_msgfree(search);
+          /* close connection on connection problems */
+          if ((rc == LDAP_UNAVAILABLE) || (rc == LDAP_SERVER_DOWN))
+            do_close(search->session);
+          myldap_search_close(search);
+          if (rcp != NULL)
+            *rcp = rc;
+          return NULL;
+        }
+        continue;
+      }
+    }
+    else
+      rc = ldap_result(search->session->ld, search->msgid, LDAP_MSG_ONE, tvp,
+                       &(search->msg));
     /* handle result */
     switch (rc)
     {
@@ -1610,78 +2151,9 @@ MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
         search->may_retry_search = 0;
         return search->entry;
       case LDAP_RES_SEARCH_RESULT:
-        /* we have a search result, parse it */
-        resultcontrols = NULL;
-        if (search->cookie != NULL)
-        {
-          ber_bvfree(search->cookie);
-          search->cookie = NULL;
-        }
-        /* NB: this frees search->msg */
-        parserc = ldap_parse_result(search->session->ld, search->msg, &rc,
-                                    NULL, NULL, NULL, &resultcontrols, 1);
+        /* we have a search result, parse it (this frees search->msg) */
+        rc = myldap_parse_search_result(search, search->msg, 1);
         search->msg = NULL;
-        /* check for errors during parsing */
-        if ((parserc != LDAP_SUCCESS) && (parserc != LDAP_MORE_RESULTS_TO_RETURN))
-        {
-          if (resultcontrols != NULL)
-            ldap_controls_free(resultcontrols);
-          myldap_err(LOG_ERR, search->session->ld, parserc, "ldap_parse_result() failed");
-          myldap_search_close(search);
-          if (rcp != NULL)
-            *rcp = parserc;
-          return NULL;
-        }
-        /* check for errors in message */
-        if ((rc != LDAP_SUCCESS) && (rc != LDAP_MORE_RESULTS_TO_RETURN))
-        {
-          if (resultcontrols != NULL)
-            ldap_controls_free(resultcontrols);
-          myldap_err(LOG_ERR, search->session->ld, rc, "ldap_result() failed");
-          /* close connection on connection problems */
-          if ((rc == LDAP_UNAVAILABLE) || (rc == LDAP_SERVER_DOWN))
-            do_close(search->session);
-          myldap_search_close(search);
-          if (rcp != NULL)
-            *rcp = rc;
-          return NULL;
-        }
-        /* handle result controls */
-        if (resultcontrols != NULL)
-        {
-          /* see if there are any more pages to come */
-          rc = ldap_parse_page_control(search->session->ld, resultcontrols,
-                                       &count, &(search->cookie));
-          if (rc != LDAP_SUCCESS)
-          {
-            if (rc != LDAP_CONTROL_NOT_FOUND)
-              myldap_err(LOG_WARNING, search->session->ld, rc, "ldap_parse_page_control() failed");
-            /* clear error flag */
-            rc = LDAP_SUCCESS;
-            if (ldap_set_option(search->session->ld, LDAP_OPT_ERROR_NUMBER,
-                                &rc) != LDAP_SUCCESS)
-              log_log(LOG_WARNING, "failed to clear the error flag");
-          }
-          /* TODO: handle the above return code?? */
-          ldap_controls_free(resultcontrols);
-        }
-        search->msgid = -1;
-        /* check if there are more pages to come */
-        if ((search->cookie == NULL) || (search->cookie->bv_len == 0))
-        {
-          if (search->count > MAX_DEBUG_LOG_DNS)
-            log_log(LOG_DEBUG, "ldap_result(): ... %d more results",
-                    search->count - MAX_DEBUG_LOG_DNS);
-          log_log(LOG_DEBUG, "ldap_result(): end of results (%d total)",
-                  search->count);
-          /* we are at the end of the search, no more results */
-          myldap_search_close(search);
-          if (rcp != NULL)
-            *rcp = LDAP_SUCCESS;
-          return NULL;
-        }
-        /* try the next page */
-        rc = do_try_search(search);
         if (rc != LDAP_SUCCESS)
         {
           /* close connection on connection problems */
@@ -1692,7 +2164,7 @@ MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
             *rcp = rc;
           return NULL;
         }
-        /* we continue with another pass */
+        /* we continue with the next page or end the search */
         break;
       case LDAP_RES_SEARCH_REFERENCE:
         break; /* just ignore search references */
@@ -1792,282 +2264,495 @@ char *myldap_cpy_dn(MYLDAP_ENTRY *entry, char *buf, size_t buflen)
   return buf;
 }
 
+/* The maximum number of ranged retrieval searches that are started ahead
+   of the results that are being processed. */
+#define MAX_RANGED_SEARCHES 3
+
+/* Find the values of the ranged attribute in the entry (e.g. the values of
+   member;range=1500-2999 when looking for member). The start and end of the
+   range are returned in lowp and highp (-1 for the last range). */
+static char **myldap_get_range(MYLDAP_ENTRY *entry, const char *attr,
+                               int *lowp, int *highp)
+{
+  char **values = NULL;
+  char *attn;
+  char *tmp;
+  BerElement *ber = NULL;
+  size_t l = strlen(attr);
+  attn = ldap_first_attribute(entry->search->session->ld, entry->search->msg, &ber);
+  while (attn != NULL)
+  {
+    if ((strncasecmp(attn, attr, l) == 0) &&
+        (strncasecmp(attn + l, ";range=", 7) == 0))
+    {
+      log_log(LOG_DEBUG, "found ranged results %s", attn);
+      *lowp = (int)strtol(attn + l + 7, &tmp, 10);
+      *highp = (*tmp == '-') ? (int)strtol(tmp + 1, &tmp, 10) : -1;
+      if (*tmp == '*')
+        *highp = -1;
+      values = ldap_get_values(entry->search->session->ld, entry->search->msg, attn);
+      ldap_memfree(attn);
+      break;
+    }
+    /* free old attribute name and get next one */
+    ldap_memfree(attn);
+    attn = ldap_next_attribute(entry->search->session->ld, entry->search->msg, ber);
+  }
+  ber_free(ber, 0);
+  if ((values != NULL) && (*values == NULL))
+  {
+    ldap_value_free(values);
+    values = NULL;
+  }
+  return values;
+}
+
+/* Start a base search for the specified range of the attribute. */
+static MYLDAP_SEARCH *myldap_search_range(MYLDAP_SESSION *session,
+                                          const char *dn, const char *attr,
+                                          int low, int high)
+{
+  char attbuf[80];
+  const char *attrs[2];
+  if (mysnprintf(attbuf, sizeof(attbuf), "%s;range=%d-%d", attr, low, high))
+  {
+    log_log(LOG_ERR, "myldap_get_ranged_values(): attbuf buffer too small");
+    return NULL;
+  }
+  attrs[0] = attbuf;
+  attrs[1] = NULL;
+  return myldap_search(session, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attrs, NULL);
+}
+
 /* Perform ranged retrieval of attributes.
    http://msdn.microsoft.com/en-us/library/aa367017(vs.85).aspx
-   http://www.tkk.fi/cc/docs/kerberos/draft-kashi-incremental-00.txt */
+   http://www.tkk.fi/cc/docs/kerberos/draft-kashi-incremental-00.txt
+   The size of the first range returned by the server is used to request
+   the following ranges, a few of which are requested at the same time.
+   The returned values are kept until the end and copied into a single
+   buffer that can be freed with free(), the attribute name is stored
+   after the list of values. */
 static char **myldap_get_ranged_values(MYLDAP_ENTRY *entry, const char *attr)
 {
   char **values;
-  char *attn;
-  const char *attrs[2];
-  BerElement *ber;
-  int i;
-  int startat = 0, nxt = 0;
-  char attbuf[80];
+  char ***chunks = NULL, ***tmpchunks;
+  int numchunks = 0, maxchunks = 0;
+  MYLDAP_SEARCH *searches[MAX_RANGED_SEARCHES];
+  int starts[MAX_RANGED_SEARCHES];
+  int numsearches = 0, maxsearches;
+  int low, high, size, next;
+  int i, j, num = 0;
+  size_t sz = 0;
+  char *buf;
   const char *dn = myldap_get_dn(entry);
   MYLDAP_SESSION *session = entry->search->session;
-  MYLDAP_SEARCH *search = NULL;
-  SET *set = NULL;
-  /* build the attribute name to find */
-  if (mysnprintf(attbuf, sizeof(attbuf), "%s;range=0-*", attr))
-  {
-    log_log(LOG_ERR, "myldap_get_ranged_values(): attbuf buffer too small (%lu required)",
-            (unsigned long) strlen(attr) + 10);
-    return NULL;
-  }
-  /* keep doing lookups untul we can't get any more results */
-  while (1)
-  {
-    /* go over all attributes to find the ranged attribute */
-    ber = NULL;
-    attn = ldap_first_attribute(entry->search->session->ld, entry->search->msg, &ber);
-    values = NULL;
-    while (attn != NULL)
+  /* the entry should have the first range */
+  values = myldap_get_range(entry, attr, &low, &high);
+  size = high - low + 1;
+  next = high + 1;
+  /* leave room for other searches that the caller may do */
+  maxsearches = myldap_search_slots(session) - 1;
+  if (maxsearches > MAX_RANGED_SEARCHES)
+    maxsearches = MAX_RANGED_SEARCHES;
+  if (maxsearches < 1)
+    maxsearches = 1;
+  while (values != NULL)
+  {
+    /* keep the values */
+    if (numchunks >= maxchunks)
     {
-      if (strncasecmp(attn, attbuf, strlen(attbuf) - 1) == 0)
+      maxchunks = (maxchunks == 0) ? 16 : maxchunks * 2;
+      tmpchunks = (char ***)realloc(chunks, maxchunks * sizeof(char **));
+      if (tmpchunks == NULL)
       {
-        log_log(LOG_DEBUG, "found ranged results %s", attn);
-        nxt = atoi(attn + strlen(attbuf) - 1) + 1;
-        values = ldap_get_values(entry->search->session->ld, entry->search->msg, attn);
-        ldap_memfree(attn);
+        log_log(LOG_CRIT, "myldap_get_ranged_values(): realloc() failed to allocate memory");
+        ldap_value_free(values);
         break;
       }
-      /* free old attribute name and get next one */
-      ldap_memfree(attn);
-      attn = ldap_next_attribute(entry->search->session->ld, entry->search->msg, ber);
+      chunks = tmpchunks;
     }
-    ber_free(ber, 0);
-    /* see if we found any values */
-    if ((values == NULL) || (*values == NULL))
+    chunks[numchunks++] = values;
+    values = NULL;
+    /* the last range was returned or the server did not tell */
+    if ((high < 0) || (size <= 0))
+      break;
+    /* if the server returned a smaller range than we asked for the
+       outstanding searches are for the wrong ranges */
+    if ((numsearches > 0) && (high + 1 != starts[0]))
+    {
+      for (i = 0; i < numsearches; i++)
+        myldap_search_close(searches[i]);
+      numsearches = 0;
+      size = high - low + 1;
+      next = high + 1;
+    }
+    /* start searches for the next ranges */
+    while (numsearches < maxsearches)
+    {
+      searches[numsearches] = myldap_search_range(session, dn, attr,
+                                                  next, next + size - 1);
+      if (searches[numsearches] == NULL)
+        break;
+      starts[numsearches++] = next;
+      next += size;
+    }
+    if (numsearches == 0)
       break;
-    /* allocate memory */
-    if (set == NULL)
+    /* get the results of the oldest search (if no entry is returned
+       myldap_get_entry() already closed the search) */
+    entry = myldap_get_entry(searches[0], NULL);
+    if (entry != NULL)
     {
-      set = set_new();
-      if (set == NULL)
+      values = myldap_get_range(entry, attr, &low, &high);
+      if ((values != NULL) && (low != starts[0]))
       {
+        log_log(LOG_WARNING, "%s: %s: unexpected range returned", dn, attr);
         ldap_value_free(values);
-        log_log(LOG_CRIT, "myldap_get_ranged_values(): set_new() failed to allocate memory");
-        return NULL;
+        values = NULL;
       }
+      myldap_search_close(searches[0]);
     }
-    /* add to the set */
-    for (i = 0; values[i] != NULL; i++)
-      set_add(set, values[i]);
-    /* free results */
-    ldap_value_free(values);
-    /* check if we should start a new search */
-    if (nxt <= startat)
-      break;
-    startat = nxt;
-    /* build attributes for a new search */
-    if (mysnprintf(attbuf, sizeof(attbuf), "%s;range=%d-*", attr, startat))
+    for (i = 1; i < numsearches; i++)
     {
-      log_log(LOG_ERR, "myldap_get_ranged_values(): attbuf buffer too small");
-      break;
+      searches[i - 1] = searches[i];
+      starts[i - 1] = starts[i];
     }
-    attrs[0] = attbuf;
-    attrs[1] = NULL;
-    /* close the previous search, if any */
-    if (search != NULL)
-      myldap_search_close(search);
-    /* start the new search */
-    search = myldap_search(session, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attrs, NULL);
-    if (search == NULL)
-      break;
-    entry = myldap_get_entry(search, NULL);
-    if (entry == NULL)
-      break;
+    numsearches--;
   }
   /* close any started searches */
-  if (search != NULL)
-    myldap_search_close(search);
-  /* return the contents of the set as a list */
-  if (set == NULL)
+  for (i = 0; i < numsearches; i++)
+    myldap_search_close(searches[i]);
+  if (numchunks == 0)
+  {
+    if (chunks != NULL)
+      free(chunks);
     return NULL;
-  values = (char **)set_tolist(set);
-  set_free(set);
+  }
+  /* copy the attribute name and the values into a single buffer */
+  sz = strlen(attr) + 1;
+  for (i = 0; i < numchunks; i++)
+    for (j = 0; chunks[i][j] != NULL; j++)
+    {
+      num++;
+      sz += strlen(chunks[i][j]) + 1;
+    }
+  values = (char **)malloc((num + 1) * sizeof(char *) + sz);
   if (values == NULL)
     log_log(LOG_CRIT, "myldap_get_ranged_values(): malloc() failed to allocate memory");
+  else
+  {
+    /* the name follows the list of values */
+    buf = (char *)(values + num + 1);
+    strcpy(buf, attr);
+    buf += strlen(attr) + 1;
+    num = 0;
+    for (i = 0; i < numchunks; i++)
+      for (j = 0; chunks[i][j] != NULL; j++)
+      {
+        sz = strlen(chunks[i][j]) + 1;
+        memcpy(buf, chunks[i][j], sz);
+        values[num++] = buf;
+        buf += sz;
+      }
+    values[num] = NULL;
+  }
+  for (i = 0; i < numchunks; i++)
+    ldap_value_free(chunks[i]);
+  free(chunks);
   return values;
 }
 
-/* Simple wrapper around ldap_get_values(). */
-const char **myldap_get_values(MYLDAP_ENTRY *entry, const char *attr)
+/* Compute a case-insensitive hash of the attribute name. */
+static uint32_t attrhash(const char *name, size_t len)
+{
+  uint32_t hash = 5381;
+  size_t i;
+  for (i = 0; i < len; i++)
+    hash = 33 * hash + (uint8_t)tolower((unsigned char)name[i]);
+  return hash;
+}
+
+/* Add the values to the index of the entry. The values and the name
+   should be stored in memory that is released together with the entry. */
+static int myldap_entry_insert(MYLDAP_ENTRY *entry, const char *name,
+                               char **values)
 {
+  struct myldap_attr *newattrs;
+  int newmax, i, j;
+  uint32_t hash;
+  /* keep the index at most half full */
+  if ((entry->numattrs + 1) * 2 > entry->maxattrs)
+  {
+    newmax = (entry->maxattrs == 0) ? 32 : entry->maxattrs * 2;
+    newattrs = (struct myldap_attr *)calloc(newmax, sizeof(struct myldap_attr));
+    if (newattrs == NULL)
+    {
+      log_log(LOG_CRIT, "myldap_entry_insert(): calloc() failed to allocate memory");
+      return -1;
+    }
+    for (i = 0; i < entry->maxattrs; i++)
+    {
+      if (entry->attrs[i].name == NULL)
+        continue;
+      for (j = entry->attrs[i].hash & (newmax - 1); newattrs[j].name != NULL;
+           j = (j + 1) & (newmax - 1))
+        /* nothing */ ;
+      newattrs[j] = entry->attrs[i];
+    }
+    if (entry->attrs != NULL)
+      free(entry->attrs);
+    entry->attrs = newattrs;
+    entry->maxattrs = newmax;
+  }
+  /* find a free slot */
+  hash = attrhash(name, strlen(name));
+  for (i = hash & (entry->maxattrs - 1); entry->attrs[i].name != NULL;
+       i = (i + 1) & (entry->maxattrs - 1))
+    /* nothing */ ;
+  entry->attrs[i].name = name;
+  entry->attrs[i].hash = hash;
+  entry->attrs[i].values = values;
+  entry->numattrs++;
+  return 0;
+}
+
+/* Copy the attribute name and values into a single block of memory from
+   the entry's chunks and add it to the index of the entry. Either bvals (an array terminated by
+   an entry without value) or bvalues (a NULL terminated list) should be
+   set. */
+static void myldap_entry_addattr(MYLDAP_ENTRY *entry, const char *name,
+                                 size_t namelen, struct berval *bvals,
+                                 struct berval **bvalues)
+{
+  struct berval *bv;
+  int num, i;
+  size_t sz;
+  char *buf;
   char **values;
-  int rc;
-  int i;
-  /* check parameters */
-  if (!is_valid_entry(entry))
-  {
-    log_log(LOG_ERR, "myldap_get_values(): invalid result entry passed");
-    errno = EINVAL;
-    return NULL;
-  }
-  else if (attr == NULL)
+  /* figure out how much memory to allocate */
+  sz = namelen + 1;
+  for (num = 0; ; num++)
   {
-    log_log(LOG_ERR, "myldap_get_values(): invalid attribute name passed");
-    errno = EINVAL;
-    return NULL;
+    bv = (bvals != NULL) ? &bvals[num] : bvalues[num];
+    if ((bv == NULL) || (bv->bv_val == NULL))
+      break;
+    sz += bv->bv_len + 1;
   }
-  if (!entry->search->valid)
-    return NULL; /* search has been stopped */
-  /* get from LDAP */
-  values = ldap_get_values(entry->search->session->ld, entry->search->msg, attr);
+  sz += (num + 1) * sizeof(char *);
+  values = (char **)myldap_entry_alloc(entry, sz);
   if (values == NULL)
-  {
-    if (ldap_get_option(entry->search->session->ld, LDAP_OPT_ERROR_NUMBER, &rc) != LDAP_SUCCESS)
-      rc = LDAP_UNAVAILABLE;
-    /* ignore decoding errors as they are just non-existing attribute values */
-    if (rc == LDAP_DECODING_ERROR)
+    return;
+  /* the name follows the list of values */
+  buf = (char *)(values + num + 1);
+  memcpy(buf, name, namelen);
+  buf[namelen] = '\0';
+  buf += namelen + 1;
+  /* copy the values */
+  for (i = 0; i < num; i++)
+  {
+    bv = (bvals != NULL) ? &bvals[i] : bvalues[i];
+    values[i] = buf;
+    memcpy(buf, bv->bv_val, bv->bv_len);
+    buf[bv->bv_len] = '\0';
+    buf += bv->bv_len + 1;
+  }
+  values[num] = NULL;
+  (void)myldap_entry_insert(entry, (const char *)(values + num + 1), values);
+}
+
+/* Decode all attributes of the entry into the index, this is done once
+   for each entry on the first lookup of a value. */
+static void myldap_entry_decode(MYLDAP_ENTRY *entry)
+{
+  LDAP *ld = entry->search->session->ld;
+  BerElement *ber = NULL;
+#ifdef USE_BER_VALUES
+  struct berval bv;
+  struct berval *bvals;
+  int rc;
+#else /* not USE_BER_VALUES */
+  char *attn;
+  struct berval **bvalues;
+#endif /* not USE_BER_VALUES */
+  entry->decoded = 1;
+  entry->decoderc = LDAP_SUCCESS;
+#ifdef USE_BER_VALUES
+  /* the values are referenced in the message and copied only once */
+  rc = ldap_get_dn_ber(ld, entry->search->msg, &ber, &bv);
+  while (rc == LDAP_SUCCESS)
+  {
+    bvals = NULL;
+    rc = ldap_get_attribute_ber(ld, entry->search->msg, ber, &bv, &bvals);
+    if ((rc != LDAP_SUCCESS) || (bv.bv_val == NULL))
     {
-      rc = LDAP_SUCCESS;
-      if (ldap_set_option(entry->search->session->ld, LDAP_OPT_ERROR_NUMBER, &rc) != LDAP_SUCCESS)
-        log_log(LOG_WARNING, "failed to clear the error flag");
+      if (bvals != NULL)
+        ber_memfree(bvals);
+      break;
     }
-    else if (rc == LDAP_SUCCESS)
+    if (memchr(bv.bv_val, ';', bv.bv_len) != NULL)
+      entry->hasoptions = 1;
+    if (bvals != NULL)
     {
-      /* we have a success code but no values, let's try to get ranged
-         values */
-      values = myldap_get_ranged_values(entry, attr);
-      if (values == NULL)
-        return NULL;
-      /* store values entry so we can free it later on */
-      for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
-        if (entry->buffers[i] == NULL)
-        {
-          entry->buffers[i] = values;
-          return (const char **)entry->buffers[i];
-        }
-      /* we found no room to store the values */
-      log_log(LOG_ERR, "ldap_get_values() couldn't store results, increase MAX_BUFFERS_PER_ENTRY");
-      free(values);
-      return NULL;
+      myldap_entry_addattr(entry, bv.bv_val, bv.bv_len, bvals, NULL);
+      ber_memfree(bvals);
     }
-    else
-      myldap_err(LOG_WARNING, entry->search->session->ld, rc,
-                 "ldap_get_values() of attribute \"%s\" on entry \"%s\" returned NULL",
-                 attr, myldap_get_dn(entry));
-    return NULL;
   }
-  /* store values entry so we can free it later on */
-  for (i = 0; i < MAX_ATTRIBUTES_PER_ENTRY; i++)
-    if (entry->attributevalues[i] == NULL)
+  entry->decoderc = rc;
+#else /* not USE_BER_VALUES */
+  for (attn = ldap_first_attribute(ld, entry->search->msg, &ber);
+       attn != NULL; attn = ldap_next_attribute(ld, entry->search->msg, ber))
+  {
+    if (strchr(attn, ';') != NULL)
+      entry->hasoptions = 1;
+    bvalues = ldap_get_values_len(ld, entry->search->msg, attn);
+    if (bvalues != NULL)
     {
-      entry->attributevalues[i] = values;
-      return (const char **)values;
+      myldap_entry_addattr(entry, attn, strlen(attn), NULL, bvalues);
+      ldap_value_free_len(bvalues);
     }
-  /* we found no room to store the entry */
-  log_log(LOG_ERR, "ldap_get_values() couldn't store results, increase MAX_ATTRIBUTES_PER_ENTRY");
-  ldap_value_free(values);
+    ldap_memfree(attn);
+  }
+#endif /* not USE_BER_VALUES */
+  if (ber != NULL)
+    ber_free(ber, 0);
+  if (entry->decoderc != LDAP_SUCCESS)
+    myldap_err(LOG_WARNING, ld, entry->decoderc,
+               "decoding attributes of entry \"%s\" failed",
+               myldap_get_dn(entry));
+}
+
+/* Look up the values of the attribute in the index of the entry. */
+static const char **myldap_entry_getattr(MYLDAP_ENTRY *entry,
+                                         const char *attr)
+{
+  uint32_t hash;
+  int i;
+  if (entry->maxattrs == 0)
+    return NULL;
+  hash = attrhash(attr, strlen(attr));
+  for (i = hash & (entry->maxattrs - 1); entry->attrs[i].name != NULL;
+       i = (i + 1) & (entry->maxattrs - 1))
+    if ((entry->attrs[i].hash == hash) &&
+        (strcasecmp(entry->attrs[i].name, attr) == 0))
+      return (const char **)entry->attrs[i].values;
   return NULL;
 }
 
-/* Convert the bervalues to a simple list of strings that can be freed
-   with one call to free(). */
-static const char **bervalues_to_values(struct berval **bvalues)
+/* Return the values of the attribute from the index of the entry,
+   performing ranged retrieval if the attribute was returned in parts. */
+static const char **myldap_entry_values(MYLDAP_ENTRY *entry, const char *attr,
+                                        const char *func)
 {
-  int num_values;
+  const char **values;
+  char **ranged;
   int i;
-  size_t sz;
-  char *buf;
-  char **values;
-  /* figure out how much memory to allocate */
-  num_values = ldap_count_values_len(bvalues);
-  sz = (num_values + 1) * sizeof(char *);
-  for (i = 0; i < num_values; i++)
-    sz += bvalues[i]->bv_len + 1;
-  /* allocate the needed memory */
-  values = (char **)malloc(sz);
-  if (values == NULL)
+  /* check parameters */
+  if (!is_valid_entry(entry))
+  {
+    log_log(LOG_ERR, "%s(): invalid result entry passed", func);
+    errno = EINVAL;
+    return NULL;
+  }
+  else if (attr == NULL)
   {
-    log_log(LOG_CRIT, "bervalues_to_values(): malloc() failed to allocate memory");
+    log_log(LOG_ERR, "%s(): invalid attribute name passed", func);
+    errno = EINVAL;
     return NULL;
   }
-  buf = (char *)values;
-  buf += (num_values + 1) * sizeof(char *);
-  /* copy from bvalues */
-  for (i = 0; i < num_values; i++)
+  if (!entry->search->valid)
+    return NULL; /* search has been stopped */
+  /* parse the entry on first use */
+  if (!entry->decoded)
+    myldap_entry_decode(entry);
+  values = myldap_entry_getattr(entry, attr);
+  if ((values != NULL) || (!entry->hasoptions) ||
+      (entry->decoderc != LDAP_SUCCESS))
+    return values;
+  /* the attribute may have been returned in ranges */
+  ranged = myldap_get_ranged_values(entry, attr);
+  if (ranged == NULL)
+    return NULL;
+  /* store the combined values in the index (the name follows the list) */
+  if (myldap_entry_keep(entry, ranged))
   {
-    values[i] = buf;
-    memcpy(values[i], bvalues[i]->bv_val, bvalues[i]->bv_len);
-    values[i][bvalues[i]->bv_len] = '\0';
-    buf += bvalues[i]->bv_len + 1;
+    free(ranged);
+    return NULL;
   }
-  values[i] = NULL;
-  return (const char **)values;
+  for (i = 0; ranged[i] != NULL; i++)
+    /* nothing */ ;
+  if (myldap_entry_insert(entry, (const char *)(ranged + i + 1), ranged))
+    return NULL;
+  return (const char **)ranged;
 }
 
 /* Simple wrapper around ldap_get_values(). */
+const char **myldap_get_values(MYLDAP_ENTRY *entry, const char *attr)
+{
+  return myldap_entry_values(entry, attr, "myldap_get_values");
+}
+
+/* Simple wrapper around ldap_get_values_len(). */
 const char **myldap_get_values_len(MYLDAP_ENTRY *entry, const char *attr)
 {
-  const char **values;
+  return myldap_entry_values(entry, attr, "myldap_get_values_len");
+}
+
+/* Like myldap_get_values_len() but also returns the lengths of the values.
+   The values are read from the message directly because the index does not
+   keep the lengths (binary values may contain NUL bytes). */
+const char **myldap_get_binvalues(MYLDAP_ENTRY *entry, const char *attr,
+                                  const size_t **lens)
+{
   struct berval **bvalues;
-  int rc;
-  int i;
+  char **values;
+  size_t *sizes;
+  char *buf;
+  size_t sz;
+  int num, i;
   /* check parameters */
   if (!is_valid_entry(entry))
   {
-    log_log(LOG_ERR, "myldap_get_values_len(): invalid result entry passed");
+    log_log(LOG_ERR, "myldap_get_binvalues(): invalid result entry passed");
     errno = EINVAL;
     return NULL;
   }
-  else if (attr == NULL)
+  else if ((attr == NULL) || (lens == NULL))
   {
-    log_log(LOG_ERR, "myldap_get_values_len(): invalid attribute name passed");
+    log_log(LOG_ERR, "myldap_get_binvalues(): invalid parameter passed");
     errno = EINVAL;
     return NULL;
   }
   if (!entry->search->valid)
     return NULL; /* search has been stopped */
-  /* get from LDAP */
-  bvalues = ldap_get_values_len(entry->search->session->ld, entry->search->msg, attr);
+  bvalues = ldap_get_values_len(entry->search->session->ld,
+                                entry->search->msg, attr);
   if (bvalues == NULL)
+    return NULL;
+  /* copy the values and lengths into a single block owned by the entry */
+  sz = 0;
+  for (num = 0; bvalues[num] != NULL; num++)
+    sz += bvalues[num]->bv_len + 1;
+  sz += (num + 1) * sizeof(char *) + num * sizeof(size_t);
+  values = (char **)myldap_entry_alloc(entry, sz);
+  if (values == NULL)
   {
-    if (ldap_get_option(entry->search->session->ld, LDAP_OPT_ERROR_NUMBER, &rc) != LDAP_SUCCESS)
-      rc = LDAP_UNAVAILABLE;
-    /* ignore decoding errors as they are just non-existing attribute values */
-    if (rc == LDAP_DECODING_ERROR)
-    {
-      rc = LDAP_SUCCESS;
-      if (ldap_set_option(entry->search->session->ld, LDAP_OPT_ERROR_NUMBER, &rc) != LDAP_SUCCESS)
-        log_log(LOG_WARNING, "failed to clear the error flag");
-      return NULL;
-    }
-    else if (rc == LDAP_SUCCESS)
-    {
-      /* we have a success code but no values, let's try to get ranged
-         values */
-      values = (const char **)myldap_get_ranged_values(entry, attr);
-    }
-    else
-    {
-      myldap_err(LOG_WARNING, entry->search->session->ld, rc,
-                 "myldap_get_values_len() of attribute \"%s\" on entry \"%s\" returned NULL",
-                 attr, myldap_get_dn(entry));
-      return NULL;
-    }
+    ldap_value_free_len(bvalues);
+    return NULL;
   }
-  else
+  sizes = (size_t *)(values + num + 1);
+  buf = (char *)(sizes + num);
+  for (i = 0; i < num; i++)
   {
-    values = bervalues_to_values(bvalues);
-    ldap_value_free_len(bvalues);
+    values[i] = buf;
+    sizes[i] = bvalues[i]->bv_len;
+    memcpy(buf, bvalues[i]->bv_val, bvalues[i]->bv_len);
+    buf[bvalues[i]->bv_len] = '\0';
+    buf += bvalues[i]->bv_len + 1;
   }
-  /* check if we got allocated memory */
-  if (values == NULL)
-    return NULL;
-  /* store values entry so we can free it later on */
-  for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
-    if (entry->buffers[i] == NULL)
-    {
-      entry->buffers[i] = (char **)values;
-      return values;
-    }
-  /* we found no room to store the values */
-  log_log(LOG_ERR, "myldap_get_values_len() couldn't store results, increase MAX_BUFFERS_PER_ENTRY");
-  free(values);
-  return NULL;
+  values[num] = NULL;
+  ldap_value_free_len(bvalues);
+  *lens = sizes;
+  return (const char **)values;
 }
 
 /* Go over the entries in exploded_rdn and see if any start with
@@ -2340,17 +3025,12 @@ const char ***myldap_get_deref_values(MYLDAP_ENTRY *entry,
   ldap_derefresponse_free(deref);
   ldap_controls_free(entryctrls);
   /* store results so we can free it later on */
-  for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
-    if (entry->buffers[i] == NULL)
-    {
-      entry->buffers[i] = (void *)results;
-      return (const char ***)results;
-    }
-  /* we found no room to store the values */
-  log_log(LOG_ERR, "myldap_get_deref_values() couldn't store results, "
-          "increase MAX_BUFFERS_PER_ENTRY");
-  free(results);
-  return NULL;
+  if (myldap_entry_keep(entry, results))
+  {
+    free(results);
+    return NULL;
+  }
+  return (const char ***)results;
 }
 #else /* not HAVE_LDAP_PARSE_DEREF_CONTROL */
 const char ***myldap_get_deref_values(MYLDAP_ENTRY UNUSED(*entry),
@@ -2360,43 +3040,45 @@ const char ***myldap_get_deref_values(MYLDAP_ENTRY UNUSED(*entry),
 }
 #endif /* not HAVE_LDAP_PARSE_DEREF_CONTROL */
 
-int myldap_escape(const char *src, char *buffer, size_t buflen)
+/* the hexadecimal digits used for escaping */
+static const char myldap_hexdigits[] = "0123456789abcdef";
+
+int myldap_escape_len(const char *src, char *buffer, size_t buflen)
 {
   size_t pos = 0;
-  /* go over all characters in source string */
-  for (; *src != '\0'; src++)
+  size_t len;
+  while (1)
   {
-    /* check if char will fit */
-    if ((pos + 4) >= buflen)
-      return -1;
-    /* do escaping for some characters */
-    switch (*src)
+    /* find the run of characters that can be copied as-is, strcspn() and
+       memcpy() are usually optimised for the CPU by the C library */
+    len = strcspn(src, "*()\\");
+    if (len > 0)
     {
-      case '*':
-        strcpy(buffer + pos, "\\2a");
-        pos += 3;
-        break;
-      case '(':
-        strcpy(buffer + pos, "\\28");
-        pos += 3;
-        break;
-      case ')':
-        strcpy(buffer + pos, "\\29");
-        pos += 3;
-        break;
-      case '\\':
-        strcpy(buffer + pos, "\\5c");
-        pos += 3;
-        break;
-      default:
-        /* just copy character */
-        buffer[pos++] = *src;
-        break;
+      /* check if the characters will fit */
+      if ((pos + len + 3) >= buflen)
+        return -1;
+      memcpy(buffer + pos, src, len);
+      pos += len;
+      src += len;
     }
+    if (*src == '\0')
+      break;
+    /* check if the escaped character will fit */
+    if ((pos + 4) >= buflen)
+      return -1;
+    buffer[pos++] = '\\';
+    buffer[pos++] = myldap_hexdigits[((unsigned char)*src) >> 4];
+    buffer[pos++] = myldap_hexdigits[((unsigned char)*src) & 0x0f];
+    src++;
   }
   /* terminate destination string */
   buffer[pos] = '\0';
-  return 0;
+  return (int)pos;
+}
+
+int myldap_escape(const char *src, char *buffer, size_t buflen)
+{
+  return (myldap_escape_len(src, buffer, buflen) < 0) ? -1 : 0;
 }
 
 int myldap_set_debuglevel(int level)
@@ -47,6 +47,11 @@
 #define LDAP_SCOPE_DEFAULT LDAP_SCOPE_SUBTREE
 #endif /* not LDAP_SCOPE_DEFAULT */
 
+/* Active Directory matching rule that walks the chain of ancestry */
+#ifndef LDAP_MATCHING_RULE_IN_CHAIN
+#define LDAP_MATCHING_RULE_IN_CHAIN "1.2.840.113556.1.4.1941"
+#endif /* not LDAP_MATCHING_RULE_IN_CHAIN */
+
 /* This a a generic session handle. */
 typedef struct ldap_session MYLDAP_SESSION;
 
@@ -75,6 +80,17 @@ MUST_USE int myldap_bind(MYLDAP_SESSION *session, const char *dn,
                          const char *password,
                          int *response, const char **message);
 
+/* Forget the credentials set with myldap_bind() and, if the connection is
+   still open, bind again using the configured credentials (or anonymously)
+   so the connection can be re-used. This returns an LDAP status code. */
+MUST_USE int myldap_reset_bind(MYLDAP_SESSION *session);
+
+/* Set whether binds done with myldap_bind() should switch the connection
+   to Active Directory fast bind mode where only the credentials are
+   verified. The connection cannot be used for searches as the bound user
+   in this mode. */
+void myldap_set_fastbind(MYLDAP_SESSION *session, int fastbind);
+
 /* Closes all pending searches and deallocates any memory that is allocated
    with these searches. This does not close the session. */
 void myldap_session_cleanup(MYLDAP_SESSION *session);
@@ -105,6 +121,10 @@ MUST_USE MYLDAP_SEARCH *myldap_search(MYLDAP_SESSION *session,
    for the search and its results. */
 void myldap_search_close(MYLDAP_SEARCH *search);
 
+/* Return the number of searches that can still be started on the session
+   while keeping the current searches open. */
+MUST_USE int myldap_search_slots(MYLDAP_SESSION *session);
+
 /* Get an entry from the result set, going over all results (returns NULL if
    no more entries are available). Note that any memory allocated to return
    information about the previous entry (e.g. with myldap_get_values()) is
@@ -128,6 +148,13 @@ MUST_USE const char **myldap_get_values(MYLDAP_ENTRY *entry, const char *attr);
    May return NULL or an empty array. */
 MUST_USE const char **myldap_get_values_len(MYLDAP_ENTRY *entry, const char *attr);
 
+/* Get the binary attribute values from a certain entry as a NULL terminated
+   list and store the lengths of the values in lens (the list of lengths is
+   freed together with the entry). May return NULL or an empty array. */
+MUST_USE const char **myldap_get_binvalues(MYLDAP_ENTRY *entry,
+                                           const char *attr,
+                                           const size_t **lens);
+
 /* Checks to see if the entry has the specified object class. */
 MUST_USE int myldap_has_objectclass(MYLDAP_ENTRY *entry, const char *objectclass);
 
@@ -154,6 +181,11 @@ MUST_USE const char *myldap_cpy_rdn_value(const char *dn, const char *attr,
 /* Escapes characters in a string for use in a search filter. */
 MUST_USE int myldap_escape(const char *src, char *buffer, size_t buflen);
 
+/* Escapes characters in a string for use in a search filter in the same
+   way as myldap_escape() but returns the length of the escaped string or
+   -1 if the buffer is too small. */
+MUST_USE int myldap_escape_len(const char *src, char *buffer, size_t buflen);
+
 /* Set the debug level globally. Returns an LDAP status code. */
 int myldap_set_debuglevel(int level);
 
@@ -0,0 +1,275 @@
+/*
+   negcache.c - cache of lookups that did not return any results
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "log.h"
+#include "cfg.h"
+#include "common/dict.h"
+#include "common/set.h"
+
+/* the file with the local users */
+#define PASSWD_FILE "/etc/passwd"
+
+/* the minimum time between two checks of the passwd file */
+#define PASSWD_CHECK_INTERVAL 10
+
+/* the maximum number of lookups to keep in the cache */
+#define NEGCACHE_MAX_ENTRIES 4096
+
+/* the maximum line length supported in the passwd file */
+#define MAX_LINE_LENGTH 4096
+
+/* the cache of lookups without results, keyed on action and search filter,
+   the value is the time the entry was added */
+static pthread_mutex_t negcache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *negcache = NULL;
+static int negcache_num = 0;
+
+/* the users from the passwd file, reloaded when the file changes */
+static pthread_mutex_t localusers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SET *localusers = NULL;
+static time_t localusers_mtime = 0;
+static time_t localusers_lastcheck = 0;
+
+/* remove all entries from the cache, negcache_mutex should be held */
+static void do_negcache_clear(void)
+{
+  const char **keys;
+  int i;
+  if (negcache == NULL)
+    return;
+  keys = dict_keys(negcache);
+  if (keys != NULL)
+  {
+    for (i = 0; keys[i] != NULL; i++)
+      free(dict_get(negcache, keys[i]));
+    free(keys);
+  }
+  dict_free(negcache);
+  negcache = NULL;
+  negcache_num = 0;
+}
+
+/* drop expired entries from the cache, negcache_mutex should be held */
+static void do_negcache_expire(time_t now)
+{
+  const char **keys;
+  DICT *newcache;
+  time_t *timestamp;
+  int i;
+  keys = dict_keys(negcache);
+  newcache = dict_new();
+  if ((keys == NULL) || (newcache == NULL))
+  {
+    if (keys != NULL)
+      free(keys);
+    if (newcache != NULL)
+      dict_free(newcache);
+    do_negcache_clear();
+    return;
+  }
+  negcache_num = 0;
+  for (i = 0; keys[i] != NULL; i++)
+  {
+    timestamp = dict_get(negcache, keys[i]);
+    if ((now < (*timestamp + nslcd_cfg->cache_notfound)) &&
+        (dict_put(newcache, keys[i], timestamp) == 0))
+      negcache_num++;
+    else
+      free(timestamp);
+  }
+  free(keys);
+  dict_free(negcache);
+  negcache = newcache;
+}
+
+void negcache_clear(void)
+{
+  pthread_mutex_lock(&negcache_mutex);
+  do_negcache_clear();
+  pthread_mutex_unlock(&negcache_mutex);
+}
+
+/* build the key for the lookup, returns NULL if the lookup should not be
+   cached (enumerations are excluded by the callers) */
+static char *negcache_key(int32_t action, const char *filter,
+                          char *buffer, size_t buflen)
+{
+  if (nslcd_cfg->cache_notfound == 0)
+    return NULL;
+  if (mysnprintf(buffer, buflen, "%08x%s", (unsigned int)action, filter))
+    return NULL;
+  return buffer;
+}
+
+int negcache_get(int32_t action, const char *filter)
+{
+  char buffer[BUFLEN_FILTER + 16];
+  const char *key;
+  time_t *timestamp;
+  int found = 0;
+  if ((key = negcache_key(action, filter, buffer, sizeof(buffer))) == NULL)
+    return 0;
+  /* the local users may have been changed */
+  localusers_check_reload();
+  pthread_mutex_lock(&negcache_mutex);
+  if ((negcache != NULL) && ((timestamp = dict_get(negcache, key)) != NULL))
+    found = (time(NULL) < (*timestamp + nslcd_cfg->cache_notfound));
+  pthread_mutex_unlock(&negcache_mutex);
+  return found;
+}
+
+void negcache_put(int32_t action, const char *filter)
+{
+  char buffer[BUFLEN_FILTER + 16];
+  const char *key;
+  time_t *timestamp;
+  time_t now;
+  if ((key = negcache_key(action, filter, buffer, sizeof(buffer))) == NULL)
+    return;
+  now = time(NULL);
+  pthread_mutex_lock(&negcache_mutex);
+  /* make room by dropping expired entries or start over */
+  if (negcache_num >= NEGCACHE_MAX_ENTRIES)
+    do_negcache_expire(now);
+  if (negcache_num >= NEGCACHE_MAX_ENTRIES)
+    do_negcache_clear();
+  if (negcache == NULL)
+    negcache = dict_new();
+  if (negcache != NULL)
+  {
+    timestamp = dict_get(negcache, key);
+    if (timestamp == NULL)
+    {
+      timestamp = (time_t *)malloc(sizeof(time_t));
+      if ((timestamp != NULL) && (dict_put(negcache, key, timestamp) != 0))
+      {
+        free(timestamp);
+        timestamp = NULL;
+      }
+      else if (timestamp != NULL)
+        negcache_num++;
+    }
+    if (timestamp != NULL)
+      *timestamp = now;
+  }
+  pthread_mutex_unlock(&negcache_mutex);
+}
+
+/* read the user names from the passwd file directly (going through NSS
+   could end up in nslcd itself), returns NULL on error */
+static SET *read_localusers(void)
+{
+  FILE *fp;
+  SET *users;
+  char line[MAX_LINE_LENGTH];
+  char *p;
+  fp = fopen(PASSWD_FILE, "r");
+  if (fp == NULL)
+  {
+    log_log(LOG_ERR, "cannot open %s: %s", PASSWD_FILE, strerror(errno));
+    return NULL;
+  }
+  users = set_new();
+  if (users == NULL)
+  {
+    log_log(LOG_CRIT, "read_localusers(): set_new() failed to allocate memory");
+    fclose(fp);
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    /* the user name is everything up to the first colon */
+    p = strchr(line, ':');
+    if ((p == NULL) || (p == line) || (line[0] == '+') || (line[0] == '-'))
+      continue;
+    *p = '\0';
+    set_add(users, line);
+  }
+  fclose(fp);
+  return users;
+}
+
+void localusers_check_reload(void)
+{
+  struct stat buf;
+  time_t t;
+  SET *users;
+  t = time(NULL);
+  pthread_mutex_lock(&localusers_mutex);
+  if (t < (localusers_lastcheck + PASSWD_CHECK_INTERVAL))
+  {
+    pthread_mutex_unlock(&localusers_mutex);
+    return;
+  }
+  localusers_lastcheck = t;
+  if (stat(PASSWD_FILE, &buf))
+  {
+    log_log(LOG_ERR, "stat(%s) failed: %s", PASSWD_FILE, strerror(errno));
+    pthread_mutex_unlock(&localusers_mutex);
+    return;
+  }
+  /* nothing to do if the file did not change */
+  if (buf.st_mtime == localusers_mtime)
+  {
+    pthread_mutex_unlock(&localusers_mutex);
+    return;
+  }
+  /* the first time the file is seen nothing was learned yet */
+  if (localusers_mtime != 0)
+  {
+    log_log(LOG_DEBUG, "%s changed, clearing negative cache", PASSWD_FILE);
+    /* accounts may have moved between the passwd file and LDAP */
+    negcache_clear();
+  }
+  localusers_mtime = buf.st_mtime;
+  /* reload the list of local users if it is used */
+  if (nslcd_cfg->nss_initgroups_ignorealllocal)
+  {
+    users = read_localusers();
+    if (users != NULL)
+    {
+      if (localusers != NULL)
+        set_free(localusers);
+      localusers = users;
+    }
+  }
+  pthread_mutex_unlock(&localusers_mutex);
+}
+
+int localusers_contains(const char *name)
+{
+  int found = 0;
+  localusers_check_reload();
+  pthread_mutex_lock(&localusers_mutex);
+  if (localusers != NULL)
+    found = set_contains(localusers, name);
+  pthread_mutex_unlock(&localusers_mutex);
+  return found;
+}
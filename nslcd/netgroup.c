@@ -62,19 +62,14 @@ const char *attmap_netgroup_memberNisNetgroup = "memberNisNetgroup";
 /* the attribute list to request with searches */
 static const char *netgroup_attrs[4];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE netgroup_byname_template;
+
 static int mkfilter_netgroup_byname(const char *name,
                                     char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_netgroup_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    netgroup_filter, attmap_netgroup_cn, safename);
+  return filter_template_build(&netgroup_byname_template, name,
+                               buffer, buflen);
 }
 
 void netgroup_init(void)
@@ -92,6 +87,9 @@ void netgroup_init(void)
   netgroup_attrs[1] = attmap_netgroup_nisNetgroupTriple;
   netgroup_attrs[2] = attmap_netgroup_memberNisNetgroup;
   netgroup_attrs[3] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&netgroup_byname_template,
+                       netgroup_filter, attmap_netgroup_cn);
 }
 
 static int write_string_stripspace_len(TFILE *fp, const char *str, int len)
@@ -196,6 +194,7 @@ static int write_netgroup(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname)
 {
   int32_t tmpint32;
   int i, j;
+  int num = 0;
   const char **names;
   const char **triples;
   const char **members;
@@ -233,9 +232,10 @@ static int write_netgroup(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname)
         }
       /* write end of result marker */
       WRITE_INT32(fp, NSLCD_NETGROUP_TYPE_END);
+      num++;
     }
   /* we're done */
-  return 0;
+  return num;
 }
 
 NSLCD_HANDLE(
@@ -248,7 +248,7 @@ NSLCD_HANDLE(
   write_netgroup(fp, entry, name)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   netgroup, all, NSLCD_ACTION_NETGROUP_ALL,
   const char *filter;
   log_setrequest("netgroup(all)");,
@@ -60,36 +60,23 @@ const char *attmap_network_ipNetworkNumber = "ipNetworkNumber";
 /* the attribute list to request with searches */
 static const char *network_attrs[3];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE network_byname_template;
+static FILTER_TEMPLATE network_byaddr_template;
+
 /* create a search filter for searching a network entry
    by name, return -1 on errors */
 static int mkfilter_network_byname(const char *name,
                                    char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_HOSTNAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_network_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    network_filter, attmap_network_cn, safename);
+  return filter_template_build(&network_byname_template, name, buffer, buflen);
 }
 
 static int mkfilter_network_byaddr(const char *addrstr,
                                    char *buffer, size_t buflen)
 {
-  char safeaddr[64];
-  /* escape attribute */
-  if (myldap_escape(addrstr, safeaddr, sizeof(safeaddr)))
-  {
-    log_log(LOG_ERR, "mkfilter_network_byaddr(): safeaddr buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    network_filter, attmap_network_ipNetworkNumber, safeaddr);
+  return filter_template_build(&network_byaddr_template, addrstr,
+                               buffer, buflen);
 }
 
 void network_init(void)
@@ -106,6 +93,11 @@ void network_init(void)
   network_attrs[0] = attmap_network_cn;
   network_attrs[1] = attmap_network_ipNetworkNumber;
   network_attrs[2] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&network_byname_template,
+                       network_filter, attmap_network_cn);
+  filter_template_init(&network_byaddr_template,
+                       network_filter, attmap_network_ipNetworkNumber);
 }
 
 /* write a single network entry to the stream */
@@ -148,7 +140,7 @@ static int write_network(TFILE *fp, MYLDAP_ENTRY *entry)
   {
     WRITE_ADDRESS(fp, entry, attmap_network_ipNetworkNumber, addresses[i]);
   }
-  return 0;
+  return 1;
 }
 
 NSLCD_HANDLE(
@@ -180,7 +172,7 @@ NSLCD_HANDLE(
   write_network(fp, entry)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   network, all, NSLCD_ACTION_NETWORK_ALL,
   const char *filter;
   log_setrequest("network(all)");,
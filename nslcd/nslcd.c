@@ -348,10 +348,11 @@ static int read_header(TFILE *fp, int32_t *action)
 }
 
 /* read a request message, returns <0 in case of errors,
-   this function closes the socket */
-static void handleconnection(int sock, MYLDAP_SESSION *session)
+   this function closes the socket, the stream in fpp is re-used between
+   connections (and created on first use) */
+static void handleconnection(int sock, MYLDAP_SESSION *session, TFILE **fpp)
 {
-  TFILE *fp;
+  TFILE *fp = *fpp;
   int32_t action;
   pid_t pid = (pid_t)-1;
   uid_t uid = (uid_t)-1;
@@ -374,10 +375,12 @@ static void handleconnection(int sock, MYLDAP_SESSION *session)
                  " gid=%lu", (unsigned long int)gid);
     log_log(LOG_DEBUG, "connection from %s", (peerinfo[0] == '\0') ? "unknown" : peerinfo);
   }
-  /* create a stream object */
-  if ((fp = tio_fdopen(sock, READ_TIMEOUT, WRITE_TIMEOUT,
-                       READBUFFER_MINSIZE, READBUFFER_MAXSIZE,
-                       WRITEBUFFER_MINSIZE, WRITEBUFFER_MAXSIZE)) == NULL)
+  /* create a stream object or re-use the one of a previous connection */
+  if (fp != NULL)
+    tio_reopen(fp, sock);
+  else if ((fp = *fpp = tio_fdopen(sock, READ_TIMEOUT, WRITE_TIMEOUT,
+                                   READBUFFER_MINSIZE, READBUFFER_MAXSIZE,
+                                   WRITEBUFFER_MINSIZE, WRITEBUFFER_MAXSIZE)) == NULL)
   {
     log_log(LOG_WARNING, "cannot create stream for writing: %s",
             strerror(errno));
@@ -387,7 +390,7 @@ static void handleconnection(int sock, MYLDAP_SESSION *session)
   /* read request */
   if (read_header(fp, &action))
   {
-    (void)tio_close(fp);
+    (void)tio_closefd(fp);
     return;
   }
   /* handle request */
@@ -402,6 +405,7 @@ static void handleconnection(int sock, MYLDAP_SESSION *session)
     case NSLCD_ACTION_GROUP_BYNAME:     (void)nslcd_group_byname(fp, session); break;
     case NSLCD_ACTION_GROUP_BYGID:      (void)nslcd_group_bygid(fp, session); break;
     case NSLCD_ACTION_GROUP_BYMEMBER:   (void)nslcd_group_bymember(fp, session); break;
+    case NSLCD_ACTION_GROUP_GIDS_BYMEMBER: (void)nslcd_group_gids_bymember(fp, session); break;
     case NSLCD_ACTION_GROUP_ALL:
       if (!nslcd_cfg->nss_disable_enumeration) (void)nslcd_group_all(fp, session);
       break;
@@ -436,6 +440,7 @@ static void handleconnection(int sock, MYLDAP_SESSION *session)
     case NSLCD_ACTION_PAM_SESS_O:       (void)nslcd_pam_sess_o(fp, session); break;
     case NSLCD_ACTION_PAM_SESS_C:       (void)nslcd_pam_sess_c(fp, session); break;
     case NSLCD_ACTION_PAM_PWMOD:        (void)nslcd_pam_pwmod(fp, session, uid); break;
+    case NSLCD_ACTION_PAM_LOGIN:        (void)nslcd_pam_login(fp, session); break;
     case NSLCD_ACTION_USERMOD:          (void)nslcd_usermod(fp, session, uid); break;
     default:
       log_log(LOG_WARNING, "invalid request id: 0x%08x", (unsigned int)action);
@@ -443,7 +448,7 @@ static void handleconnection(int sock, MYLDAP_SESSION *session)
   }
   /* we're done with the request */
   myldap_session_cleanup(session);
-  (void)tio_close(fp);
+  (void)tio_closefd(fp);
   return;
 }
 
@@ -526,14 +531,23 @@ static void install_sighandler(int signum, void (*handler) (int))
   }
 }
 
+/* the resources that a worker keeps between connections */
+struct worker_state {
+  MYLDAP_SESSION *session;
+  TFILE *fp;
+};
+
 static void worker_cleanup(void *arg)
 {
-  MYLDAP_SESSION *session = (MYLDAP_SESSION *)arg;
-  myldap_session_close(session);
+  struct worker_state *state = (struct worker_state *)arg;
+  if (state->fp != NULL)
+    (void)tio_close(state->fp);
+  myldap_session_close(state->session);
 }
 
 static void *worker(void UNUSED(*arg))
 {
+  struct worker_state state;
   MYLDAP_SESSION *session;
   int csock;
   int j;
@@ -543,8 +557,10 @@ static void *worker(void UNUSED(*arg))
   struct timeval tv;
   /* create a new LDAP session */
   session = myldap_create_session();
+  state.session = session;
+  state.fp = NULL;
   /* clean up the session if we're done */
-  pthread_cleanup_push(worker_cleanup, session);
+  pthread_cleanup_push(worker_cleanup, &state);
   /* start waiting for incoming connections */
   while (1)
   {
@@ -600,7 +616,7 @@ static void *worker(void UNUSED(*arg))
     /* indicate new connection to logging module (generates unique id) */
     log_newsession();
     /* handle the connection */
-    handleconnection(csock, session);
+    handleconnection(csock, session, &state.fp);
     /* indicate end of session in log messages */
     log_clearsession();
   }
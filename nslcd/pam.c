@@ -31,6 +31,11 @@
 #endif /* HAVE_STDINT_H */
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#ifdef HAVE_CRYPT_H
+#include <crypt.h>
+#endif /* HAVE_CRYPT_H */
 
 #include "common.h"
 #include "log.h"
@@ -166,6 +171,447 @@ static int do_searches(MYLDAP_SESSION *session, const char *option,
   return rc;
 }
 
+/* perform the searches for all the filters at the same time, every filter
+   should match an entry in one of the search bases, returns an LDAP status
+   code as soon as one of the filters is known to fail */
+static int do_concurrent_searches(MYLDAP_SESSION *session, const char *option,
+                                  char filters[][BUFLEN_FILTER], int num)
+{
+  MYLDAP_SEARCH *searches[NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES];
+  int bases[NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES];
+  int matched[NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES];
+  int lastrc[NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES];
+  static const char *attrs[2];
+  const char *base;
+  MYLDAP_ENTRY *entry;
+  int i, done = 0;
+  int rc = LDAP_SUCCESS;
+  /* prepare the searches */
+  attrs[0] = "dn";
+  attrs[1] = NULL;
+  for (i = 0; i < num; i++)
+  {
+    searches[i] = NULL;
+    bases[i] = 0;
+    matched[i] = 0;
+    lastrc[i] = LDAP_SUCCESS;
+  }
+  while ((done < num) && (rc == LDAP_SUCCESS))
+  {
+    /* start searches for the filters that are waiting as long as the
+       session has room for them */
+    for (i = 0; (i < num) && (rc == LDAP_SUCCESS); i++)
+    {
+      if ((matched[i]) || (searches[i] != NULL) ||
+          (myldap_search_slots(session) <= 0))
+        continue;
+      base = nslcd_cfg->bases[bases[i]];
+      if (base == NULL)
+      {
+        log_log(LOG_ERR, "%s \"%s\" found no matches", option, filters[i]);
+        /* return the last error of the searches, if any */
+        rc = (lastrc[i] != LDAP_SUCCESS) ? lastrc[i] : LDAP_NO_SUCH_OBJECT;
+        break;
+      }
+      log_log(LOG_DEBUG, "trying %s \"%s\"", option, filters[i]);
+      searches[i] = myldap_search(session, base, LDAP_SCOPE_SUBTREE,
+                                  filters[i], attrs, &rc);
+      if (searches[i] == NULL)
+        log_log(LOG_ERR, "%s \"%s\" failed: %s",
+                option, filters[i], ldap_err2string(rc));
+    }
+    if (rc != LDAP_SUCCESS)
+      break;
+    /* wait for the result of the first running search */
+    for (i = 0; (i < num) && (searches[i] == NULL); i++)
+      /* nothing */ ;
+    if (i >= num)
+    {
+      log_log(LOG_ERR, "%s: no room in session to start searches", option);
+      rc = LDAP_OPERATIONS_ERROR;
+      break;
+    }
+    entry = myldap_get_entry(searches[i], &rc);
+    if (entry != NULL)
+    {
+      log_log(LOG_DEBUG, "%s found \"%s\"", option, myldap_get_dn(entry));
+      myldap_search_close(searches[i]);
+      matched[i] = 1;
+      done++;
+    }
+    else if (rc == LDAP_SUCCESS)
+    {
+      /* no match in this search base, try the next one */
+      bases[i]++;
+    }
+    else
+    {
+      /* an error in one search base does not stop the others from being
+         tried */
+      log_log(LOG_ERR, "%s \"%s\" failed: %s",
+              option, filters[i], ldap_err2string(rc));
+      lastrc[i] = rc;
+      rc = LDAP_SUCCESS;
+      bases[i]++;
+    }
+    /* the search was closed above or by myldap_get_entry() */
+    searches[i] = NULL;
+  }
+  /* close any searches that are still running */
+  for (i = 0; i < num; i++)
+    if (searches[i] != NULL)
+      myldap_search_close(searches[i]);
+  return rc;
+}
+
+/* the pool of connections that are kept open for authentication binds */
+static pthread_mutex_t authc_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static MYLDAP_SESSION **authc_pool = NULL;
+static int authc_pool_num = 0;
+static unsigned long int authc_pool_hits = 0;
+static unsigned long int authc_pool_misses = 0;
+
+/* get a session for performing an authentication bind, either from the
+   pool or a new one */
+static MYLDAP_SESSION *authc_session_get(void)
+{
+  MYLDAP_SESSION *session = NULL;
+  if (nslcd_cfg->pam_authc_pool <= 0)
+    return myldap_create_session();
+  pthread_mutex_lock(&authc_pool_mutex);
+  if (authc_pool_num > 0)
+  {
+    session = authc_pool[--authc_pool_num];
+    authc_pool_hits++;
+  }
+  else
+    authc_pool_misses++;
+  log_log(LOG_DEBUG, "authc connection pool %s (hits=%lu, misses=%lu)",
+          (session != NULL) ? "hit" : "miss",
+          authc_pool_hits, authc_pool_misses);
+  pthread_mutex_unlock(&authc_pool_mutex);
+  if (session == NULL)
+    return myldap_create_session();
+  /* close the connection if it was reset or has been idle for too long */
+  myldap_session_check(session);
+  return session;
+}
+
+/* return the session to the pool after re-binding it with the normal
+   credentials or close it if that is not possible */
+static void authc_session_put(MYLDAP_SESSION *session)
+{
+  myldap_session_cleanup(session);
+  if ((nslcd_cfg->pam_authc_pool > 0) &&
+      (myldap_reset_bind(session) == LDAP_SUCCESS))
+  {
+    pthread_mutex_lock(&authc_pool_mutex);
+    if (authc_pool == NULL)
+      authc_pool = (MYLDAP_SESSION **)malloc(nslcd_cfg->pam_authc_pool * sizeof(MYLDAP_SESSION *));
+    if ((authc_pool != NULL) && (authc_pool_num < nslcd_cfg->pam_authc_pool))
+    {
+      authc_pool[authc_pool_num++] = session;
+      session = NULL;
+    }
+    pthread_mutex_unlock(&authc_pool_mutex);
+  }
+  if (session != NULL)
+    myldap_session_close(session);
+}
+
+/* the offline authentication cache, this keeps a salted hash of the
+   password of users that recently authenticated successfully so they
+   can still log in when the LDAP server cannot be reached */
+static pthread_mutex_t authc_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *authc_cache = NULL;
+static int authc_cache_num = 0;
+struct authc_cache_entry {
+  time_t timestamp;   /* when the password was last verified online */
+  char verifier[128]; /* crypt() output, empty if invalidated */
+  int failures;       /* number of failed offline attempts */
+  time_t lastfailure; /* time of the last failed offline attempt */
+};
+
+/* the maximum number of users to keep in the cache */
+#define AUTHC_CACHE_MAX_ENTRIES 1024
+
+/* the number of hashing rounds to make brute-forcing the verifiers slow */
+#define AUTHC_CACHE_ROUNDS 20000
+
+#if defined(HAVE_CRYPT) || defined(HAVE_CRYPT_R)
+
+#ifndef HAVE_CRYPT_R
+/* crypt() uses a static buffer */
+static pthread_mutex_t crypt_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif /* not HAVE_CRYPT_R */
+
+/* hash the password with the specified setting (salt or existing hash),
+   the result is stored in buffer, returns 0 on success */
+static int authc_cache_crypt(const char *password, const char *setting,
+                             char *buffer, size_t buflen)
+{
+  const char *res;
+  int rc = -1;
+#ifdef HAVE_CRYPT_R
+  struct crypt_data *data;
+  data = (struct crypt_data *)calloc(1, sizeof(struct crypt_data));
+  if (data == NULL)
+  {
+    log_log(LOG_CRIT, "authc_cache_crypt(): calloc() failed to allocate memory");
+    return -1;
+  }
+  res = crypt_r(password, setting, data);
+#else /* not HAVE_CRYPT_R */
+  pthread_mutex_lock(&crypt_mutex);
+  res = crypt(password, setting);
+#endif /* not HAVE_CRYPT_R */
+  /* check that we got a proper salted SHA-512 hash */
+  if ((res != NULL) && (strncmp(res, "$6$", 3) == 0) && (strlen(res) < buflen))
+  {
+    strcpy(buffer, res);
+    rc = 0;
+  }
+#ifdef HAVE_CRYPT_R
+  memset(data, 0, sizeof(struct crypt_data));
+  free(data);
+#else /* not HAVE_CRYPT_R */
+  pthread_mutex_unlock(&crypt_mutex);
+#endif /* not HAVE_CRYPT_R */
+  return rc;
+}
+
+/* build a new random salt setting for crypt(), returns 0 on success */
+static int authc_cache_salt(char *buffer, size_t buflen)
+{
+  static const char alphabet[] = "./0123456789"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz";
+  unsigned char random[16];
+  char salt[sizeof(random) + 1];
+  FILE *fp;
+  unsigned int i;
+  fp = fopen("/dev/urandom", "r");
+  if (fp == NULL)
+  {
+    log_log(LOG_ERR, "cannot open /dev/urandom: %s", strerror(errno));
+    return -1;
+  }
+  if (fread(random, sizeof(random), 1, fp) != 1)
+  {
+    log_log(LOG_ERR, "cannot read /dev/urandom");
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  for (i = 0; i < sizeof(random); i++)
+    salt[i] = alphabet[random[i] % (sizeof(alphabet) - 1)];
+  salt[i] = '\0';
+  return mysnprintf(buffer, buflen, "$6$rounds=%d$%s$",
+                    AUTHC_CACHE_ROUNDS, salt);
+}
+
+/* drop expired and invalidated verifiers from the cache,
+   authc_cache_mutex should be held */
+static void do_authc_cache_expire(time_t now)
+{
+  const char **keys;
+  DICT *newcache;
+  struct authc_cache_entry *cacheentry;
+  int i;
+  keys = dict_keys(authc_cache);
+  newcache = dict_new();
+  if ((keys == NULL) || (newcache == NULL))
+  {
+    if (keys != NULL)
+      free(keys);
+    if (newcache != NULL)
+      dict_free(newcache);
+    return;
+  }
+  authc_cache_num = 0;
+  for (i = 0; keys[i] != NULL; i++)
+  {
+    cacheentry = dict_get(authc_cache, keys[i]);
+    if ((cacheentry->verifier[0] != '\0') &&
+        (now < (cacheentry->timestamp + nslcd_cfg->cache_authc_positive)) &&
+        (dict_put(newcache, keys[i], cacheentry) == 0))
+      authc_cache_num++;
+    else
+    {
+      memset(cacheentry, 0, sizeof(struct authc_cache_entry));
+      free(cacheentry);
+    }
+  }
+  free(keys);
+  dict_free(authc_cache);
+  authc_cache = newcache;
+}
+
+#endif /* HAVE_CRYPT || HAVE_CRYPT_R */
+
+/* remove the verifier of the user from the cache */
+static void authc_cache_invalidate(const char *username)
+{
+  struct authc_cache_entry *cacheentry;
+  pthread_mutex_lock(&authc_cache_mutex);
+  if ((authc_cache != NULL) && ((cacheentry = dict_get(authc_cache, username)) != NULL))
+  {
+    memset(cacheentry->verifier, 0, sizeof(cacheentry->verifier));
+    cacheentry->failures = 0;
+  }
+  pthread_mutex_unlock(&authc_cache_mutex);
+}
+
+/* store a verifier of the password in the cache */
+static void authc_cache_store(const char *username, const char *password)
+{
+#if defined(HAVE_CRYPT) || defined(HAVE_CRYPT_R)
+  struct authc_cache_entry *cacheentry;
+  char setting[64];
+  char verifier[sizeof(cacheentry->verifier)];
+  time_t now;
+  /* the slow hash is calculated without holding the lock */
+  if ((authc_cache_salt(setting, sizeof(setting)) != 0) ||
+      (authc_cache_crypt(password, setting, verifier, sizeof(verifier)) != 0))
+  {
+    log_log(LOG_WARNING, "%s: failed to build offline authentication verifier",
+            username);
+    return;
+  }
+  now = time(NULL);
+  pthread_mutex_lock(&authc_cache_mutex);
+  if (authc_cache == NULL)
+    authc_cache = dict_new();
+  if (authc_cache != NULL)
+  {
+    cacheentry = dict_get(authc_cache, username);
+    /* make room by dropping expired verifiers */
+    if ((cacheentry == NULL) && (authc_cache_num >= AUTHC_CACHE_MAX_ENTRIES))
+      do_authc_cache_expire(now);
+    if ((cacheentry == NULL) && (authc_cache_num >= AUTHC_CACHE_MAX_ENTRIES))
+      log_log(LOG_DEBUG, "%s: offline authentication cache full", username);
+    else if (cacheentry == NULL)
+    {
+      cacheentry = (struct authc_cache_entry *)malloc(sizeof(struct authc_cache_entry));
+      if ((cacheentry != NULL) && (dict_put(authc_cache, username, cacheentry) != 0))
+      {
+        free(cacheentry);
+        cacheentry = NULL;
+      }
+      else if (cacheentry != NULL)
+        authc_cache_num++;
+    }
+    if (cacheentry != NULL)
+    {
+      cacheentry->timestamp = now;
+      strcpy(cacheentry->verifier, verifier);
+      cacheentry->failures = 0;
+      cacheentry->lastfailure = 0;
+    }
+  }
+  pthread_mutex_unlock(&authc_cache_mutex);
+  memset(verifier, 0, sizeof(verifier));
+#endif /* HAVE_CRYPT || HAVE_CRYPT_R */
+}
+
+/* update the offline authentication cache with the result of an online
+   authentication attempt (rc is an LDAP result code, authzrc an
+   NSLCD_PAM_* code) */
+static void authc_cache_update(const char *username, const char *password,
+                               int rc, int authzrc)
+{
+  if ((nslcd_cfg->cache_authc_positive == 0) || (*username == '\0'))
+    return;
+  if ((rc == LDAP_SUCCESS) && (authzrc == NSLCD_PAM_SUCCESS))
+    authc_cache_store(username, password);
+  else if ((rc == LDAP_SUCCESS) || (rc == LDAP_INVALID_CREDENTIALS))
+  {
+    /* the server rejected the password or the account has problems so
+       the verifier should no longer be used */
+    authc_cache_invalidate(username);
+  }
+}
+
+/* check whether the LDAP result code indicates that no LDAP server
+   could be reached */
+static int is_offline_error(int rc)
+{
+  return (rc == LDAP_SERVER_DOWN) || (rc == LDAP_UNAVAILABLE) ||
+         (rc == LDAP_CONNECT_ERROR) || (rc == LDAP_TIMEOUT) ||
+         (rc == LDAP_BUSY);
+}
+
+/* try to authenticate the user against the offline cache after the LDAP
+   operation failed with the specified LDAP result code, returns an
+   NSLCD_PAM_* code or -1 if the cache cannot be used */
+static int try_offline_authc(int ldaprc, const char *username,
+                             const char *password)
+{
+#if defined(HAVE_CRYPT) || defined(HAVE_CRYPT_R)
+  struct authc_cache_entry *cacheentry;
+  char verifier[sizeof(cacheentry->verifier)];
+  char result[sizeof(cacheentry->verifier)];
+  time_t now;
+  int rc;
+  if ((nslcd_cfg->cache_authc_positive == 0) || (*username == '\0') ||
+      (!is_offline_error(ldaprc)))
+    return -1;
+  /* get a copy of the verifier and check the lockout */
+  now = time(NULL);
+  pthread_mutex_lock(&authc_cache_mutex);
+  cacheentry = (authc_cache != NULL) ? dict_get(authc_cache, username) : NULL;
+  if ((cacheentry == NULL) || (cacheentry->verifier[0] == '\0') ||
+      (now >= (cacheentry->timestamp + nslcd_cfg->cache_authc_positive)))
+  {
+    pthread_mutex_unlock(&authc_cache_mutex);
+    log_log(LOG_DEBUG, "no offline authentication information available");
+    return -1;
+  }
+  if ((cacheentry->failures >= nslcd_cfg->pam_authc_cache_maxfail) &&
+      (now < (cacheentry->lastfailure + nslcd_cfg->cache_authc_negative)))
+  {
+    pthread_mutex_unlock(&authc_cache_mutex);
+    log_log(LOG_NOTICE, "offline authentication locked after %d failures",
+            nslcd_cfg->pam_authc_cache_maxfail);
+    return NSLCD_PAM_MAXTRIES;
+  }
+  strcpy(verifier, cacheentry->verifier);
+  pthread_mutex_unlock(&authc_cache_mutex);
+  /* hash the password with the salt from the verifier */
+  if ((authc_cache_crypt(password, verifier, result, sizeof(result)) == 0) &&
+      (strcmp(result, verifier) == 0))
+    rc = NSLCD_PAM_SUCCESS;
+  else
+    rc = NSLCD_PAM_AUTH_ERR;
+  memset(result, 0, sizeof(result));
+  memset(verifier, 0, sizeof(verifier));
+  /* record the result */
+  pthread_mutex_lock(&authc_cache_mutex);
+  cacheentry = dict_get(authc_cache, username);
+  if (cacheentry != NULL)
+  {
+    if (rc == NSLCD_PAM_SUCCESS)
+      cacheentry->failures = 0;
+    else
+    {
+      /* start counting again after the lockout period expired */
+      if (now >= (cacheentry->lastfailure + nslcd_cfg->cache_authc_negative))
+        cacheentry->failures = 0;
+      cacheentry->failures++;
+      cacheentry->lastfailure = now;
+    }
+  }
+  pthread_mutex_unlock(&authc_cache_mutex);
+  if (rc == NSLCD_PAM_SUCCESS)
+    log_log(LOG_NOTICE, "authenticated using offline authentication cache");
+  else
+    log_log(LOG_NOTICE, "offline authentication failed");
+  return rc;
+#else /* not (HAVE_CRYPT || HAVE_CRYPT_R) */
+  return -1;
+#endif /* not (HAVE_CRYPT || HAVE_CRYPT_R) */
+}
+
 /* set up a connection and try to bind with the specified DN and password,
    returns an LDAP result code */
 static int try_bind(const char *userdn, const char *password,
@@ -182,10 +628,11 @@ static int try_bind(const char *userdn, const char *password,
   DICT *dict;
   char filter[BUFLEN_FILTER];
   const char *res;
-  /* set up a new connection */
-  session = myldap_create_session();
+  /* get a connection to bind with */
+  session = authc_session_get();
   if (session == NULL)
     return LDAP_UNAVAILABLE;
+  myldap_set_fastbind(session, nslcd_cfg->pam_authc_fastbind);
   /* perform a BIND operation with user credentials */
   rc = myldap_bind(session, userdn, password, authzrc, &msg);
   if (rc == LDAP_SUCCESS)
@@ -213,7 +660,7 @@ static int try_bind(const char *userdn, const char *password,
       dict = search_vars_new(userdn, username, service, ruser, rhost, tty);
       if (dict == NULL)
       {
-        myldap_session_close(session);
+        authc_session_put(session);
         return LDAP_LOCAL_ERROR;
       }
       res = expr_parse(nslcd_cfg->pam_authc_search, filter, sizeof(filter),
@@ -221,7 +668,7 @@ static int try_bind(const char *userdn, const char *password,
       if (res == NULL)
       {
         search_vars_free(dict);
-        myldap_session_close(session);
+        authc_session_put(session);
         log_log(LOG_ERR, "invalid pam_authc_search \"%s\"",
                 nslcd_cfg->pam_authc_search);
         return LDAP_LOCAL_ERROR;
@@ -240,8 +687,8 @@ static int try_bind(const char *userdn, const char *password,
     mysnprintf(authzmsg, authzmsgsz - 1, "%s", msg);
     log_log(LOG_WARNING, "%s: %s", userdn, authzmsg);
   }
-  /* close the session */
-  myldap_session_close(session);
+  /* return the session to the pool or close it */
+  authc_session_put(session);
   /* return results */
   return rc;
 }
@@ -308,18 +755,14 @@ static void update_username(MYLDAP_ENTRY *entry, char *username,
   }
 }
 
-static int check_shadow(MYLDAP_SESSION *session, const char *username,
-                        char *authzmsg, size_t authzmsgsz,
-                        int check_maxdays, int check_mindays)
+/* check the shadow properties of the entry */
+static int check_shadow_entry(MYLDAP_ENTRY *entry,
+                              char *authzmsg, size_t authzmsgsz,
+                              int check_maxdays, int check_mindays)
 {
-  MYLDAP_ENTRY *entry = NULL;
   long today, lastchangedate, mindays, maxdays, warndays, inactdays, expiredate;
   unsigned long flag;
   long daysleft, inactleft;
-  /* get the shadow entry */
-  entry = shadow_uid2entry(session, username, NULL);
-  if (entry == NULL)
-    return NSLCD_PAM_SUCCESS; /* no shadow entry found, nothing to check */
   /* get today's date */
   today = (long)(time(NULL) / (60 * 60 * 24));
   /* get shadow information */
@@ -411,6 +854,57 @@ static int check_shadow(MYLDAP_SESSION *session, const char *username,
   return NSLCD_PAM_SUCCESS;
 }
 
+static int check_shadow(MYLDAP_SESSION *session, const char *username,
+                        char *authzmsg, size_t authzmsgsz,
+                        int check_maxdays, int check_mindays)
+{
+  MYLDAP_ENTRY *entry = NULL;
+  /* get the shadow entry */
+  entry = shadow_uid2entry(session, username, NULL);
+  if (entry == NULL)
+    return NSLCD_PAM_SUCCESS; /* no shadow entry found, nothing to check */
+  return check_shadow_entry(entry, authzmsg, authzmsgsz,
+                            check_maxdays, check_mindays);
+}
+
+/* generate a pseudo-random session id */
+static void generate_sessionid(char *buffer, size_t buflen)
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz"
+                                 "01234567890";
+  unsigned int i;
+  for (i = 0; i < (buflen - 1); i++)
+    buffer[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+  buffer[i] = '\0';
+}
+
+/* write an authentication (or login) response for the result of the
+   offline cache, no authorisation checks can be done without the LDAP
+   server */
+static int write_offline_authc(TFILE *fp, const char *username, int rc,
+                               int login)
+{
+  int32_t tmpint32;
+  char sessionid[25];
+  WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+  WRITE_INT32(fp, rc);
+  WRITE_STRING(fp, username);
+  WRITE_INT32(fp, NSLCD_PAM_SUCCESS);
+  WRITE_STRING(fp, "");
+  if (login)
+  {
+    sessionid[0] = '\0';
+    if (rc == NSLCD_PAM_SUCCESS)
+      generate_sessionid(sessionid, sizeof(sessionid));
+    WRITE_INT32(fp, NSLCD_PAM_AUTHINFO_UNAVAIL);
+    WRITE_STRING(fp, "");
+    WRITE_STRING(fp, sessionid);
+  }
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
 /* check authentication credentials of the user */
 int nslcd_pam_authc(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
 {
@@ -422,6 +916,7 @@ int nslcd_pam_authc(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
   MYLDAP_ENTRY *entry;
   int authzrc = NSLCD_PAM_SUCCESS;
   char authzmsg[BUFLEN_MESSAGE];
+  int bindrc, offlinerc;
   authzmsg[0] = '\0';
   /* read request parameters */
   READ_STRING(fp, username);
@@ -467,12 +962,16 @@ int nslcd_pam_authc(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
     entry = validate_user(session, username, &rc);
     if (entry == NULL)
     {
+      /* if the LDAP server is unreachable use the offline cache */
+      offlinerc = try_offline_authc(rc, username, password);
+      memset(password, 0, sizeof(password));
+      if (offlinerc >= 0)
+        return write_offline_authc(fp, username, offlinerc, 0);
       /* for user not found we just say no result */
       if (rc == LDAP_NO_SUCH_OBJECT)
       {
         WRITE_INT32(fp, NSLCD_RESULT_END);
       }
-      memset(password, 0, sizeof(password));
       return -1;
     }
     userdn = myldap_get_dn(entry);
@@ -483,6 +982,12 @@ int nslcd_pam_authc(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
                 &authzrc, authzmsg, sizeof(authzmsg));
   if (rc == LDAP_SUCCESS)
     log_log(LOG_DEBUG, "bind successful");
+  else if ((offlinerc = try_offline_authc(rc, username, password)) >= 0)
+  {
+    memset(password, 0, sizeof(password));
+    return write_offline_authc(fp, username, offlinerc, 0);
+  }
+  bindrc = rc;
   /* map result code */
   switch (rc)
   {
@@ -493,6 +998,8 @@ int nslcd_pam_authc(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
   /* perform shadow attribute checks */
   if ((*username != '\0') && (authzrc == NSLCD_PAM_SUCCESS))
     authzrc = check_shadow(session, username, authzmsg, sizeof(authzmsg), 1, 0);
+  /* keep the offline verifier up-to-date */
+  authc_cache_update(username, password, bindrc, authzrc);
   /* write response */
   WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
   WRITE_INT32(fp, rc);
@@ -504,45 +1011,178 @@ int nslcd_pam_authc(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
   return 0;
 }
 
+/* the cache of authorisation decisions, keyed on the expanded
+   pam_authz_search filters */
+static pthread_mutex_t authz_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *authz_cache = NULL;
+static int authz_cache_num = 0;
+struct authz_cache_entry {
+  time_t timestamp;
+  int rc;
+};
+
+/* the maximum number of decisions to keep in the cache */
+#define AUTHZ_CACHE_MAX_ENTRIES 1024
+
+/* remove all entries from the cache, authz_cache_mutex should be held */
+static void do_authz_cache_clear(void)
+{
+  const char **keys;
+  int i;
+  if (authz_cache == NULL)
+    return;
+  keys = dict_keys(authz_cache);
+  if (keys != NULL)
+  {
+    for (i = 0; keys[i] != NULL; i++)
+      free(dict_get(authz_cache, keys[i]));
+    free(keys);
+  }
+  dict_free(authz_cache);
+  authz_cache = NULL;
+  authz_cache_num = 0;
+}
+
+void pam_authz_cache_clear(void)
+{
+  pthread_mutex_lock(&authz_cache_mutex);
+  do_authz_cache_clear();
+  pthread_mutex_unlock(&authz_cache_mutex);
+}
+
+/* build a cache key from the list of filters, returns NULL if the cache
+   is not used or memory allocation failed */
+static char *authz_cache_key(char filters[][BUFLEN_FILTER], int num)
+{
+  size_t len = 1;
+  char *key;
+  int i;
+  if ((nslcd_cfg->cache_authz_positive == 0) && (nslcd_cfg->cache_authz_negative == 0))
+    return NULL;
+  for (i = 0; i < num; i++)
+    len += strlen(filters[i]) + 1;
+  key = (char *)malloc(len);
+  if (key == NULL)
+  {
+    log_log(LOG_CRIT, "authz_cache_key(): malloc() failed to allocate memory");
+    return NULL;
+  }
+  key[0] = '\0';
+  for (i = 0; i < num; i++)
+  {
+    strcat(key, filters[i]);
+    strcat(key, "\n");
+  }
+  return key;
+}
+
+/* look up a still valid decision in the cache, returns non-zero if one
+   was found and stores it in rcp */
+static int authz_cache_get(const char *key, int *rcp)
+{
+  struct authz_cache_entry *cacheentry;
+  time_t ttl;
+  int found = 0;
+  pthread_mutex_lock(&authz_cache_mutex);
+  if ((authz_cache != NULL) && ((cacheentry = dict_get(authz_cache, key)) != NULL))
+  {
+    ttl = (cacheentry->rc == LDAP_SUCCESS) ? nslcd_cfg->cache_authz_positive
+                                           : nslcd_cfg->cache_authz_negative;
+    if (time(NULL) < (cacheentry->timestamp + ttl))
+    {
+      *rcp = cacheentry->rc;
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&authz_cache_mutex);
+  return found;
+}
+
+/* store the decision in the cache, only definitive answers (allow or no
+   matches found) are stored */
+static void authz_cache_put(const char *key, int rc)
+{
+  struct authz_cache_entry *cacheentry;
+  if (!(((rc == LDAP_SUCCESS) && (nslcd_cfg->cache_authz_positive > 0)) ||
+        ((rc == LDAP_NO_SUCH_OBJECT) && (nslcd_cfg->cache_authz_negative > 0))))
+    return;
+  pthread_mutex_lock(&authz_cache_mutex);
+  /* start over if the cache grows too big */
+  if (authz_cache_num >= AUTHZ_CACHE_MAX_ENTRIES)
+    do_authz_cache_clear();
+  if (authz_cache == NULL)
+    authz_cache = dict_new();
+  if (authz_cache != NULL)
+  {
+    cacheentry = dict_get(authz_cache, key);
+    if (cacheentry == NULL)
+    {
+      cacheentry = (struct authz_cache_entry *)malloc(sizeof(struct authz_cache_entry));
+      if ((cacheentry != NULL) && (dict_put(authz_cache, key, cacheentry) != 0))
+      {
+        free(cacheentry);
+        cacheentry = NULL;
+      }
+      else if (cacheentry != NULL)
+        authz_cache_num++;
+    }
+    if (cacheentry != NULL)
+    {
+      cacheentry->timestamp = time(NULL);
+      cacheentry->rc = rc;
+    }
+  }
+  pthread_mutex_unlock(&authz_cache_mutex);
+}
+
 /* perform an authorisation search, returns an LDAP status code */
 static int try_authz_search(MYLDAP_SESSION *session, const char *dn,
                           const char *username, const char *service,
                           const char *ruser, const char *rhost,
                           const char *tty)
 {
-  DICT *dict = NULL;
-  char filter[BUFLEN_FILTER];
+  DICT *dict;
+  char filters[NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES][BUFLEN_FILTER];
+  char *key;
   int rc = LDAP_SUCCESS;
-  const char *res;
-  int i;
-  /* go over all pam_authz_search options */
-  for (i = 0; (i < NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES) && (nslcd_cfg->pam_authz_searches[i] != NULL); i++)
+  int num;
+  /* nothing to check if no pam_authz_search options are set */
+  if (nslcd_cfg->pam_authz_searches[0] == NULL)
+    return LDAP_SUCCESS;
+  /* build the search filters for all pam_authz_search options */
+  dict = search_vars_new(dn, username, service, ruser, rhost, tty);
+  if (dict == NULL)
+    return LDAP_LOCAL_ERROR;
+  for (num = 0; (num < NSS_LDAP_CONFIG_MAX_AUTHZ_SEARCHES) && (nslcd_cfg->pam_authz_searches[num] != NULL); num++)
   {
-    if (dict == NULL)
-    {
-      dict = search_vars_new(dn, username, service, ruser, rhost, tty);
-      if (dict == NULL)
-        return LDAP_LOCAL_ERROR;
-    }
-    /* build the search filter */
-    res = expr_parse(nslcd_cfg->pam_authz_searches[i],
-                     filter, sizeof(filter),
-                     search_var_get, (void *)dict);
-    if (res == NULL)
+    if (expr_parse(nslcd_cfg->pam_authz_searches[num],
+                   filters[num], sizeof(filters[num]),
+                   search_var_get, (void *)dict) == NULL)
     {
       search_vars_free(dict);
       log_log(LOG_ERR, "invalid pam_authz_search \"%s\"",
-              nslcd_cfg->pam_authz_searches[i]);
+              nslcd_cfg->pam_authz_searches[num]);
       return LDAP_LOCAL_ERROR;
     }
-    /* perform the actual searches on all bases */
-    rc = do_searches(session, "pam_authz_search", filter);
-    if (rc != LDAP_SUCCESS)
-      break;
   }
-  /* we went over all pam_authz_search entries */
-  if (dict != NULL)
-    search_vars_free(dict);
+  search_vars_free(dict);
+  /* see if we have a cached decision for these filters */
+  key = authz_cache_key(filters, num);
+  if ((key != NULL) && (authz_cache_get(key, &rc)))
+  {
+    log_log(LOG_DEBUG, "pam_authz_search: using cached %s",
+            (rc == LDAP_SUCCESS) ? "allow" : "deny");
+    free(key);
+    return rc;
+  }
+  /* perform the actual searches on all bases */
+  rc = do_concurrent_searches(session, "pam_authz_search", filters, num);
+  /* remember the decision */
+  if (key != NULL)
+  {
+    authz_cache_put(key, rc);
+    free(key);
+  }
   return rc;
 }
 
@@ -605,10 +1245,6 @@ int nslcd_pam_sess_o(TFILE *fp, MYLDAP_SESSION UNUSED(*session))
   int32_t tmpint32;
   char username[BUFLEN_NAME], service[BUFLEN_NAME], ruser[BUFLEN_NAME], rhost[BUFLEN_HOSTNAME], tty[64];
   char sessionid[25];
-  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                                 "abcdefghijklmnopqrstuvwxyz"
-                                 "01234567890";
-  unsigned int i;
   /* read request parameters */
   READ_STRING(fp, username);
   READ_STRING(fp, service);
@@ -616,9 +1252,7 @@ int nslcd_pam_sess_o(TFILE *fp, MYLDAP_SESSION UNUSED(*session))
   READ_STRING(fp, rhost);
   READ_STRING(fp, tty);
   /* generate pseudo-random session id */
-  for (i = 0; i < (sizeof(sessionid) - 1); i++)
-    sessionid[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
-  sessionid[i] = '\0';
+  generate_sessionid(sessionid, sizeof(sessionid));
   /* log call */
   log_setrequest("sess_o=\"%s\"", username);
   log_log(LOG_DEBUG, "nslcd_pam_sess_o(\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"): %s",
@@ -658,6 +1292,118 @@ int nslcd_pam_sess_c(TFILE *fp, MYLDAP_SESSION UNUSED(*session))
   return 0;
 }
 
+/* perform the authentication, authorisation and session open steps in one
+   go, the user entry is only looked up once
+   unlike nslcd_pam_authc() this does not handle the blank user name that
+   is used to authenticate as rootpwmoddn (it is rejected by validate_user()
+   and pam_sm_chauthtok() still sends that as NSLCD_ACTION_PAM_AUTHC) so the
+   caller uid is not needed here */
+int nslcd_pam_login(TFILE *fp, MYLDAP_SESSION *session)
+{
+  int32_t tmpint32;
+  int rc;
+  char username[BUFLEN_NAME], service[BUFLEN_NAME], ruser[BUFLEN_NAME], rhost[BUFLEN_HOSTNAME], tty[64];
+  char password[BUFLEN_PASSWORD];
+  char userdn[BUFLEN_DN];
+  MYLDAP_ENTRY *entry;
+  int authzrc = NSLCD_PAM_SUCCESS;
+  char authzmsg[BUFLEN_MESSAGE];
+  int acctrc = NSLCD_PAM_SUCCESS;
+  char acctmsg[BUFLEN_MESSAGE];
+  char sessionid[25];
+  int offlinerc;
+  authzmsg[0] = '\0';
+  acctmsg[0] = '\0';
+  sessionid[0] = '\0';
+  /* read request parameters */
+  READ_STRING(fp, username);
+  READ_STRING(fp, service);
+  READ_STRING(fp, ruser);
+  READ_STRING(fp, rhost);
+  READ_STRING(fp, tty);
+  READ_STRING(fp, password);
+  /* log call */
+  log_setrequest("login=\"%s\"", username);
+  log_log(LOG_DEBUG, "nslcd_pam_login(\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\")",
+          username, service, ruser, rhost, tty, *password ? "***" : "");
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, NSLCD_ACTION_PAM_LOGIN);
+  /* lookup the user entry */
+  entry = validate_user(session, username, &rc);
+  if (entry == NULL)
+  {
+    /* if the LDAP server is unreachable use the offline cache */
+    offlinerc = try_offline_authc(rc, username, password);
+    memset(password, 0, sizeof(password));
+    if (offlinerc >= 0)
+      return write_offline_authc(fp, username, offlinerc, 1);
+    /* for user not found we just say no result */
+    if (rc == LDAP_NO_SUCH_OBJECT)
+    {
+      WRITE_INT32(fp, NSLCD_RESULT_END);
+    }
+    return -1;
+  }
+  /* keep a copy of the DN because the entry does not survive further
+     searches on the session */
+  if (strlen(myldap_get_dn(entry)) >= sizeof(userdn))
+  {
+    log_log(LOG_ERR, "nslcd_pam_login(): DN of user too long");
+    memset(password, 0, sizeof(password));
+    return -1;
+  }
+  strcpy(userdn, myldap_get_dn(entry));
+  update_username(entry, username, sizeof(username));
+  /* try authentication */
+  rc = try_bind(userdn, password, username, service, ruser, rhost, tty,
+                &authzrc, authzmsg, sizeof(authzmsg));
+  if ((rc != LDAP_SUCCESS) &&
+      ((offlinerc = try_offline_authc(rc, username, password)) >= 0))
+  {
+    memset(password, 0, sizeof(password));
+    return write_offline_authc(fp, username, offlinerc, 1);
+  }
+  if (rc == LDAP_SUCCESS)
+  {
+    log_log(LOG_DEBUG, "bind successful");
+    /* perform the shadow attribute checks for both phases on a single
+       shadow entry */
+    entry = shadow_uid2entry(session, username, NULL);
+    if (entry != NULL)
+    {
+      acctrc = check_shadow_entry(entry, acctmsg, sizeof(acctmsg), 0, 0);
+      if (authzrc == NSLCD_PAM_SUCCESS)
+        authzrc = check_shadow_entry(entry, authzmsg, sizeof(authzmsg), 1, 0);
+    }
+    /* check authorisation search */
+    if (try_authz_search(session, userdn, username, service, ruser,
+                         rhost, tty) != LDAP_SUCCESS)
+    {
+      acctrc = NSLCD_PAM_PERM_DENIED;
+      mysnprintf(acctmsg, sizeof(acctmsg) - 1, "LDAP authorisation check failed");
+    }
+    /* prepare the session */
+    generate_sessionid(sessionid, sizeof(sessionid));
+    log_log(LOG_DEBUG, "nslcd_pam_login(): session id %s", sessionid);
+  }
+  /* keep the offline verifier up-to-date */
+  authc_cache_update(username, password, rc, authzrc);
+  memset(password, 0, sizeof(password));
+  rc = (rc == LDAP_SUCCESS) ? NSLCD_PAM_SUCCESS : NSLCD_PAM_AUTH_ERR;
+  /* write response */
+  WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+  WRITE_INT32(fp, rc);
+  WRITE_STRING(fp, username);
+  WRITE_INT32(fp, authzrc);
+  WRITE_STRING(fp, authzmsg);
+  WRITE_INT32(fp, acctrc);
+  WRITE_STRING(fp, acctmsg);
+  WRITE_STRING(fp, sessionid);
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
 extern const char *shadow_filter;
 
 /* try to update the shadowLastChange attribute of the entry if possible */
@@ -875,6 +1621,8 @@ int nslcd_pam_pwmod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
     memset(newpassword, 0, sizeof(newpassword));
     return 0;
   }
+  /* the offline verifier is no longer valid */
+  authc_cache_invalidate(username);
   /* write response */
   log_log(LOG_NOTICE, "password changed for %s", myldap_get_dn(entry));
   WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
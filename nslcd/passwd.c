@@ -63,6 +63,7 @@ const char *attmap_passwd_gidNumber     = "gidNumber";
 const char *attmap_passwd_gecos         = "\"${gecos:-$cn}\"";
 const char *attmap_passwd_homeDirectory = "homeDirectory";
 const char *attmap_passwd_loginShell    = "loginShell";
+const char *attmap_passwd_memberOf      = "memberOf";
 
 /* special properties for objectSid-based searches
    (these are already LDAP-escaped strings) */
@@ -82,21 +83,16 @@ static const char *default_passwd_userPassword = "*"; /* unmatchable */
 /* the attribute list to request with searches */
 static const char **passwd_attrs = NULL;
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE passwd_byname_template;
+static FILTER_TEMPLATE passwd_byuid_template;
+
 /* create a search filter for searching a passwd entry
    by name, return -1 on errors */
 static int mkfilter_passwd_byname(const char *name,
                                   char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_passwd_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    passwd_filter, attmap_passwd_uid, safename);
+  return filter_template_build(&passwd_byname_template, name, buffer, buflen);
 }
 
 /* create a search filter for searching a passwd entry
@@ -113,8 +109,8 @@ static int mkfilter_passwd_byuid(uid_t uid, char *buffer, size_t buflen)
   }
   else
   {
-    return mysnprintf(buffer, buflen, "(&%s(%s=%lu))",
-                      passwd_filter, attmap_passwd_uidNumber, (unsigned long int)uid);
+    return filter_template_build_uint(&passwd_byuid_template,
+                                      (unsigned long int)uid, buffer, buflen);
   }
 }
 
@@ -157,6 +153,11 @@ void passwd_init(void)
     exit(EXIT_FAILURE);
   }
   set_free(set);
+  /* set up the search filter templates */
+  filter_template_init(&passwd_byname_template,
+                       passwd_filter, attmap_passwd_uid);
+  filter_template_init(&passwd_byuid_template,
+                       passwd_filter, attmap_passwd_uidNumber);
 }
 
 /* the cache that is used in dn2uid() */
@@ -167,6 +168,168 @@ struct dn2uid_cache_entry {
   char *uid;
 };
 
+/* the cache that is used in uid2dn() */
+static pthread_mutex_t uid2dn_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *uid2dn_cache = NULL;
+static int uid2dn_cache_num = 0;
+struct uid2dn_cache_entry {
+  time_t timestamp;
+  char *dn;
+};
+
+/* the maximum number of users to keep in the uid2dn cache */
+#define UID2DN_CACHE_MAX_ENTRIES 4096
+
+/* free the cache entry */
+static void uid2dn_cache_free(struct uid2dn_cache_entry *cacheentry)
+{
+  if (cacheentry->dn != NULL)
+    free(cacheentry->dn);
+  free(cacheentry);
+}
+
+/* remove all entries from the cache, uid2dn_cache_mutex should be held */
+static void do_uid2dn_cache_clear(void)
+{
+  const char **keys;
+  int i;
+  if (uid2dn_cache == NULL)
+    return;
+  keys = dict_keys(uid2dn_cache);
+  if (keys != NULL)
+  {
+    for (i = 0; keys[i] != NULL; i++)
+      uid2dn_cache_free(dict_get(uid2dn_cache, keys[i]));
+    free(keys);
+  }
+  dict_free(uid2dn_cache);
+  uid2dn_cache = NULL;
+  uid2dn_cache_num = 0;
+}
+
+/* drop expired entries from the cache, uid2dn_cache_mutex should be held */
+static void do_uid2dn_cache_expire(time_t now)
+{
+  const char **keys;
+  DICT *newcache;
+  struct uid2dn_cache_entry *cacheentry;
+  time_t ttl;
+  int i;
+  keys = dict_keys(uid2dn_cache);
+  newcache = nslcd_cfg->ignorecase ? dict_new_ignorecase() : dict_new();
+  if ((keys == NULL) || (newcache == NULL))
+  {
+    if (keys != NULL)
+      free(keys);
+    if (newcache != NULL)
+      dict_free(newcache);
+    do_uid2dn_cache_clear();
+    return;
+  }
+  uid2dn_cache_num = 0;
+  for (i = 0; keys[i] != NULL; i++)
+  {
+    cacheentry = dict_get(uid2dn_cache, keys[i]);
+    ttl = (cacheentry->dn != NULL) ? nslcd_cfg->cache_uid2dn_positive
+                                   : nslcd_cfg->cache_uid2dn_negative;
+    if ((now < (cacheentry->timestamp + ttl)) &&
+        (dict_put(newcache, keys[i], cacheentry) == 0))
+      uid2dn_cache_num++;
+    else
+      uid2dn_cache_free(cacheentry);
+  }
+  free(keys);
+  dict_free(uid2dn_cache);
+  uid2dn_cache = newcache;
+}
+
+/* store the DN (or NULL if the user was not found) for the user name in
+   the uid2dn cache */
+static void uid2dn_cache_put(const char *uid, const char *dn)
+{
+  struct uid2dn_cache_entry *cacheentry;
+  time_t now;
+  /* check whether the cache is enabled */
+  if (((dn != NULL) && (nslcd_cfg->cache_uid2dn_positive == 0)) ||
+      ((dn == NULL) && (nslcd_cfg->cache_uid2dn_negative == 0)))
+    return;
+  now = time(NULL);
+  pthread_mutex_lock(&uid2dn_cache_mutex);
+  /* make room by dropping expired entries or start over */
+  if (uid2dn_cache_num >= UID2DN_CACHE_MAX_ENTRIES)
+    do_uid2dn_cache_expire(now);
+  if (uid2dn_cache_num >= UID2DN_CACHE_MAX_ENTRIES)
+    do_uid2dn_cache_clear();
+  if (uid2dn_cache == NULL)
+    uid2dn_cache = nslcd_cfg->ignorecase ? dict_new_ignorecase() : dict_new();
+  if (uid2dn_cache == NULL)
+  {
+    pthread_mutex_unlock(&uid2dn_cache_mutex);
+    return;
+  }
+  cacheentry = dict_get(uid2dn_cache, uid);
+  if (cacheentry == NULL)
+  {
+    /* allocate a new entry in the cache */
+    cacheentry = (struct uid2dn_cache_entry *)malloc(sizeof(struct uid2dn_cache_entry));
+    if (cacheentry != NULL)
+    {
+      cacheentry->dn = NULL;
+      if (dict_put(uid2dn_cache, uid, cacheentry) != 0)
+      {
+        free(cacheentry);
+        cacheentry = NULL;
+      }
+      else
+        uid2dn_cache_num++;
+    }
+  }
+  /* update the cache entry */
+  if (cacheentry != NULL)
+  {
+    cacheentry->timestamp = now;
+    if ((cacheentry->dn == NULL) || (dn == NULL) ||
+        (strcmp(cacheentry->dn, dn) != 0))
+    {
+      if (cacheentry->dn != NULL)
+        free(cacheentry->dn);
+      cacheentry->dn = dn != NULL ? strdup(dn) : NULL;
+    }
+  }
+  pthread_mutex_unlock(&uid2dn_cache_mutex);
+}
+
+/* look up the user name in the uid2dn cache, returns 1 and fills buf on a
+   positive hit, 0 if the user is known not to exist and -1 otherwise */
+static int uid2dn_cache_get(const char *uid, char *buf, size_t buflen)
+{
+  struct uid2dn_cache_entry *cacheentry;
+  int rc = -1;
+  pthread_mutex_lock(&uid2dn_cache_mutex);
+  if ((uid2dn_cache != NULL) && ((cacheentry = dict_get(uid2dn_cache, uid)) != NULL))
+  {
+    if ((cacheentry->dn != NULL) && (strlen(cacheentry->dn) < buflen))
+    {
+      /* positive hit: if the cached entry is still valid, return that */
+      if ((nslcd_cfg->cache_uid2dn_positive > 0) &&
+          (time(NULL) < (cacheentry->timestamp + nslcd_cfg->cache_uid2dn_positive)))
+      {
+        strcpy(buf, cacheentry->dn);
+        rc = 1;
+      }
+    }
+    else if (cacheentry->dn == NULL)
+    {
+      /* negative hit: if the cached entry is still valid, return that */
+      if ((nslcd_cfg->cache_uid2dn_negative > 0) &&
+          (time(NULL) < (cacheentry->timestamp + nslcd_cfg->cache_uid2dn_negative)))
+        rc = 0;
+    }
+  }
+  pthread_mutex_unlock(&uid2dn_cache_mutex);
+  return rc;
+}
+
 /* checks whether the entry has a valid uidNumber attribute
    (>= nss_min_uid) */
 static int entry_has_valid_uid(MYLDAP_ENTRY *entry)
@@ -293,7 +456,7 @@ char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf, size_t buflen)
   /* see if we have a cached entry */
   pthread_mutex_lock(&dn2uid_cache_mutex);
   if (dn2uid_cache == NULL)
-    dn2uid_cache = dict_new();
+    dn2uid_cache = dict_new_ignorecase();
   if ((dn2uid_cache != NULL) && ((cacheentry = dict_get(dn2uid_cache, dn)) != NULL))
   {
     if ((cacheentry->uid != NULL) && (strlen(cacheentry->uid) < buflen))
@@ -393,15 +556,90 @@ MYLDAP_ENTRY *uid2entry(MYLDAP_SESSION *session, const char *uid, int *rcp)
   return NULL;
 }
 
-char *uid2dn(MYLDAP_SESSION *session, const char *uid, char *buf, size_t buflen)
+int groupdn2uids(MYLDAP_SESSION *session, const char *groupdn,
+                 MEMBERLIST *members)
+{
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  const char *base;
+  int i, j;
+  static const char *attrs[3];
+  const char **values;
+  char safedn[BUFLEN_SAFEDN];
+  char filter[BUFLEN_FILTER];
+  int rc = LDAP_SUCCESS;
+  /* escape DN */
+  if (myldap_escape(groupdn, safedn, sizeof(safedn)))
+  {
+    log_log(LOG_ERR, "groupdn2uids(): safedn buffer too small");
+    return -1;
+  }
+  /* the server expands the memberOf attribute through nested groups */
+  if (mysnprintf(filter, sizeof(filter), "(&%s(%s:%s:=%s))",
+                 passwd_filter, attmap_passwd_memberOf,
+                 LDAP_MATCHING_RULE_IN_CHAIN, safedn))
+  {
+    log_log(LOG_ERR, "groupdn2uids(): filter buffer too small");
+    return -1;
+  }
+  /* set up attributes (we don't need much) */
+  attrs[0] = attmap_passwd_uid;
+  attrs[1] = attmap_passwd_uidNumber;
+  attrs[2] = NULL;
+  for (i = 0; (i < NSS_LDAP_CONFIG_MAX_BASES) && ((base = passwd_bases[i]) != NULL); i++)
+  {
+    search = myldap_search(session, base, passwd_scope, filter, attrs, &rc);
+    if (search == NULL)
+      return -1;
+    while ((entry = myldap_get_entry(search, &rc)) != NULL)
+    {
+      if (!entry_has_valid_uid(entry))
+        continue;
+      values = myldap_get_values(entry, attmap_passwd_uid);
+      if (values != NULL)
+        for (j = 0; values[j] != NULL; j++)
+          if (isvalidname(values[j]))
+            memberlist_add(members, values[j]);
+    }
+    if (rc != LDAP_SUCCESS)
+      return -1;
+  }
+  return 0;
+}
+
+char *uid2dn(MYLDAP_SESSION *session, const char *uid, char *buf,
+             size_t buflen, int *rcp)
 {
   MYLDAP_ENTRY *entry;
+  int rc = LDAP_SUCCESS;
+  if (rcp == NULL)
+    rcp = &rc;
+  /* see if we have a cached entry */
+  switch (uid2dn_cache_get(uid, buf, buflen))
+  {
+    case 1:
+      *rcp = LDAP_SUCCESS;
+      return buf;
+    case 0:
+      *rcp = LDAP_NO_SUCH_OBJECT;
+      return NULL;
+    default:
+      break;
+  }
   /* look up the entry */
-  entry = uid2entry(session, uid, NULL);
+  entry = uid2entry(session, uid, rcp);
   if (entry == NULL)
+  {
+    /* only remember that the user does not exist */
+    if (*rcp == LDAP_NO_SUCH_OBJECT)
+      uid2dn_cache_put(uid, NULL);
     return NULL;
+  }
   /* get DN */
-  return myldap_cpy_dn(entry, buf, buflen);
+  if (myldap_cpy_dn(entry, buf, buflen) == NULL)
+    return NULL;
+  uid2dn_cache_put(uid, buf);
+  return buf;
 }
 
 #ifndef NSS_FLAVOUR_GLIBC
@@ -430,6 +668,7 @@ static int write_passwd(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
   char shell[64];
   char passbuffer[BUFLEN_PASSWORDHASH];
   int i, j;
+  int num = 0;
   /* get the usernames for this entry */
   usernames = myldap_get_values(entry, attmap_passwd_uid);
   if ((usernames == NULL) || (usernames[0] == NULL))
@@ -565,15 +804,16 @@ static int write_passwd(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
             WRITE_STRING(fp, gecos);
             WRITE_STRING(fp, homedir);
             WRITE_STRING(fp, shell);
+            num++;
           }
         }
       }
     }
   }
-  return 0;
+  return num;
 }
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_FIRST(
   passwd, byname, NSLCD_ACTION_PASSWD_BYNAME,
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
@@ -589,7 +829,7 @@ NSLCD_HANDLE_UID(
   write_passwd(fp, entry, name, NULL, calleruid)
 )
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_FIRST(
   passwd, byuid, NSLCD_ACTION_PASSWD_BYUID,
   uid_t uid;
   char filter[BUFLEN_FILTER];
@@ -609,7 +849,7 @@ NSLCD_HANDLE_UID(
   write_passwd(fp, entry, NULL, &uid, calleruid)
 )
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_ALL(
   passwd, all, NSLCD_ACTION_PASSWD_ALL,
   const char *filter;
   log_setrequest("passwd(all)");
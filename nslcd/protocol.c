@@ -62,19 +62,15 @@ const char *attmap_protocol_ipProtocolNumber = "ipProtocolNumber";
 /* the attribute list to request with searches */
 static const char *protocol_attrs[3];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE protocol_byname_template;
+static FILTER_TEMPLATE protocol_bynumber_template;
+
 static int mkfilter_protocol_byname(const char *name,
                                     char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_protocol_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    protocol_filter, attmap_protocol_cn, safename);
+  return filter_template_build(&protocol_byname_template, name,
+                               buffer, buflen);
 }
 
 /* create a search filter for searching a protocol entry
@@ -82,8 +78,8 @@ static int mkfilter_protocol_byname(const char *name,
 static int mkfilter_protocol_bynumber(int protocol,
                                       char *buffer, size_t buflen)
 {
-  return mysnprintf(buffer, buflen, "(&%s(%s=%d))",
-                    protocol_filter, attmap_protocol_ipProtocolNumber, protocol);
+  return filter_template_build_int(&protocol_bynumber_template, protocol,
+                                   buffer, buflen);
 }
 
 void protocol_init(void)
@@ -100,6 +96,11 @@ void protocol_init(void)
   protocol_attrs[0] = attmap_protocol_cn;
   protocol_attrs[1] = attmap_protocol_ipProtocolNumber;
   protocol_attrs[2] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&protocol_byname_template,
+                       protocol_filter, attmap_protocol_cn);
+  filter_template_init(&protocol_bynumber_template,
+                       protocol_filter, attmap_protocol_ipProtocolNumber);
 }
 
 static int write_protocol(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname)
@@ -165,7 +166,7 @@ static int write_protocol(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname)
   WRITE_STRINGLIST_EXCEPT(fp, aliases, name);
   /* proto number is actually an 8-bit value but we write 32 bits anyway */
   WRITE_INT32(fp, proto);
-  return 0;
+  return 1;
 }
 
 NSLCD_HANDLE(
@@ -188,7 +189,7 @@ NSLCD_HANDLE(
   write_protocol(fp, entry, NULL)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   protocol, all, NSLCD_ACTION_PROTOCOL_ALL,
   const char *filter;
   log_setrequest("protocol(all)");,
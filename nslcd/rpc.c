@@ -64,24 +64,19 @@ const char *attmap_rpc_oncRpcNumber = "oncRpcNumber";
 /* the attribute list to request with searches */
 static const char *rpc_attrs[3];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE rpc_byname_template;
+static FILTER_TEMPLATE rpc_bynumber_template;
+
 static int mkfilter_rpc_byname(const char *name, char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_rpc_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    rpc_filter, attmap_rpc_cn, safename);
+  return filter_template_build(&rpc_byname_template, name, buffer, buflen);
 }
 
 static int mkfilter_rpc_bynumber(int number, char *buffer, size_t buflen)
 {
-  return mysnprintf(buffer, buflen, "(&%s(%s=%d))",
-                    rpc_filter, attmap_rpc_oncRpcNumber, number);
+  return filter_template_build_int(&rpc_bynumber_template, number,
+                                   buffer, buflen);
 }
 
 void rpc_init(void)
@@ -98,6 +93,10 @@ void rpc_init(void)
   rpc_attrs[0] = attmap_rpc_cn;
   rpc_attrs[1] = attmap_rpc_oncRpcNumber;
   rpc_attrs[2] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&rpc_byname_template, rpc_filter, attmap_rpc_cn);
+  filter_template_init(&rpc_bynumber_template,
+                       rpc_filter, attmap_rpc_oncRpcNumber);
 }
 
 /* write a single rpc entry to the stream */
@@ -163,7 +162,7 @@ static int write_rpc(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname)
   WRITE_STRING(fp, name);
   WRITE_STRINGLIST_EXCEPT(fp, aliases, name);
   WRITE_INT32(fp, number);
-  return 0;
+  return 1;
 }
 
 NSLCD_HANDLE(
@@ -186,7 +185,7 @@ NSLCD_HANDLE(
   write_rpc(fp, entry, NULL)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   rpc, all, NSLCD_ACTION_RPC_ALL,
   const char *filter;
   log_setrequest("rpc(all)");,
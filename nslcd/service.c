@@ -65,31 +65,33 @@ const char *attmap_service_ipServiceProtocol = "ipServiceProtocol";
 /* the attribute list to request with searches */
 static const char *service_attrs[4];
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE service_byname_template;
+static FILTER_TEMPLATE service_bynumber_template;
+
 static int mkfilter_service_byname(const char *name, const char *protocol,
                                    char *buffer, size_t buflen)
 {
   char safename[BUFLEN_SAFENAME], safeprotocol[BUFLEN_SAFENAME];
+  /* only the name has to be filled in */
+  if (*protocol == '\0')
+    return filter_template_build(&service_byname_template, name,
+                                 buffer, buflen);
   /* escape attributes */
   if (myldap_escape(name, safename, sizeof(safename)))
   {
     log_log(LOG_ERR, "mkfilter_service_byname(): safename buffer too small");
     return -1;
   }
-  /* build filter */
-  if (*protocol != '\0')
+  if (myldap_escape(protocol, safeprotocol, sizeof(safeprotocol)))
   {
-    if (myldap_escape(protocol, safeprotocol, sizeof(safeprotocol)))
-    {
-      log_log(LOG_ERR, "mkfilter_service_byname(): safeprotocol buffer too small");
-      return -1;
-    }
-    return mysnprintf(buffer, buflen, "(&%s(%s=%s)(%s=%s))",
-                      service_filter, attmap_service_cn, safename,
-                      attmap_service_ipServiceProtocol, safeprotocol);
+    log_log(LOG_ERR, "mkfilter_service_byname(): safeprotocol buffer too small");
+    return -1;
   }
-  else
-    return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                      service_filter, attmap_service_cn, safename);
+  /* build filter */
+  return mysnprintf(buffer, buflen, "(&%s(%s=%s)(%s=%s))",
+                    service_filter, attmap_service_cn, safename,
+                    attmap_service_ipServiceProtocol, safeprotocol);
 }
 
 static int mkfilter_service_bynumber(int number, const char *protocol,
@@ -108,8 +110,8 @@ static int mkfilter_service_bynumber(int number, const char *protocol,
                       attmap_service_ipServiceProtocol, safeprotocol);
   }
   else
-    return mysnprintf(buffer, buflen, "(&%s(%s=%d))",
-                      service_filter, attmap_service_ipServicePort, number);
+    return filter_template_build_int(&service_bynumber_template, number,
+                                     buffer, buflen);
 }
 
 void service_init(void)
@@ -127,6 +129,11 @@ void service_init(void)
   service_attrs[1] = attmap_service_ipServicePort;
   service_attrs[2] = attmap_service_ipServiceProtocol;
   service_attrs[3] = NULL;
+  /* set up the search filter templates */
+  filter_template_init(&service_byname_template,
+                       service_filter, attmap_service_cn);
+  filter_template_init(&service_bynumber_template,
+                       service_filter, attmap_service_ipServicePort);
 }
 
 static int write_service(TFILE *fp, MYLDAP_ENTRY *entry,
@@ -140,6 +147,7 @@ static int write_service(TFILE *fp, MYLDAP_ENTRY *entry,
   char *tmp;
   long port;
   int i;
+  int num = 0;
   /* get the most canonical name */
   name = myldap_get_rdn_value(entry, attmap_service_cn);
   /* get the other names for the service entries */
@@ -207,8 +215,9 @@ static int write_service(TFILE *fp, MYLDAP_ENTRY *entry,
       /* port number is actually a 16-bit value but we write 32 bits anyway */
       WRITE_INT32(fp, port);
       WRITE_STRING(fp, protocols[i]);
+      num++;
     }
-  return 0;
+  return num;
 }
 
 NSLCD_HANDLE(
@@ -237,7 +246,7 @@ NSLCD_HANDLE(
   write_service(fp, entry, NULL, protocol)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_ALL(
   service, all, NSLCD_ACTION_SERVICE_ALL,
   const char *filter;
   log_setrequest("service(all)");,
@@ -70,18 +70,12 @@ static const char *default_shadow_userPassword = "*"; /* unmatchable */
 /* the attribute list to request with searches */
 static const char **shadow_attrs = NULL;
 
+/* the prebuilt search filters for single value lookups */
+static FILTER_TEMPLATE shadow_byname_template;
+
 static int mkfilter_shadow_byname(const char *name, char *buffer, size_t buflen)
 {
-  char safename[BUFLEN_SAFENAME];
-  /* escape attribute */
-  if (myldap_escape(name, safename, sizeof(safename)))
-  {
-    log_log(LOG_ERR, "mkfilter_shadow_byname(): safename buffer too small");
-    return -1;
-  }
-  /* build filter */
-  return mysnprintf(buffer, buflen, "(&%s(%s=%s))",
-                    shadow_filter, attmap_shadow_uid, safename);
+  return filter_template_build(&shadow_byname_template, name, buffer, buflen);
 }
 
 void shadow_init(void)
@@ -113,6 +107,9 @@ void shadow_init(void)
     exit(EXIT_FAILURE);
   }
   set_free(set);
+  /* set up the search filter templates */
+  filter_template_init(&shadow_byname_template,
+                       shadow_filter, attmap_shadow_uid);
 }
 
 static long to_date(const char *dn, const char *date, const char *attr)
@@ -233,6 +230,7 @@ static int write_shadow(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
   long expiredate;
   unsigned long flag;
   int i;
+  int num = 0;
   char passbuffer[BUFLEN_PASSWORDHASH];
   /* get username */
   usernames = myldap_get_values(entry, attmap_shadow_uid);
@@ -271,9 +269,10 @@ static int write_shadow(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
         WRITE_INT32(fp, inactdays);
         WRITE_INT32(fp, expiredate);
         WRITE_INT32(fp, flag);
+        num++;
       }
     }
-  return 0;
+  return num;
 }
 
 MYLDAP_ENTRY *shadow_uid2entry(MYLDAP_SESSION *session, const char *username,
@@ -311,7 +310,7 @@ MYLDAP_ENTRY *shadow_uid2entry(MYLDAP_SESSION *session, const char *username,
   return NULL;
 }
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_FIRST(
   shadow, byname, NSLCD_ACTION_SHADOW_BYNAME,
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
@@ -326,7 +325,7 @@ NSLCD_HANDLE_UID(
   write_shadow(fp, entry, name, calleruid)
 )
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_ALL(
   shadow, all, NSLCD_ACTION_SHADOW_ALL,
   const char *filter;
   log_setrequest("shadow(all)");,
@@ -45,19 +45,90 @@ static nss_status_t read_group(TFILE *fp, struct group *result,
   return NSS_STATUS_SUCCESS;
 }
 
-/* read all group entries from the stream and add
-   gids of these groups to the list */
+/* add the gid to the list unless it is the specified group */
+static nss_status_t add_gid(gid_t gid, gid_t skipgroup, long int *start,
+                            long int *size, gid_t **groupsp,
+                            long int limit, int UNUSED(*errnop))
+{
+#ifdef NSS_FLAVOUR_GLIBC
+  gid_t *newgroups;
+  long int newsize;
+#endif /* NSS_FLAVOUR_GLIBC */
+  /* only add the group to the list if it is not the specified group */
+  if (gid != skipgroup)
+  {
+#ifdef NSS_FLAVOUR_GLIBC
+    /* check if we reached the limit */
+    if ((limit > 0) && (*start >= limit))
+      return NSS_STATUS_TRYAGAIN;
+    /* check if our buffer is large enough */
+    if ((*start) >= (*size))
+    {
+      /* for some reason Glibc expects us to grow the array (completely
+         different from all other NSS functions) */
+      /* calculate new size */
+      newsize = 2 * (*size);
+      if ((limit > 0) && (*start >= limit))
+        newsize = limit;
+      /* allocate new memory */
+      newgroups = realloc(*groupsp, newsize * sizeof(gid_t));
+      if (newgroups == NULL)
+        return NSS_STATUS_TRYAGAIN;
+      *groupsp = newgroups;
+      *size = newsize;
+    }
+#endif /* NSS_FLAVOUR_GLIBC */
+#ifdef NSS_FLAVOUR_SOLARIS
+    /* check if we reached the limit */
+    if ((limit > 0) && (*start >= limit))
+    {
+      *errnop = 1; /* this is args->erange */
+      return NSS_STATUS_NOTFOUND;
+    }
+#endif /* NSS_FLAVOUR_SOLARIS */
+    /* add gid to list */
+    (*groupsp)[(*start)++] = gid;
+  }
+  return NSS_STATUS_SUCCESS;
+}
+
+/* read the list of group ids from the stream and add
+   these gids to the list */
 static nss_status_t read_gids(TFILE *fp, gid_t skipgroup, long int *start,
                               long int *size, gid_t **groupsp,
                               long int limit, int *errnop)
+{
+  int32_t tmpint32;
+  int32_t num, i;
+  gid_t gid;
+  nss_status_t retv;
+  /* read the number of gids */
+  READ_INT32(fp, num);
+  /* loop over the gids */
+  for (i = 0; i < num; i++)
+  {
+    READ_INT32(fp, gid);
+    retv = add_gid(gid, skipgroup, start, size, groupsp, limit, errnop);
+    if (retv != NSS_STATUS_SUCCESS)
+      return retv;
+  }
+  /* return the proper status code */
+  return NSS_STATUS_SUCCESS;
+}
+
+/* read all group entries from the stream (the response to the
+   NSLCD_ACTION_GROUP_BYMEMBER request that is used with nslcd versions
+   that do not support NSLCD_ACTION_GROUP_GIDS_BYMEMBER) and add
+   gids of these groups to the list */
+static nss_status_t read_group_gids(TFILE *fp, gid_t skipgroup,
+                                    long int *start, long int *size,
+                                    gid_t **groupsp, long int limit,
+                                    int *errnop)
 {
   int32_t res = (int32_t)NSLCD_RESULT_BEGIN;
   int32_t tmpint32, tmp2int32, tmp3int32;
   gid_t gid;
-#ifdef NSS_FLAVOUR_GLIBC
-  gid_t *newgroups;
-  long int newsize;
-#endif /* NSS_FLAVOUR_GLIBC */
+  nss_status_t retv;
   /* loop over results */
   while (res == (int32_t)NSLCD_RESULT_BEGIN)
   {
@@ -69,41 +140,9 @@ static nss_status_t read_gids(TFILE *fp, gid_t skipgroup, long int *start,
     READ_INT32(fp, gid);
     /* skip members */
     SKIP_STRINGLIST(fp);
-    /* only add the group to the list if it is not the specified group */
-    if (gid != skipgroup)
-    {
-#ifdef NSS_FLAVOUR_GLIBC
-      /* check if we reached the limit */
-      if ((limit > 0) && (*start >= limit))
-        return NSS_STATUS_TRYAGAIN;
-      /* check if our buffer is large enough */
-      if ((*start) >= (*size))
-      {
-        /* for some reason Glibc expects us to grow the array (completely
-           different from all other NSS functions) */
-        /* calculate new size */
-        newsize = 2 * (*size);
-        if ((limit > 0) && (*start >= limit))
-          newsize = limit;
-        /* allocate new memory */
-        newgroups = realloc(*groupsp, newsize * sizeof(gid_t));
-        if (newgroups == NULL)
-          return NSS_STATUS_TRYAGAIN;
-        *groupsp = newgroups;
-        *size = newsize;
-      }
-#endif /* NSS_FLAVOUR_GLIBC */
-#ifdef NSS_FLAVOUR_SOLARIS
-      /* check if we reached the limit */
-      if ((limit > 0) && (*start >= limit))
-      {
-        *errnop = 1; /* this is args->erange */
-        return NSS_STATUS_NOTFOUND;
-      }
-#endif /* NSS_FLAVOUR_SOLARIS */
-      /* add gid to list */
-      (*groupsp)[(*start)++] = gid;
-    }
+    retv = add_gid(gid, skipgroup, start, size, groupsp, limit, errnop);
+    if (retv != NSS_STATUS_SUCCESS)
+      return retv;
     /* read next response code (don't bail out on not success since we
        just want to build up a list) */
     READ_INT32(fp, res);
@@ -112,6 +151,66 @@ static nss_status_t read_gids(TFILE *fp, gid_t skipgroup, long int *start,
   return NSS_STATUS_SUCCESS;
 }
 
+/* set when nslcd does not know the NSLCD_ACTION_GROUP_GIDS_BYMEMBER
+   request, so the NSLCD_ACTION_GROUP_BYMEMBER request is used instead */
+static int gids_bymember_unsupported = 0;
+
+/* do the NSLCD_ACTION_GROUP_GIDS_BYMEMBER request and add the returned
+   gids to the list, if nslcd closes the connection without writing a
+   response header (what older versions do for unknown requests)
+   gids_bymember_unsupported is set, the erangep is passed to read_gids() */
+static nss_status_t gids_bymember(const char *user, gid_t skipgroup,
+                                  long int *start, long int *size,
+                                  gid_t **groupsp, long int limit,
+                                  int *errnop, int *erangep)
+{
+  TFILE *fp;
+  int32_t tmpint32;
+  nss_status_t retv;
+  /* open socket and write request */
+  if ((fp = nslcd_client_open()) == NULL)
+  {
+    ERROR_OUT_OPENERROR;
+  }
+  WRITE_INT32(fp, (int32_t)NSLCD_VERSION);
+  WRITE_INT32(fp, (int32_t)NSLCD_ACTION_GROUP_GIDS_BYMEMBER);
+  WRITE_STRING(fp, user);
+  if (tio_flush(fp) < 0)
+  {
+    ERROR_OUT_WRITEERROR(fp);
+  }
+  /* nslcd writes the response header before doing any LDAP lookups so
+     only a connection that is closed before that means the request is
+     unknown (timeouts and other errors are not treated this way) */
+  if (tio_read(fp, &tmpint32, sizeof(int32_t)))
+  {
+    if (errno == ECONNRESET)
+      gids_bymember_unsupported = 1;
+    ERROR_OUT_READERROR(fp);
+  }
+  tmpint32 = ntohl(tmpint32);
+  if (tmpint32 != (int32_t)NSLCD_VERSION)
+  {
+    ERROR_OUT_READERROR(fp);
+  }
+  READ(fp, &tmpint32, sizeof(int32_t));
+  tmpint32 = ntohl(tmpint32);
+  if (tmpint32 != (int32_t)NSLCD_ACTION_GROUP_GIDS_BYMEMBER)
+  {
+    ERROR_OUT_READERROR(fp);
+  }
+  /* read response */
+  READ_RESPONSE_CODE(fp);
+  retv = read_gids(fp, skipgroup, start, size, groupsp, limit, erangep);
+  /* close socket and we're done */
+  if ((retv == NSS_STATUS_SUCCESS) || (retv == NSS_STATUS_TRYAGAIN))
+  {
+    (void)tio_skipall(fp, SKIP_TIMEOUT);
+    (void)tio_close(fp);
+  }
+  return retv;
+}
+
 #ifdef NSS_FLAVOUR_GLIBC
 
 /* get a group entry by name */
@@ -167,21 +266,58 @@ nss_status_t NSS_NAME(endgrent)(void)
    limit     IN     - the maxium size of the array
    *errnop   OUT    - for returning errno
 */
-nss_status_t NSS_NAME(initgroups_dyn)(const char *user, gid_t skipgroup,
-                                      long int *start, long int *size,
-                                      gid_t **groupsp, long int limit,
-                                      int *errnop)
-{
 /* temporarily map the buffer and buflen names so the check in NSS_GETONE
    for validity of the buffer works (renaming the parameters may cause
    confusion) */
 #define buffer groupsp
 #define buflen *size
+
+/* get the list of group ids in a single result */
+static nss_status_t initgroups_gids(const char *user, gid_t skipgroup,
+                                    long int *start, long int *size,
+                                    gid_t **groupsp, long int limit,
+                                    int *errnop)
+{
+  NSS_AVAILCHECK;
+  NSS_BUFCHECK;
+  return gids_bymember(user, skipgroup, start, size, groupsp, limit,
+                       errnop, errnop);
+}
+
+/* get the group ids from the full group entries */
+static nss_status_t initgroups_groups(const char *user, gid_t skipgroup,
+                                      long int *start, long int *size,
+                                      gid_t **groupsp, long int limit,
+                                      int *errnop)
+{
   NSS_GETONE(NSLCD_ACTION_GROUP_BYMEMBER,
              WRITE_STRING(fp, user),
-             read_gids(fp, skipgroup, start, size, groupsp, limit, errnop));
+             read_group_gids(fp, skipgroup, start, size, groupsp, limit,
+                             errnop));
+}
+
 #undef buffer
 #undef buflen
+
+nss_status_t NSS_NAME(initgroups_dyn)(const char *user, gid_t skipgroup,
+                                      long int *start, long int *size,
+                                      gid_t **groupsp, long int limit,
+                                      int *errnop)
+{
+  long int oldstart = *start;
+  nss_status_t retv = NSS_STATUS_UNAVAIL;
+  if (!gids_bymember_unsupported)
+    retv = initgroups_gids(user, skipgroup, start, size, groupsp, limit,
+                           errnop);
+  /* older nslcd versions close the connection on the unknown request,
+     use the request that returns the full group entries */
+  if (gids_bymember_unsupported)
+  {
+    *start = oldstart;
+    retv = initgroups_groups(user, skipgroup, start, size, groupsp, limit,
+                             errnop);
+  }
+  return retv;
 }
 
 #endif /* NSS_FLAVOUR_GLIBC */
@@ -245,18 +381,49 @@ static nss_status_t group_endgrent(nss_backend_t *be, void UNUSED(*args))
   NSS_ENDENT(LDAP_BE(be)->fp);
 }
 
-static nss_status_t group_getgroupsbymember(nss_backend_t UNUSED(*be), void *args)
+/* get the list of group ids in a single result */
+static nss_status_t group_gids_bymember(void *args)
+{
+  struct nss_groupsbymem *argp = (struct nss_groupsbymem *)args;
+  long int start = (long int)argp->numgids;
+  gid_t skipgroup = (start > 0) ? argp->gid_array[0] : (gid_t)-1;
+  nss_status_t retv;
+  NSS_EXTRA_DEFS;
+  NSS_AVAILCHECK;
+  NSS_BUFCHECK;
+  retv = gids_bymember(argp->username, skipgroup, &start, NULL,
+                       (gid_t **)&argp->gid_array, argp->maxgids,
+                       errnop, &NSS_ARGS(args)->erange);
+  argp->numgids = (int)start;
+  return retv;
+}
+
+/* get the group ids from the full group entries */
+static nss_status_t group_groups_bymember(void *args)
 {
   struct nss_groupsbymem *argp = (struct nss_groupsbymem *)args;
   long int start = (long int)argp->numgids;
   gid_t skipgroup = (start > 0) ? argp->gid_array[0] : (gid_t)-1;
   NSS_GETONE(NSLCD_ACTION_GROUP_BYMEMBER,
              WRITE_STRING(fp, argp->username),
-             read_gids(fp, skipgroup, &start, NULL, (gid_t **)&argp->gid_array,
-                       argp->maxgids, &NSS_ARGS(args)->erange);
+             read_group_gids(fp, skipgroup, &start, NULL,
+                             (gid_t **)&argp->gid_array, argp->maxgids,
+                             &NSS_ARGS(args)->erange);
              argp->numgids = (int)start);
 }
 
+static nss_status_t group_getgroupsbymember(nss_backend_t UNUSED(*be), void *args)
+{
+  nss_status_t retv = NSS_STATUS_UNAVAIL;
+  if (!gids_bymember_unsupported)
+    retv = group_gids_bymember(args);
+  /* older nslcd versions close the connection on the unknown request,
+     use the request that returns the full group entries */
+  if (gids_bymember_unsupported)
+    retv = group_groups_bymember(args);
+  return retv;
+}
+
 static nss_backend_op_t group_ops[] = {
   nss_ldap_destructor,
   group_endgrent,
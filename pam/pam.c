@@ -67,6 +67,11 @@ struct pld_ctx {
   char *username;
   struct nslcd_resp saved_authz;
   struct nslcd_resp saved_session;
+  /* results of the combined login request for later phases */
+  int have_acct;
+  struct nslcd_resp saved_acct;
+  int have_sessid;
+  struct nslcd_resp saved_sessid;
   int asroot;
   char *oldpassword;
 };
@@ -83,6 +88,12 @@ static void ctx_clear(struct pld_ctx *ctx)
   memset(ctx->saved_authz.msg, 0, sizeof(ctx->saved_authz.msg));
   ctx->saved_session.res = PAM_SUCCESS;
   memset(ctx->saved_session.msg, 0, sizeof(ctx->saved_session.msg));
+  ctx->have_acct = 0;
+  ctx->saved_acct.res = PAM_SUCCESS;
+  memset(ctx->saved_acct.msg, 0, sizeof(ctx->saved_acct.msg));
+  ctx->have_sessid = 0;
+  ctx->saved_sessid.res = PAM_SUCCESS;
+  memset(ctx->saved_sessid.msg, 0, sizeof(ctx->saved_sessid.msg));
   ctx->asroot = 0;
   if (ctx->oldpassword)
   {
@@ -326,6 +337,81 @@ static int nslcd_request_authc(pam_handle_t *pamh, struct pld_cfg *cfg,
   )
 }
 
+/* set when nslcd does not know the login request, so the separate
+   authentication, authorisation and session requests are used instead */
+static int login_unsupported = 0;
+
+/* perform a combined authentication, authorisation and session open call
+   over nslcd, if nslcd closes the connection without writing a response
+   header (what older versions do for unknown requests) login_unsupported
+   is set */
+static int nslcd_request_login(pam_handle_t *pamh, struct pld_cfg *cfg,
+                               const char *username, const char *service,
+                               const char *ruser, const char *rhost,
+                               const char *tty, const char *passwd,
+                               struct nslcd_resp *authc_resp,
+                               struct nslcd_resp *authz_resp,
+                               struct nslcd_resp *acct_resp,
+                               struct nslcd_resp *sess_resp)
+{
+  TFILE *fp;
+  int32_t tmpint32;
+  if (cfg->debug)
+    pam_syslog(pamh, LOG_DEBUG, "nslcd login; user=%s", username);
+  /* open socket and write request */
+  if ((fp = nslcd_client_open()) == NULL)
+  {
+    ERROR_OUT_OPENERROR;
+  }
+  WRITE_INT32(fp, (int32_t)NSLCD_VERSION);
+  WRITE_INT32(fp, (int32_t)NSLCD_ACTION_PAM_LOGIN);
+  WRITE_STRING(fp, username);
+  WRITE_STRING(fp, service);
+  WRITE_STRING(fp, ruser);
+  WRITE_STRING(fp, rhost);
+  WRITE_STRING(fp, tty);
+  WRITE_STRING(fp, passwd);
+  if (tio_flush(fp) < 0)
+  {
+    ERROR_OUT_WRITEERROR(fp);
+  }
+  /* nslcd writes the response header before doing any LDAP lookups so
+     only a connection that is closed before that means the request is
+     unknown (timeouts and other errors are not treated this way) */
+  if (tio_read(fp, &tmpint32, sizeof(int32_t)))
+  {
+    if (errno == ECONNRESET)
+    {
+      if (cfg->debug)
+        pam_syslog(pamh, LOG_DEBUG, "nslcd does not support login requests");
+      login_unsupported = 1;
+    }
+    ERROR_OUT_READERROR(fp);
+  }
+  tmpint32 = ntohl(tmpint32);
+  if (tmpint32 != (int32_t)NSLCD_VERSION)
+  {
+    ERROR_OUT_READERROR(fp);
+  }
+  READ(fp, &tmpint32, sizeof(int32_t));
+  tmpint32 = ntohl(tmpint32);
+  if (tmpint32 != (int32_t)NSLCD_ACTION_PAM_LOGIN)
+  {
+    ERROR_OUT_READERROR(fp);
+  }
+  /* read the result entry */
+  READ_RESPONSE_CODE(fp);
+  READ_PAM_CODE(fp, authc_resp->res);
+  READ_STRING(fp, authc_resp->msg); /* user name */
+  READ_PAM_CODE(fp, authz_resp->res);
+  READ_STRING(fp, authz_resp->msg);
+  READ_PAM_CODE(fp, acct_resp->res);
+  READ_STRING(fp, acct_resp->msg);
+  READ_STRING(fp, sess_resp->msg); /* session id */
+  (void)tio_close(fp);
+  return PAM_SUCCESS;
+}
+
 /* perform an authorisation call over nslcd */
 static int nslcd_request_authz(pam_handle_t *pamh, struct pld_cfg *cfg,
                                const char *username, const char *service,
@@ -452,6 +538,7 @@ int pam_sm_authenticate(pam_handle_t *pamh, int flags,
   const char *ruser = NULL, *rhost = NULL, *tty = NULL;
   char *passwd = NULL;
   struct nslcd_resp resp;
+  int combined = 1;
   /* set up configuration */
   cfg_init(pamh, flags, argc, argv, &cfg);
   rc = init(pamh, &cfg, &ctx, &username, &service, &ruser, &rhost, &tty);
@@ -487,9 +574,23 @@ int pam_sm_authenticate(pam_handle_t *pamh, int flags,
       pam_syslog(pamh, LOG_DEBUG, "user has empty password, access denied");
     return PAM_AUTH_ERR;
   }
-  /* do the nslcd request */
-  rc = nslcd_request_authc(pamh, &cfg, username, service, ruser, rhost, tty,
-                           passwd, &resp, &(ctx->saved_authz));
+  /* do the nslcd request, this also returns the results for the account
+     and session phases so we don't have to contact nslcd for those */
+  ctx->have_acct = 0;
+  ctx->have_sessid = 0;
+  if (!login_unsupported)
+    rc = nslcd_request_login(pamh, &cfg, username, service, ruser, rhost, tty,
+                             passwd, &resp, &(ctx->saved_authz),
+                             &(ctx->saved_acct), &(ctx->saved_sessid));
+  if (login_unsupported)
+  {
+    /* older nslcd versions close the connection on the (to them unknown)
+       login request, use the separate authentication request and do the
+       account and session requests in the later phases */
+    combined = 0;
+    rc = nslcd_request_authc(pamh, &cfg, username, service, ruser, rhost, tty,
+                             passwd, &resp, &(ctx->saved_authz));
+  }
   if (rc != PAM_SUCCESS)
     return remap_pam_rc(rc, &cfg);
   /* check the authentication result */
@@ -502,6 +603,9 @@ int pam_sm_authenticate(pam_handle_t *pamh, int flags,
   /* debug log */
   if (cfg.debug)
     pam_syslog(pamh, LOG_DEBUG, "authentication succeeded");
+  /* keep the account and session results for the later phases */
+  ctx->have_acct = combined;
+  ctx->have_sessid = combined && (ctx->saved_sessid.msg[0] != '\0');
   /* if password change is required, save old password in context */
   if ((ctx->saved_authz.res == PAM_NEW_AUTHTOK_REQD) && (ctx->oldpassword == NULL))
     ctx->oldpassword = strdup(passwd);
@@ -545,11 +649,20 @@ int pam_sm_acct_mgmt(pam_handle_t *pamh, int flags,
   rc = init(pamh, &cfg, &ctx, &username, &service, &ruser, &rhost, &tty);
   if (rc != PAM_SUCCESS)
     return remap_pam_rc(rc, &cfg);
-  /* do the nslcd request */
-  rc = nslcd_request_authz(pamh, &cfg, username, service, ruser, rhost, tty,
-                           &authz_resp);
-  if (rc != PAM_SUCCESS)
-    return remap_pam_rc(rc, &cfg);
+  /* use the result from the login request or do the nslcd request */
+  if (ctx->have_acct)
+  {
+    if (cfg.debug)
+      pam_syslog(pamh, LOG_DEBUG, "using authorisation result from authentication");
+    memcpy(&authz_resp, &(ctx->saved_acct), sizeof(authz_resp));
+  }
+  else
+  {
+    rc = nslcd_request_authz(pamh, &cfg, username, service, ruser, rhost, tty,
+                             &authz_resp);
+    if (rc != PAM_SUCCESS)
+      return remap_pam_rc(rc, &cfg);
+  }
   /* check the returned authorisation value and the value from authentication */
   if (authz_resp.res != PAM_SUCCESS)
   {
@@ -609,11 +722,21 @@ int pam_sm_open_session(pam_handle_t *pamh, int flags,
   rc = init(pamh, &cfg, &ctx, &username, &service, &ruser, &rhost, &tty);
   if (rc != PAM_SUCCESS)
     return remap_pam_rc(rc, &cfg);
-  /* do the nslcd request */
-  rc = nslcd_request_sess_o(pamh, &cfg, username, service, ruser, rhost,
-                            tty, &(ctx->saved_session));
-  if (rc != PAM_SUCCESS)
-    return remap_pam_rc(rc, &cfg);
+  /* use the session id from the login request (only once) or do the
+     nslcd request */
+  if (ctx->have_sessid)
+  {
+    memcpy(&(ctx->saved_session), &(ctx->saved_sessid),
+           sizeof(ctx->saved_session));
+    ctx->have_sessid = 0;
+  }
+  else
+  {
+    rc = nslcd_request_sess_o(pamh, &cfg, username, service, ruser, rhost,
+                              tty, &(ctx->saved_session));
+    if (rc != PAM_SUCCESS)
+      return remap_pam_rc(rc, &cfg);
+  }
   /* debug log */
   if (cfg.debug)
     pam_syslog(pamh, LOG_DEBUG, "session open succeeded; session_id=%s",
@@ -783,6 +906,8 @@ int pam_sm_chauthtok(pam_handle_t *pamh, int flags,
     return rc;
   }
   pam_syslog(pamh, LOG_NOTICE, "password changed for %s", username);
+  /* the saved authorisation result is no longer current */
+  ctx->have_acct = 0;
   return PAM_SUCCESS;
 }
 
@@ -182,6 +182,13 @@ def read(filename):  # noqa: C901 (many simple branches)
         if m:
             globals()[m.group('keyword').lower()] = int(m.group('value'))
             continue
+        # pynslcd does not support the server-side chaining for nested
+        # groups, expand them on the client instead
+        m = re.match(
+            r'nss_nested_groups\s+server-chain$', line, re.IGNORECASE)
+        if m:
+            globals()['nss_nested_groups'] = True
+            continue
         # parse options with a single boolean argument
         m = re.match(
             r'(?P<keyword>referrals|nss_nested_groups|nss_getgrent_skipmembers|'
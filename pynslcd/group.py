@@ -229,6 +229,24 @@ class GroupByMemberRequest(GroupRequest):
         return super(GroupByMemberRequest, self).handle_request(parameters)
 
 
+class GroupGidsByMemberRequest(GroupByMemberRequest):
+
+    action = constants.NSLCD_ACTION_GROUP_GIDS_BYMEMBER
+
+    def handle_request(self, parameters):
+        # check whether requested user is in nss_initgroups_ignoreusers
+        if parameters['memberUid'] not in cfg.nss_initgroups_ignoreusers:
+            gids = [values[2] for values in self.get_results(parameters)]
+            if gids:
+                # write all group ids as a single result
+                self.fp.write_int32(constants.NSLCD_RESULT_BEGIN)
+                self.fp.write_int32(len(gids))
+                for gid in gids:
+                    self.fp.write_int32(gid)
+        # write the final result code
+        self.fp.write_int32(constants.NSLCD_RESULT_END)
+
+
 class GroupAllRequest(GroupRequest):
 
     action = constants.NSLCD_ACTION_GROUP_ALL
@@ -154,6 +154,28 @@ class PAMRequest(common.Request):
             logging.info('username changed from %r to %r', parameters['username'], value)
             parameters['username'] = value
 
+    def check_authz_search(self, parameters):
+        if not cfg.pam_authz_searches:
+            return
+        # escape all parameters
+        variables = dict((k, escape_filter_chars(v)) for k, v in parameters.items())
+        variables.update(
+            hostname=escape_filter_chars(socket.gethostname()),
+            fqdn=escape_filter_chars(socket.getfqdn()),
+            dn=variables['userdn'],
+            uid=variables['username'])
+        # go over all authz searches
+        for x in cfg.pam_authz_searches:
+            filter = x.value(variables)
+            logging.debug('trying pam_authz_search "%s"', filter)
+            srch = search.LDAPSearch(self.conn, filter=filter, attributes=('dn', ))
+            try:
+                dn, values = srch.items().next()
+            except StopIteration:
+                logging.error('pam_authz_search "%s" found no matches', filter)
+                raise
+            logging.debug('pam_authz_search found "%s"', dn)
+
 
 class PAMAuthenticationRequest(PAMRequest):
 
@@ -231,28 +253,6 @@ class PAMAuthorisationRequest(PAMRequest):
         self.fp.write_string(msg)
         self.fp.write_int32(constants.NSLCD_RESULT_END)
 
-    def check_authz_search(self, parameters):
-        if not cfg.pam_authz_searches:
-            return
-        # escape all parameters
-        variables = dict((k, escape_filter_chars(v)) for k, v in parameters.items())
-        variables.update(
-            hostname=escape_filter_chars(socket.gethostname()),
-            fqdn=escape_filter_chars(socket.getfqdn()),
-            dn=variables['userdn'],
-            uid=variables['username'])
-        # go over all authz searches
-        for x in cfg.pam_authz_searches:
-            filter = x.value(variables)
-            logging.debug('trying pam_authz_search "%s"', filter)
-            srch = search.LDAPSearch(self.conn, filter=filter, attributes=('dn', ))
-            try:
-                dn, values = srch.items().next()
-            except StopIteration:
-                logging.error('pam_authz_search "%s" found no matches', filter)
-                raise
-            logging.debug('pam_authz_search found "%s"', dn)
-
     def handle_request(self, parameters):
         # fill in any missing userdn, etc.
         self.validate(parameters)
@@ -366,6 +366,62 @@ class PAMSessionOpenRequest(PAMRequest):
         self.write(session_id)
 
 
+class PAMLoginRequest(PAMRequest):
+
+    action = constants.NSLCD_ACTION_PAM_LOGIN
+
+    def read_parameters(self, fp):
+        return dict(username=fp.read_string(),
+                    service=fp.read_string(),
+                    ruser=fp.read_string(),
+                    rhost=fp.read_string(),
+                    tty=fp.read_string(),
+                    password=fp.read_string())
+        # TODO: log call with parameters
+
+    def write(self, username, authc=constants.NSLCD_PAM_SUCCESS,
+              authz=constants.NSLCD_PAM_SUCCESS, msg='',
+              acct=constants.NSLCD_PAM_SUCCESS, acctmsg='', session_id=''):
+        self.fp.write_int32(constants.NSLCD_RESULT_BEGIN)
+        self.fp.write_int32(authc)
+        self.fp.write_string(username)
+        self.fp.write_int32(authz)
+        self.fp.write_string(msg)
+        self.fp.write_int32(acct)
+        self.fp.write_string(acctmsg)
+        self.fp.write_string(session_id)
+        self.fp.write_int32(constants.NSLCD_RESULT_END)
+
+    def handle_request(self, parameters):
+        # fill in any missing userdn, etc.
+        self.validate(parameters)
+        # try authentication
+        try:
+            conn, authz, msg = authenticate(parameters['userdn'], parameters['password'])
+        except ldap.INVALID_CREDENTIALS as e:
+            try:
+                msg = e[0]['desc']
+            except Exception:
+                msg = str(e)
+            logging.debug('bind failed: %s', msg)
+            self.write(parameters['username'], authc=constants.NSLCD_PAM_AUTH_ERR, msg=msg)
+            return
+        if authz != constants.NSLCD_PAM_SUCCESS:
+            logging.warning('%s: %s: %s', parameters['userdn'], parameters['username'], msg)
+        else:
+            logging.debug('bind successful')
+        # check authorisation search
+        acct, acctmsg = constants.NSLCD_PAM_SUCCESS, ''
+        try:
+            self.check_authz_search(parameters)
+        except StopIteration:
+            acct, acctmsg = constants.NSLCD_PAM_PERM_DENIED, 'LDAP authorisation check failed'
+        # FIXME: perform shadow attribute checks with check_shadow()
+        self.write(parameters['username'], authz=authz, msg=msg,
+                   acct=acct, acctmsg=acctmsg,
+                   session_id=generate_session_id())
+
+
 class PAMSessionCloseRequest(PAMRequest):
 
     action = constants.NSLCD_ACTION_PAM_SESS_C
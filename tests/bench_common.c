@@ -0,0 +1,140 @@
+/*
+   bench_common.c - time the checks and escaping done for every request
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <regex.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+#include "nslcd/common.h"
+#include "nslcd/cfg.h"
+#include "nslcd/log.h"
+
+static double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the escaping as it was done one character at a time, for comparison */
+static int escape_bytewise(const char *src, char *buffer, size_t buflen)
+{
+  size_t pos = 0;
+  for (; *src != '\0'; src++)
+  {
+    if ((pos + 4) >= buflen)
+      return -1;
+    if ((*src == '*') || (*src == '(') || (*src == ')') || (*src == '\\'))
+    {
+      buffer[pos++] = '\\';
+      buffer[pos++] = "0123456789abcdef"[((unsigned char)*src) >> 4];
+      buffer[pos++] = "0123456789abcdef"[((unsigned char)*src) & 0x0f];
+    }
+    else
+      buffer[pos++] = *src;
+  }
+  buffer[pos] = '\0';
+  return 0;
+}
+
+/* time the checks and the escaping that are done for every request */
+static void benchmark_kernels(int num)
+{
+  char (*names)[24], (*dns)[64];
+  char buffer[BUFLEN_SAFEDN], expected[BUFLEN_SAFEDN];
+  double start, t1, t2;
+  int i;
+  names = malloc(num * sizeof(*names));
+  dns = malloc(num * sizeof(*dns));
+  assert((names != NULL) && (dns != NULL));
+  for (i = 0; i < num; i++)
+  {
+    sprintf(names[i], "user%06d", i);
+    sprintf(dns[i], "uid=%s,ou=people,dc=example(%d),dc=com", names[i], i % 7);
+    /* check that the results are the same */
+    assert(myldap_escape(dns[i], buffer, sizeof(buffer)) == 0);
+    assert(escape_bytewise(dns[i], expected, sizeof(expected)) == 0);
+    assertstreq(buffer, expected);
+  }
+  /* validating names */
+  start = get_time();
+  for (i = 0; i < num; i++)
+    assert(regexec(&nslcd_cfg->validnames, names[i], 0, NULL, 0) == 0);
+  t1 = get_time() - start;
+  start = get_time();
+  for (i = 0; i < num; i++)
+    assert(isvalidname(names[i]));
+  t2 = get_time() - start;
+  printf("validnames:  regexec() %.1f ns, table %.1f ns per name\n",
+         t1 * 1e9 / num, t2 * 1e9 / num);
+  /* escaping names and DNs */
+  start = get_time();
+  for (i = 0; i < num; i++)
+    assert(escape_bytewise(names[i], buffer, sizeof(buffer)) == 0);
+  t1 = get_time() - start;
+  start = get_time();
+  for (i = 0; i < num; i++)
+    assert(myldap_escape(names[i], buffer, sizeof(buffer)) == 0);
+  t2 = get_time() - start;
+  printf("escape name: bytewise %.1f ns, myldap_escape() %.1f ns\n",
+         t1 * 1e9 / num, t2 * 1e9 / num);
+  start = get_time();
+  for (i = 0; i < num; i++)
+    assert(escape_bytewise(dns[i], buffer, sizeof(buffer)) == 0);
+  t1 = get_time() - start;
+  start = get_time();
+  for (i = 0; i < num; i++)
+    assert(myldap_escape(dns[i], buffer, sizeof(buffer)) == 0);
+  t2 = get_time() - start;
+  printf("escape DN:   bytewise %.1f ns, myldap_escape() %.1f ns\n",
+         t1 * 1e9 / num, t2 * 1e9 / num);
+  free(names);
+  free(dns);
+}
+
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *srcdir;
+  char fname[100];
+  /* build the name of the file */
+  srcdir = getenv("srcdir");
+  if (srcdir == NULL)
+    srcdir = ".";
+  snprintf(fname, sizeof(fname), "%s/nslcd-test.conf", srcdir);
+  fname[sizeof(fname) - 1] = '\0';
+  /* ensure that file is not world readable for configuration parsing to
+     succeed */
+  (void)chmod(fname, (mode_t)0660);
+  /* initialize configuration */
+  cfg_init(fname);
+  /* run the benchmarks */
+  benchmark_kernels(100000);
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+   bench_dict.c - time the basic operations of the dict module
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/dict.h"
+#include "compat/attrs.h"
+
+static double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Time filling the dictionary with num keys and looking up existing and
+   absent keys in a random order. */
+static void benchmark(const char *name, DICT *(*newdict)(void),
+                      const char *format, int num, int rounds)
+{
+  DICT *dict;
+  char **keys;
+  char *tmp;
+  int i, j, round;
+  double start, put, get, miss;
+  /* generate the keys and shuffle them */
+  keys = (char **)malloc(2 * num * sizeof(char *));
+  assert(keys != NULL);
+  for (i = 0; i < 2 * num; i++)
+  {
+    keys[i] = (char *)malloc(80);
+    assert(keys[i] != NULL);
+    sprintf(keys[i], format, i);
+  }
+  for (i = num - 1; i > 0; i--)
+  {
+    j = (int)((i + 1.0) * (rand() / (RAND_MAX + 1.0)));
+    tmp = keys[i];
+    keys[i] = keys[j];
+    keys[j] = tmp;
+  }
+  /* do the timing */
+  start = get_time();
+  for (round = 0; round < rounds; round++)
+  {
+    dict = newdict();
+    assert(dict != NULL);
+    for (i = 0; i < num; i++)
+      assert(dict_put(dict, keys[i], dict) == 0);
+    if (round < rounds - 1)
+      dict_free(dict);
+  }
+  put = get_time() - start;
+  start = get_time();
+  for (round = 0; round < rounds; round++)
+    for (i = 0; i < num; i++)
+      assert(dict_get(dict, keys[i]) == dict);
+  get = get_time() - start;
+  start = get_time();
+  for (round = 0; round < rounds; round++)
+    for (i = num; i < 2 * num; i++)
+      assert(dict_get(dict, keys[i]) == NULL);
+  miss = get_time() - start;
+  printf("%-22s %6d keys: put %6.1f ns, hit %6.1f ns, miss %6.1f ns\n",
+         name, num, put * 1e9 / (rounds * num), get * 1e9 / (rounds * num),
+         miss * 1e9 / (rounds * num));
+  dict_free(dict);
+  for (i = 0; i < 2 * num; i++)
+    free(keys[i]);
+  free(keys);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  benchmark("short keys", dict_new, "user%06d", 1000, 1000);
+  benchmark("short keys", dict_new, "user%06d", 100000, 10);
+  benchmark("DN keys", dict_new,
+            "uid=user%06d,ou=people,dc=example,dc=com", 1000, 1000);
+  benchmark("DN keys", dict_new,
+            "uid=user%06d,ou=people,dc=example,dc=com", 100000, 10);
+  benchmark("DN keys (ignorecase)", dict_new_ignorecase,
+            "uid=user%06d,ou=people,dc=example,dc=com", 1000, 1000);
+  return 0;
+}
@@ -0,0 +1,176 @@
+/*
+   bench_expr.c - time expanding expressions for a large enumeration
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/expr.h"
+#include "compat/attrs.h"
+
+/* the number of expressions that are expanded for each entry */
+#define NUM_EXPRS 3
+
+/* a simulated entry for the benchmark */
+struct bench_entry {
+  char uid[20];
+  char cn[30];
+  const char *gecos;
+  const char *homeDirectory;
+};
+
+/* look up the attribute by name like entry_expand() does */
+static const char *entryexpanderfn(const char *name, void *expander_attr)
+{
+  struct bench_entry *entry = (struct bench_entry *)expander_attr;
+  if (strcasecmp(name, "dn") == 0)
+    return "";
+  if (strcasecmp(name, "uid") == 0)
+    return entry->uid;
+  if (strcasecmp(name, "cn") == 0)
+    return entry->cn;
+  if (strcasecmp(name, "gecos") == 0)
+    return entry->gecos;
+  if (strcasecmp(name, "homeDirectory") == 0)
+    return entry->homeDirectory;
+  return NULL;
+}
+
+/* the attributes of the entry that variables can be resolved to */
+enum bench_attr { ATTR_NONE, ATTR_UID, ATTR_CN, ATTR_GECOS, ATTR_HOMEDIR };
+
+static enum bench_attr resolve_attr(const char *name)
+{
+  if (strcasecmp(name, "uid") == 0)
+    return ATTR_UID;
+  if (strcasecmp(name, "cn") == 0)
+    return ATTR_CN;
+  if (strcasecmp(name, "gecos") == 0)
+    return ATTR_GECOS;
+  if (strcasecmp(name, "homeDirectory") == 0)
+    return ATTR_HOMEDIR;
+  return ATTR_NONE;
+}
+
+/* the variables of an expression resolved to attributes of the entry */
+struct bench_slots {
+  struct bench_entry *entry;
+  const enum bench_attr *attrs;
+};
+
+static const char *slotexpanderfn(int var, void *expander_attr)
+{
+  struct bench_slots *slots = (struct bench_slots *)expander_attr;
+  switch (slots->attrs[var])
+  {
+    case ATTR_UID:     return slots->entry->uid;
+    case ATTR_CN:      return slots->entry->cn;
+    case ATTR_GECOS:   return slots->entry->gecos;
+    case ATTR_HOMEDIR: return slots->entry->homeDirectory;
+    case ATTR_NONE:
+    default:           return NULL;
+  }
+}
+
+static double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* time expanding the default passwd expressions for a large enumeration */
+static void benchmark_enumeration(int num)
+{
+  static const char *exprs[NUM_EXPRS] = {
+    "\"${gecos:-$cn}\"",
+    "\"${homeDirectory:-/home/$uid}\"",
+    "\"${loginShell:-/bin/sh}\""
+  };
+  EXPR *compiled[NUM_EXPRS];
+  enum bench_attr attrs[NUM_EXPRS][4];
+  struct bench_entry *entries;
+  struct bench_slots slots;
+  char buffer[256];
+  double start, parsed, evaluated, slotted;
+  const char *name;
+  int i, j;
+  for (j = 0; j < NUM_EXPRS; j++)
+  {
+    compiled[j] = expr_compile(exprs[j] + 1);
+    assert(compiled[j] != NULL);
+    for (i = 0; (name = expr_var(compiled[j], i)) != NULL; i++)
+    {
+      assert(i < 4);
+      attrs[j][i] = resolve_attr(name);
+    }
+  }
+  /* generate the entries */
+  entries = (struct bench_entry *)malloc(num * sizeof(struct bench_entry));
+  assert(entries != NULL);
+  for (i = 0; i < num; i++)
+  {
+    sprintf(entries[i].uid, "user%06d", i);
+    sprintf(entries[i].cn, "User Number %d", i);
+    entries[i].gecos = (i % 2) ? "Some User" : NULL;
+    entries[i].homeDirectory = (i % 3) ? "/srv/home/user" : NULL;
+  }
+  start = get_time();
+  for (i = 0; i < num; i++)
+    for (j = 0; j < NUM_EXPRS; j++)
+      assert(expr_parse(exprs[j] + 1, buffer, sizeof(buffer),
+                        entryexpanderfn, &entries[i]) != NULL);
+  parsed = get_time() - start;
+  start = get_time();
+  for (i = 0; i < num; i++)
+    for (j = 0; j < NUM_EXPRS; j++)
+      assert(expr_eval(compiled[j], buffer, sizeof(buffer),
+                       entryexpanderfn, &entries[i]) != NULL);
+  evaluated = get_time() - start;
+  start = get_time();
+  for (i = 0; i < num; i++)
+    for (j = 0; j < NUM_EXPRS; j++)
+    {
+      slots.entry = &entries[i];
+      slots.attrs = attrs[j];
+      assert(expr_eval_slots(compiled[j], buffer, sizeof(buffer),
+                             slotexpanderfn, &slots) != NULL);
+    }
+  slotted = get_time() - start;
+  printf("%d entries: expr_parse() %.1f ns, expr_eval() %.1f ns, "
+         "expr_eval_slots() %.1f ns per entry\n",
+         num, parsed * 1e9 / num, evaluated * 1e9 / num,
+         slotted * 1e9 / num);
+  for (j = 0; j < NUM_EXPRS; j++)
+    expr_free(compiled[j]);
+  free(entries);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  benchmark_enumeration(100000);
+  return EXIT_SUCCESS;
+}
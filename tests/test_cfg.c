@@ -205,6 +205,7 @@ static void test_read(void)
           "map\tpasswd uid\t\tsAMAccountName\n"
           "map passwd homeDirectory \"${homeDirectory:-/home/$uid}\"  \n"
           "map    passwd gecos            \"${givenName}. ${sn}\"\n"
+          "map passwd memberOf isMemberOf\n"
           "filter group (&(objeclClass=posixGroup)(gid=1*))\n"
           "\n"
           "scope passwd one\n"
@@ -226,6 +227,7 @@ static void test_read(void)
   assertstreq(attmap_passwd_uid, "sAMAccountName");
   assertstreq(attmap_passwd_homeDirectory, "\"${homeDirectory:-/home/$uid}\"");
   assertstreq(attmap_passwd_gecos, "\"${givenName}. ${sn}\"");
+  assertstreq(attmap_passwd_memberOf, "isMemberOf");
   assertstreq(group_filter, "(&(objeclClass=posixGroup)(gid=1*))");
   assert(passwd_scope == LDAP_SCOPE_ONELEVEL);
   assert(cfg.cache_dn2uid_positive == 10 * 60);
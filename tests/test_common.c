@@ -23,8 +23,16 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
+#include <regex.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "common.h"
 
 #include "nslcd/common.h"
 #include "nslcd/cfg.h"
@@ -44,6 +52,168 @@ static void test_isvalidname(void)
   assert(isvalidname("(foo bar)"));
 }
 
+/* check that the table that is used for the default validnames expression
+   gives the same results as the regular expression */
+static void test_isvalidname_table(void)
+{
+  static const char *names[] = {
+    "", " ", "a", "~", "a~", "~a", "a b", "a  b", "a ", " a", "a\\", "\\a",
+    "a\\b", "$", "a-", "-a", "a~b", "A(b)C", "user@EXAMPLE.COM", NULL
+  };
+  char name[8];
+  int c, i;
+  assert(nslcd_cfg->validnames_default);
+  for (i = 0; names[i] != NULL; i++)
+    assert(isvalidname(names[i]) ==
+           (regexec(&nslcd_cfg->validnames, names[i], 0, NULL, 0) == 0));
+  /* try every character at the start, in the middle and at the end */
+  for (c = 1; c < 256; c++)
+  {
+    for (i = 0; i < 5; i++)
+    {
+      strcpy(name, "aaa");
+      switch (i)
+      {
+        case 0: name[1] = '\0'; /* fall through */
+        case 1: name[0] = (char)c; break;
+        case 2: name[1] = (char)c; break;
+        case 3: name[2] = (char)c; break;
+        case 4: name[0] = name[1] = name[2] = (char)c; break;
+      }
+      assert(isvalidname(name) ==
+             (regexec(&nslcd_cfg->validnames, name, 0, NULL, 0) == 0));
+    }
+  }
+}
+
+static void test_memberlist(void)
+{
+  MEMBERLIST *list, *other;
+  TFILE *fp;
+  int sp[2];
+  char buf[64];
+  char name[32];
+  uint32_t tmp;
+  int i;
+  list = memberlist_new();
+  assert(list != NULL);
+  assert(memberlist_size(list) == 0);
+  /* duplicates should only be added once */
+  assert(memberlist_add(list, "arthur") == 0);
+  assert(memberlist_add(list, "bob") == 0);
+  assert(memberlist_add(list, "arthur") == 0);
+  assert(memberlist_size(list) == 2);
+  /* add enough names to grow the buffer and the hashtable */
+  other = memberlist_new();
+  assert(other != NULL);
+  for (i = 0; i < 5000; i++)
+  {
+    snprintf(name, sizeof(name), "user%d", i % 2500);
+    assert(memberlist_add(other, name) == 0);
+  }
+  assert(memberlist_add(other, "bob") == 0);
+  assert(memberlist_size(other) == 2501);
+  assert(memberlist_addall(other, list) == 0);
+  assert(memberlist_size(other) == 2502);
+  memberlist_free(other);
+  /* check that the list is written in the protocol format */
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+  fp = tio_fdopen(sp[0], 1000, 1000, 64, 64, 64, 1024);
+  assert(fp != NULL);
+  assert(memberlist_write(fp, list) == 0);
+  assert(memberlist_write(fp, NULL) == 0);
+  assert(tio_flush(fp) == 0);
+  assert(read(sp[1], buf, 25) == 25);
+  memcpy(&tmp, buf, sizeof(uint32_t));
+  assert(ntohl(tmp) == 2);
+  memcpy(&tmp, buf + 4, sizeof(uint32_t));
+  assert(ntohl(tmp) == 6);
+  assert(memcmp(buf + 8, "arthur", 6) == 0);
+  memcpy(&tmp, buf + 14, sizeof(uint32_t));
+  assert(ntohl(tmp) == 3);
+  assert(memcmp(buf + 18, "bob", 3) == 0);
+  memcpy(&tmp, buf + 21, sizeof(uint32_t));
+  assert(ntohl(tmp) == 0);
+  (void)tio_close(fp);
+  close(sp[1]);
+  memberlist_free(list);
+}
+
+static void test_filter_template(void)
+{
+  FILTER_TEMPLATE tmpl;
+  char buffer[BUFLEN_FILTER];
+  char safename[BUFLEN_SAFENAME];
+  char expected[BUFLEN_FILTER];
+  size_t i, len;
+  filter_template_init(&tmpl, "(objectClass=posixAccount)", "uid");
+  assert(filter_template_build(&tmpl, "t*st(\\)", buffer, sizeof(buffer)) == 0);
+  assertstreq(buffer, "(&(objectClass=posixAccount)(uid=t\\2ast\\28\\5c\\29))");
+  /* the result should be the same as building it the old way */
+  assert(myldap_escape("arthur", safename, sizeof(safename)) == 0);
+  assert(mysnprintf(expected, sizeof(expected), "(&%s(%s=%s))",
+                    "(objectClass=posixAccount)", "uid", safename) == 0);
+  assert(filter_template_build(&tmpl, "arthur", buffer, sizeof(buffer)) == 0);
+  assertstreq(buffer, expected);
+  /* numbers */
+  assert(filter_template_build_int(&tmpl, 0, buffer, sizeof(buffer)) == 0);
+  assertstreq(buffer, "(&(objectClass=posixAccount)(uid=0))");
+  assert(filter_template_build_int(&tmpl, -42, buffer, sizeof(buffer)) == 0);
+  assertstreq(buffer, "(&(objectClass=posixAccount)(uid=-42))");
+  assert(filter_template_build_uint(&tmpl, 4294967295UL,
+                                    buffer, sizeof(buffer)) == 0);
+  assertstreq(buffer, "(&(objectClass=posixAccount)(uid=4294967295))");
+  /* buffers that are too small should fail */
+  len = strlen("(&(objectClass=posixAccount)(uid=1234))");
+  for (i = 1; i <= len; i++)
+    assert(filter_template_build_int(&tmpl, 1234, buffer, i) != 0);
+  assert(filter_template_build_int(&tmpl, 1234, buffer, len + 1) == 0);
+  for (i = 1; i < 30; i++)
+    assert(filter_template_build(&tmpl, "a*", buffer, i) != 0);
+  free(tmpl.prefix);
+}
+
+/* the escaping as it was done one character at a time, for comparison */
+static int escape_bytewise(const char *src, char *buffer, size_t buflen)
+{
+  size_t pos = 0;
+  for (; *src != '\0'; src++)
+  {
+    if ((pos + 4) >= buflen)
+      return -1;
+    if ((*src == '*') || (*src == '(') || (*src == ')') || (*src == '\\'))
+    {
+      buffer[pos++] = '\\';
+      buffer[pos++] = "0123456789abcdef"[((unsigned char)*src) >> 4];
+      buffer[pos++] = "0123456789abcdef"[((unsigned char)*src) & 0x0f];
+    }
+    else
+      buffer[pos++] = *src;
+  }
+  buffer[pos] = '\0';
+  return 0;
+}
+
+/* check that myldap_escape() escapes names and DNs in the same way as
+   escaping one character at a time */
+static void test_myldap_escape(void)
+{
+  char name[24], dn[64];
+  char buffer[BUFLEN_SAFEDN], expected[BUFLEN_SAFEDN];
+  int i;
+  for (i = 0; i < 1000; i++)
+  {
+    sprintf(name, "user%06d", i);
+    sprintf(dn, "uid=%s,ou=people,dc=example(%d),dc=com", name, i % 7);
+    assert(myldap_escape(name, buffer, sizeof(buffer)) == 0);
+    assert(escape_bytewise(name, expected, sizeof(expected)) == 0);
+    assertstreq(buffer, expected);
+    assert(myldap_escape(dn, buffer, sizeof(buffer)) == 0);
+    assert(escape_bytewise(dn, expected, sizeof(expected)) == 0);
+    assertstreq(buffer, expected);
+  }
+}
+
 /* the main program... */
 int main(int UNUSED(argc), char UNUSED(*argv[]))
 {
@@ -64,5 +234,9 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   log_setdefaultloglevel(LOG_DEBUG);
   /* run the tests */
   test_isvalidname();
+  test_isvalidname_table();
+  test_memberlist();
+  test_filter_template();
+  test_myldap_escape();
   return 0;
 }
@@ -177,6 +177,82 @@ static void test_countelements(int num)
   free(keys);
 }
 
+/* Test the dictionary that ignores case of the keys. */
+static void test_ignorecase(void)
+{
+  DICT *dict;
+  static char *value1 = "value1";
+  static char *value2 = "value2";
+  static char *value3 = "value3";
+  const char **keys;
+  int i;
+  dict = dict_new_ignorecase();
+  assert(dict != NULL);
+  assert(dict_put(dict, "Key1", value1) == 0);
+  assert(dict_put(dict, "cn=Test,DC=Example,dc=com", value2) == 0);
+  assert(dict_get(dict, "key1") == value1);
+  assert(dict_get(dict, "KEY1") == value1);
+  assert(dict_get(dict, "key2") == NULL);
+  assert(dict_get(dict, "CN=test,dc=example,DC=COM") == value2);
+  /* only ASCII letters are folded */
+  assert(dict_get(dict, "key1\xc3\xa9") == NULL);
+  assert(dict_put(dict, "@[`{", value3) == 0);
+  assert(dict_get(dict, "`{@[") == NULL);
+  assert(dict_get(dict, "@[`{") == value3);
+  /* replacing keeps the originally stored key */
+  assert(dict_put(dict, "KEY1", value3) == 0);
+  assert(dict_get(dict, "key1") == value3);
+  keys = dict_keys(dict);
+  assert(keys != NULL);
+  for (i = 0; keys[i] != NULL; i++)
+    assert(dict_get(dict, keys[i]) != NULL);
+  assert(i == 3);
+  free(keys);
+  /* remove using a different case */
+  assert(dict_put(dict, "Cn=Test,Dc=Example,Dc=Com", NULL) == 0);
+  assert(dict_get(dict, "cn=Test,DC=Example,dc=com") == NULL);
+  dict_free(dict);
+}
+
+/* Test random additions and removals of short and long keys against a
+   simple array of the expected contents. */
+static void test_removal(void)
+{
+  DICT *dict;
+  char buf[80];
+  static int present[2000];
+  int i, r;
+  dict = dict_new();
+  assert(dict != NULL);
+  for (i = 0; i < 100000; i++)
+  {
+    r = (int)(2000.0 * (rand() / (RAND_MAX + 1.0)));
+    if (r % 2)
+      sprintf(buf, "uid=user%04d,ou=people,dc=example,dc=com", r);
+    else
+      sprintf(buf, "user%04d", r);
+    if (rand() % 3)
+    {
+      assert(dict_put(dict, buf, &present[r]) == 0);
+      present[r] = 1;
+    }
+    else
+    {
+      assert(dict_put(dict, buf, NULL) == 0);
+      present[r] = 0;
+    }
+  }
+  for (r = 0; r < 2000; r++)
+  {
+    if (r % 2)
+      sprintf(buf, "uid=user%04d,ou=people,dc=example,dc=com", r);
+    else
+      sprintf(buf, "user%04d", r);
+    assert(dict_get(dict, buf) == (present[r] ? &present[r] : NULL));
+  }
+  dict_free(dict);
+}
+
 /* the main program... */
 int main(int UNUSED(argc), char UNUSED(*argv[]))
 {
@@ -200,5 +276,7 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   test_countelements(4);
   test_countelements(10);
   test_countelements(20);
+  test_ignorecase();
+  test_removal();
   return 0;
 }
@@ -162,6 +162,139 @@ static void test_expr_vars(void)
   set_free(set);
 }
 
+/* count the number of calls to the expander */
+static int num_expands = 0;
+
+static const char *countingexpanderfn(const char *name, void *expander_attr)
+{
+  num_expands++;
+  return expanderfn(name, expander_attr);
+}
+
+/* check that the compiled expression gives the same result as parsing */
+static void check_compiled(const char *expr)
+{
+  char buffer1[1024], buffer2[1024];
+  EXPR *compiled;
+  compiled = expr_compile(expr);
+  assert(compiled != NULL);
+  assert(expr_parse(expr, buffer1, sizeof(buffer1), expanderfn, NULL) != NULL);
+  assert(expr_eval(compiled, buffer2, sizeof(buffer2), expanderfn, NULL) != NULL);
+  assertstreq(buffer2, buffer1);
+  expr_free(compiled);
+}
+
+static void test_expr_compile(void)
+{
+  char buffer[10];
+  char largebuffer[100];
+  EXPR *expr;
+  check_compiled("");
+  check_compiled("$test1");
+  check_compiled("\\$test1");
+  check_compiled("$empty");
+  check_compiled("$foo1$empty-$foo2");
+  check_compiled("$foo1+$null+$foo2");
+  check_compiled("${test1}\\$");
+  check_compiled("${test1:-default}");
+  check_compiled("${empty:-default}");
+  check_compiled("${test1:+setset}");
+  check_compiled("${empty:+setset}");
+  check_compiled("${empty:-$test1}");
+  check_compiled("a/$test1/b");
+  check_compiled("a/$empty/b");
+  check_compiled("a${test1}b");
+  check_compiled("a${test1}b${test2:+${test3:-d$test4}e}c");
+  check_compiled("a${test1}b${test2:+${empty:-d$test4}e}c");
+  check_compiled("${test1#foo}");
+  check_compiled("${test1#zoo}");
+  check_compiled("${test1#?oo}");
+  check_compiled("${test1#f\\?o}");
+  check_compiled("${test1#foobarbaz}");
+  check_compiled("${userPassword#{crypt\\}}");
+  check_compiled("${test1:0:6}");
+  check_compiled("${test1:0:10}");
+  check_compiled("${test1:0:3}");
+  check_compiled("${test1:3:0}");
+  check_compiled("${test1:3:6}");
+  check_compiled("${test1:7:0}");
+  check_compiled("${test1:7:3}");
+  check_compiled("\"${gecos:-$cn}\"");
+  check_compiled("\"${homeDirectory;foo:-/home/$uid}\"");
+  /* these are errors */
+  assert(expr_compile("$&") == NULL);
+  assert(expr_compile("${a") == NULL);
+  assert(expr_compile("${a:-b") == NULL);
+  assert(expr_compile("${a#b") == NULL);
+  assert(expr_compile("${a:1}") == NULL);
+  assert(expr_compile("${a?}") == NULL);
+  assert(expr_compile("abc\\") == NULL);
+  /* variables are only expanded once */
+  expr = expr_compile("$a${a}${a:-x}${empty:-$a}$empty");
+  assert(expr != NULL);
+  num_expands = 0;
+  assert(expr_eval(expr, largebuffer, sizeof(largebuffer), countingexpanderfn, NULL) != NULL);
+  assertstreq(largebuffer, "foobarfoobarfoobarfoobar");
+  assert(num_expands == 2);
+  expr_free(expr);
+  /* results that do not fit */
+  expr = expr_compile("$test1$empty$test1");
+  assert(expr != NULL);
+  assert(expr_eval(expr, buffer, sizeof(buffer), expanderfn, NULL) == NULL);
+  expr_free(expr);
+  expr = expr_compile("${empty:-long test value}");
+  assert(expr != NULL);
+  assert(expr_eval(expr, buffer, sizeof(buffer), expanderfn, NULL) == NULL);
+  expr_free(expr);
+  expr = expr_compile("123456789");
+  assert(expr != NULL);
+  assert(expr_eval(expr, buffer, sizeof(buffer), expanderfn, NULL) != NULL);
+  assertstreq(buffer, "123456789");
+  expr_free(expr);
+}
+
+/* expander that is passed the variable index, the values are resolved
+   by the test */
+static const char *slotexpanderfn(int var, void *expander_attr)
+{
+  const char **slots = (const char **)expander_attr;
+  num_expands++;
+  return slots[var];
+}
+
+static void test_expr_slots(void)
+{
+  char buffer[100];
+  const char *slots[3];
+  const char *name;
+  EXPR *expr;
+  int i;
+  expr = expr_compile("${gecos:-$cn}/$uid/$cn");
+  assert(expr != NULL);
+  /* each variable is listed once */
+  for (i = 0; (name = expr_var(expr, i)) != NULL; i++)
+  {
+    assert(i < 3);
+    if (strcmp(name, "gecos") == 0)
+      slots[i] = "";
+    else if (strcmp(name, "cn") == 0)
+      slots[i] = "Arthur Dent";
+    else if (strcmp(name, "uid") == 0)
+      slots[i] = "arthur";
+    else
+      assert(0);
+  }
+  assert(i == 3);
+  assert(expr_var(expr, -1) == NULL);
+  num_expands = 0;
+  assert(expr_eval_slots(expr, buffer, sizeof(buffer),
+                         slotexpanderfn, slots) != NULL);
+  assertstreq(buffer, "Arthur Dent/arthur/Arthur Dent");
+  /* every variable is expanded only once */
+  assert(num_expands == 3);
+  expr_free(expr);
+}
+
 /* the main program... */
 int main(int UNUSED(argc), char UNUSED(*argv[]))
 {
@@ -169,5 +302,7 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   test_expr_parse();
   test_buffer_overflow();
   test_expr_vars();
+  test_expr_compile();
+  test_expr_slots();
   return EXIT_SUCCESS;
 }
@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
@@ -31,6 +32,7 @@
 
 #include "common.h"
 
+#include "common/set.h"
 #include "nslcd/log.h"
 #include "nslcd/cfg.h"
 #include "nslcd/myldap.h"
@@ -249,6 +251,107 @@ static void test_get_rdnvalues(void)
            rdnval == NULL ? "NULL" : rdnval);
 }
 
+/* count the entries that are returned by the search (the DNs are added to
+   the set if one is passed) */
+static int count_entries(MYLDAP_SEARCH *search, SET *dns)
+{
+  MYLDAP_ENTRY *entry;
+  int i, rc;
+  for (i = 0; (entry = myldap_get_entry(search, &rc)) != NULL; i++)
+  {
+    if (dns != NULL)
+      assert(set_add(dns, myldap_get_dn(entry)) == 0);
+  }
+  assert(rc == LDAP_SUCCESS);
+  return i;
+}
+
+/* this method tests that searches that return multiple pages of results
+   return the same entries as a search without paging */
+static void test_paged_search(void)
+{
+  MYLDAP_SESSION *session;
+  MYLDAP_SEARCH *search1, *search2;
+  MYLDAP_ENTRY *entry;
+  const char *attrs[] = { "uid", "uidNumber", NULL };
+  SET *dns;
+  const char **keys;
+  int oldpagesize = nslcd_cfg->pagesize;
+  int expected, num1, num2, i;
+  int rc1, rc2;
+  /* initialize session */
+  printf("test_myldap: test_paged_search(): getting session...\n");
+  session = myldap_create_session();
+  assert(session != NULL);
+  /* get the number of entries without paging */
+  nslcd_cfg->pagesize = 0;
+  search1 = myldap_search(session, nslcd_cfg->bases[0], LDAP_SCOPE_SUBTREE,
+                          "(objectClass=posixAccount)", attrs, NULL);
+  assert(search1 != NULL);
+  expected = count_entries(search1, NULL);
+  printf("test_myldap: test_paged_search(): %d entries without paging\n",
+         expected);
+  /* use a page size that results in many pages */
+  nslcd_cfg->pagesize = 7;
+  dns = set_new();
+  assert(dns != NULL);
+  search1 = myldap_search(session, nslcd_cfg->bases[0], LDAP_SCOPE_SUBTREE,
+                          "(objectClass=posixAccount)", attrs, NULL);
+  assert(search1 != NULL);
+  num1 = count_entries(search1, dns);
+  printf("test_myldap: test_paged_search(): %d entries with paging\n", num1);
+  assert(num1 == expected);
+  /* every entry should have been returned once */
+  keys = set_tolist(dns);
+  assert(keys != NULL);
+  for (i = 0; keys[i] != NULL; i++)
+    /* nothing */ ;
+  assert(i == expected);
+  free(keys);
+  set_free(dns);
+  /* interleave two paged searches on the same session */
+  search1 = myldap_search(session, nslcd_cfg->bases[0], LDAP_SCOPE_SUBTREE,
+                          "(objectClass=posixAccount)", attrs, NULL);
+  assert(search1 != NULL);
+  search2 = myldap_search(session, nslcd_cfg->bases[0], LDAP_SCOPE_SUBTREE,
+                          "(objectClass=posixAccount)", attrs, NULL);
+  assert(search2 != NULL);
+  num1 = num2 = 0;
+  rc1 = rc2 = LDAP_SUCCESS;
+  while ((search1 != NULL) || (search2 != NULL))
+  {
+    if (search1 != NULL)
+    {
+      if (myldap_get_entry(search1, &rc1) != NULL)
+        num1++;
+      else
+        search1 = NULL;
+    }
+    if (search2 != NULL)
+    {
+      if (myldap_get_entry(search2, &rc2) != NULL)
+        num2++;
+      else
+        search2 = NULL;
+    }
+  }
+  assert((rc1 == LDAP_SUCCESS) && (rc2 == LDAP_SUCCESS));
+  assert((num1 == expected) && (num2 == expected));
+  /* stop a paged search half way through a page */
+  search1 = myldap_search(session, nslcd_cfg->bases[0], LDAP_SCOPE_SUBTREE,
+                          "(objectClass=posixAccount)", attrs, NULL);
+  assert(search1 != NULL);
+  for (i = 0; i < 10; i++)
+  {
+    entry = myldap_get_entry(search1, NULL);
+    assert(entry != NULL);
+  }
+  myldap_search_close(search1);
+  /* clean up */
+  nslcd_cfg->pagesize = oldpagesize;
+  myldap_session_close(session);
+}
+
 /* this method tests to see if we can perform two searches within
    one session */
 static void test_two_searches(void)
@@ -439,6 +542,7 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   test_get_values();
   test_get_rdnvalues();
   test_two_searches();
+  test_paged_search();
   test_threads();
   test_connections();
   test_escape();
@@ -0,0 +1,112 @@
+/*
+   test_myldap_allocs.c - count the memory allocations done for searches
+                          and entries by the myldap module
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+/* the number of requests to handle */
+#define NUM_REQUESTS 1000
+
+/* the number of values and the size of each value that is stored with
+   the entry of each request (more than fits in a single chunk) */
+#define NUM_VALUES 30
+#define VALUE_SIZE 200
+
+/* count the allocations that are done from the myldap module */
+static int num_allocs = 0;
+#define malloc(size) (num_allocs++, malloc(size))
+#define realloc(ptr, size) (num_allocs++, realloc(ptr, size))
+
+/* we include the source because we want to count the allocations */
+#include "../nslcd/myldap.c"
+
+/* handle a request like the request handlers do: start a search, get an
+   entry, store some values with it and close the search */
+static void handle_request(MYLDAP_SESSION *session, const char *filter)
+{
+  static const char *attrs[] = { "uid", "uidNumber", "gidNumber", NULL };
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  char *value;
+  int i;
+  search = myldap_search_new(session, "dc=test,dc=tld", LDAP_SCOPE_SUBTREE,
+                             filter, attrs);
+  entry = myldap_entry_new(search);
+  search->entry = entry;
+  for (i = 0; i < NUM_VALUES; i++)
+  {
+    value = myldap_entry_alloc(entry, VALUE_SIZE);
+    assert(value != NULL);
+    memset(value, 'x', VALUE_SIZE);
+  }
+  myldap_search_close(search);
+}
+
+/* the memory of closed searches and entries should be re-used by the
+   following requests on the same session */
+static void test_reuse(void)
+{
+  MYLDAP_SESSION *session;
+  int i, first;
+  session = myldap_create_session();
+  num_allocs = 0;
+  handle_request(session, "(&(objectClass=posixAccount)(uid=arthur))");
+  first = num_allocs;
+  /* the search, the entry and two chunks for the values */
+  assert(first == 4);
+  for (i = 0; i < NUM_REQUESTS; i++)
+    handle_request(session, "(&(objectClass=posixAccount)(uid=zaphod))");
+  printf("test_myldap_allocs: %d allocations for %d requests\n",
+         num_allocs, NUM_REQUESTS + 1);
+  assert(num_allocs == first);
+  /* a search with a longer filter needs a bigger block */
+  handle_request(session, "(&(objectClass=posixAccount)(uid=arthur-dent-the-long))");
+  assert(num_allocs == first + 1);
+  myldap_session_close(session);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *srcdir;
+  char fname[100];
+  /* build the name of the file */
+  srcdir = getenv("srcdir");
+  if (srcdir == NULL)
+    srcdir = ".";
+  snprintf(fname, sizeof(fname), "%s/nslcd-test.conf", srcdir);
+  fname[sizeof(fname) - 1] = '\0';
+  /* ensure that file is not world readable for configuration parsing to
+     succeed */
+  (void)chmod(fname, (mode_t)0660);
+  /* initialize configuration */
+  cfg_init(fname);
+  /* partially initialize logging */
+  log_setdefaultloglevel(LOG_DEBUG);
+  /* run the tests */
+  test_reuse();
+  return 0;
+}
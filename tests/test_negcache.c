@@ -0,0 +1,196 @@
+/*
+   test_negcache.c - check that found entries are not negatively cached
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "common.h"
+
+/* replace the LDAP functions that are used by the request handlers with
+   ones that return a single prepared entry */
+#define myldap_search test_search
+#define myldap_get_entry test_get_entry
+#define myldap_search_close test_search_close
+#define myldap_get_dn test_get_dn
+#define myldap_get_values test_get_values
+#define myldap_get_rdn_value test_get_rdn_value
+
+/* we include the sources because we want the handlers to use the above */
+#include "../nslcd/alias.c"
+#include "../nslcd/ether.c"
+#include "../nslcd/host.c"
+#include "../nslcd/netgroup.c"
+#include "../nslcd/network.c"
+#include "../nslcd/protocol.c"
+#include "../nslcd/rpc.c"
+#include "../nslcd/service.c"
+
+/* the number of searches that were started */
+static int num_searches = 0;
+
+/* whether the search should return the entry */
+static int have_entry = 0;
+
+/* the search and entry that are handed out (never dereferenced) */
+static int dummy_search, dummy_entry;
+static int entry_returned = 0;
+
+MYLDAP_SEARCH *test_search(MYLDAP_SESSION UNUSED(*session),
+                           const char UNUSED(*base), int UNUSED(scope),
+                           const char UNUSED(*filter),
+                           const char UNUSED(**attrs), int *rcp)
+{
+  num_searches++;
+  entry_returned = 0;
+  if (rcp != NULL)
+    *rcp = LDAP_SUCCESS;
+  return (MYLDAP_SEARCH *)&dummy_search;
+}
+
+MYLDAP_ENTRY *test_get_entry(MYLDAP_SEARCH UNUSED(*search), int *rcp)
+{
+  if (rcp != NULL)
+    *rcp = LDAP_SUCCESS;
+  if ((!have_entry) || (entry_returned))
+    return NULL;
+  entry_returned = 1;
+  return (MYLDAP_ENTRY *)&dummy_entry;
+}
+
+void test_search_close(MYLDAP_SEARCH UNUSED(*search))
+{
+}
+
+const char *test_get_dn(MYLDAP_ENTRY UNUSED(*entry))
+{
+  return "cn=test,dc=test,dc=tld";
+}
+
+/* the values of the attributes of the entry */
+static struct {
+  const char *attr;
+  const char *values[2];
+} test_values[] = {
+  { "cn", { "test", NULL } },
+  { "rfc822MailMember", { "arthur@example.com", NULL } },
+  { "macAddress", { "0:1:2:3:4:5", NULL } },
+  { "ipHostNumber", { "192.0.2.1", NULL } },
+  { "nisNetgroupTriple", { "(host,user,domain)", NULL } },
+  { "ipNetworkNumber", { "192.0.2.0", NULL } },
+  { "ipProtocolNumber", { "6", NULL } },
+  { "oncRpcNumber", { "100000", NULL } },
+  { "ipServicePort", { "22", NULL } },
+  { "ipServiceProtocol", { "tcp", NULL } },
+  { NULL, { NULL, NULL } }
+};
+
+const char **test_get_values(MYLDAP_ENTRY UNUSED(*entry), const char *attr)
+{
+  int i;
+  for (i = 0; test_values[i].attr != NULL; i++)
+    if (strcasecmp(test_values[i].attr, attr) == 0)
+      return test_values[i].values;
+  return NULL;
+}
+
+const char *test_get_rdn_value(MYLDAP_ENTRY UNUSED(*entry),
+                               const char UNUSED(*attr))
+{
+  return "test";
+}
+
+typedef int (*handler_fn)(TFILE *fp, MYLDAP_SESSION *session);
+
+/* pass a by-name request with the name test (and for services the protocol
+   tcp) to the handler and return the number of started searches */
+static int do_request(handler_fn handler, int withprotocol)
+{
+  int32_t tmpint32;
+  int sp[2];
+  TFILE *fp, *peer;
+  num_searches = 0;
+  assertok(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+  fp = tio_fdopen(sp[0], 1000, 1000, 1024, 2 * 1024, 1024, 16 * 1024);
+  peer = tio_fdopen(sp[1], 1000, 1000, 1024, 16 * 1024, 1024, 2 * 1024);
+  assert((fp != NULL) && (peer != NULL));
+  /* write the request parameters */
+  WRITE_STRING(peer, "test");
+  if (withprotocol)
+  {
+    WRITE_STRING(peer, "tcp");
+  }
+  assertok(tio_flush(peer) == 0);
+  /* handle the request */
+  assert(handler(fp, NULL) == 0);
+  (void)tio_close(fp);
+  (void)tio_close(peer);
+  return num_searches;
+}
+
+/* a found entry should be searched for again while a lookup without
+   results is answered from the cache */
+static void test_handler(handler_fn handler, int withprotocol)
+{
+  negcache_clear();
+  have_entry = 1;
+  assert(do_request(handler, withprotocol) == 1);
+  assert(do_request(handler, withprotocol) == 1);
+  have_entry = 0;
+  assert(do_request(handler, withprotocol) == 1);
+  assert(do_request(handler, withprotocol) == 0);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *srcdir;
+  char fname[100];
+  /* build the name of the file */
+  srcdir = getenv("srcdir");
+  if (srcdir == NULL)
+    srcdir = ".";
+  snprintf(fname, sizeof(fname), "%s/nslcd-test.conf", srcdir);
+  fname[sizeof(fname) - 1] = '\0';
+  /* ensure that file is not world readable for configuration parsing to
+     succeed */
+  (void)chmod(fname, (mode_t)0660);
+  /* initialize configuration and enable the cache */
+  cfg_init(fname);
+  nslcd_cfg->cache_notfound = 60;
+  /* partially initialize logging */
+  log_setdefaultloglevel(LOG_DEBUG);
+  /* run the tests */
+  test_handler(nslcd_alias_byname, 0);
+  test_handler(nslcd_ether_byname, 0);
+  test_handler(nslcd_host_byname, 0);
+  test_handler(nslcd_netgroup_byname, 0);
+  test_handler(nslcd_network_byname, 0);
+  test_handler(nslcd_protocol_byname, 0);
+  test_handler(nslcd_rpc_byname, 0);
+  test_handler(nslcd_service_byname, 1);
+  return 0;
+}
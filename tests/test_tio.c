@@ -358,6 +358,7 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   test_blocks(400, 11, 11, 400);
   test_blocks(10 * 1024, 11, 10 * 11, 1024);
   test_blocks(5 * 1023, 20, 20 * 1023, 5);
+  test_blocks(3 * 1024 + 7, 30, 3 * (3 * 1024 + 7), 10);
   /* reader closes file sooner */
 /*  test_blocks(2 * 6 * 1023, 20, 20 * 1023, 5); */
 /*  test_blocks(10, 10, 10, 9); */
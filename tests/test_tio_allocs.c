@@ -0,0 +1,139 @@
+/*
+   test_tio_allocs.c - count the memory allocations done by the tio module
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* the number of connections to handle */
+#define NUM_CONNECTIONS 1000
+
+/* the buffer sizes used by nslcd */
+#define READBUFFER_MINSIZE 32
+#define READBUFFER_MAXSIZE 64
+#define WRITEBUFFER_MINSIZE 1024
+#define WRITEBUFFER_MAXSIZE 1 * 1024 * 1024
+
+/* the size of the request and the response */
+#define REQUEST_SIZE 12
+#define RESPONSE_SIZE 256
+
+/* count the allocations that are done from the tio module */
+static int num_allocs = 0;
+#define malloc(size) (num_allocs++, malloc(size))
+#define realloc(ptr, size) (num_allocs++, realloc(ptr, size))
+
+/* we include the source because we want to count the allocations */
+#include "../common/tio.c"
+
+/* these are the other end of the connection */
+
+static void peer_write(int fd, const void *buf, size_t count)
+{
+  assert(write(fd, buf, count) == (ssize_t)count);
+}
+
+static void peer_read(int fd, void *buf, size_t count)
+{
+  ssize_t rv;
+  size_t done = 0;
+  while (done < count)
+  {
+    rv = read(fd, (char *)buf + done, count - done);
+    assert(rv > 0);
+    done += rv;
+  }
+}
+
+/* handle a single connection like nslcd does with the stream in fpp,
+   the stream is re-used if reuse is set */
+static void handle_connection(TFILE **fpp, int reuse, size_t responsesize)
+{
+  int sp[2];
+  uint8_t request[REQUEST_SIZE];
+  static uint8_t response[16 * 1024];
+  assert(responsesize <= sizeof(response));
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+  if (reuse && (*fpp != NULL))
+    tio_reopen(*fpp, sp[0]);
+  else
+    *fpp = tio_fdopen(sp[0], 1000, 1000,
+                      READBUFFER_MINSIZE, READBUFFER_MAXSIZE,
+                      WRITEBUFFER_MINSIZE, WRITEBUFFER_MAXSIZE);
+  assert(*fpp != NULL);
+  memset(request, 'q', sizeof(request));
+  peer_write(sp[1], request, sizeof(request));
+  assert(tio_read(*fpp, request, sizeof(request)) == 0);
+  memset(response, 'r', responsesize);
+  assert(tio_write(*fpp, response, responsesize) == 0);
+  if (reuse)
+  {
+    assert(tio_closefd(*fpp) == 0);
+  }
+  else
+  {
+    assert(tio_close(*fpp) == 0);
+    *fpp = NULL;
+  }
+  peer_read(sp[1], response, responsesize);
+  close(sp[1]);
+}
+
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  TFILE *fp = NULL;
+  int i;
+  int fresh, reused;
+  /* open a new stream for every connection */
+  num_allocs = 0;
+  for (i = 0; i < NUM_CONNECTIONS; i++)
+    handle_connection(&fp, 0, RESPONSE_SIZE);
+  fresh = num_allocs;
+  printf("new stream:    %.2f allocations per connection\n",
+         (double)fresh / NUM_CONNECTIONS);
+  /* re-use the stream, only the first connection allocates */
+  handle_connection(&fp, 1, RESPONSE_SIZE);
+  num_allocs = 0;
+  for (i = 0; i < NUM_CONNECTIONS; i++)
+    handle_connection(&fp, 1, RESPONSE_SIZE);
+  reused = num_allocs;
+  printf("reused stream: %.2f allocations per connection\n",
+         (double)reused / NUM_CONNECTIONS);
+  assert(fresh >= 3 * NUM_CONNECTIONS);
+  assert(reused == 0);
+  /* a large response grows the buffer which is shrunk again afterwards */
+  handle_connection(&fp, 1, 8 * 1024);
+  assert(fp->writebuffer.size == WRITEBUFFER_MINSIZE);
+  assert(fp->writebuffer.len == 0);
+  assert(fp->fd == -1);
+  /* the stream is still usable */
+  num_allocs = 0;
+  handle_connection(&fp, 1, RESPONSE_SIZE);
+  assert(num_allocs == 0);
+  (void)tio_close(fp);
+  return 0;
+}
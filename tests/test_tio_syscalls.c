@@ -0,0 +1,115 @@
+/*
+   test_tio_syscalls.c - count the system calls done by the tio module
+   This file is part of the nss-pam-ldapd library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* the number of request/response pairs to do */
+#define NUM_REQUESTS 10000
+
+/* the size of the request and the response */
+#define REQUEST_SIZE 12
+#define RESPONSE_SIZE 64
+
+/* these are the other end of the connection and are not counted */
+
+static void peer_write(int fd, const void *buf, size_t count)
+{
+  assert(write(fd, buf, count) == (ssize_t)count);
+}
+
+static void peer_read(int fd, void *buf, size_t count)
+{
+  ssize_t rv;
+  size_t done = 0;
+  while (done < count)
+  {
+    rv = read(fd, (char *)buf + done, count - done);
+    assert(rv > 0);
+    done += rv;
+  }
+}
+
+/* count the system calls that are done from the tio module */
+static int num_syscalls = 0;
+#define poll(fds, nfds, timeout) (num_syscalls++, poll(fds, nfds, timeout))
+#define read(fd, buf, count) (num_syscalls++, read(fd, buf, count))
+#define write(fd, buf, count) (num_syscalls++, write(fd, buf, count))
+#define recv(fd, buf, len, flags) (num_syscalls++, recv(fd, buf, len, flags))
+#define send(fd, buf, len, flags) (num_syscalls++, send(fd, buf, len, flags))
+#define clock_gettime(clk, ts) (num_syscalls++, clock_gettime(clk, ts))
+
+/* we include the source because we want to change the static settings */
+#include "../common/tio.c"
+
+/* handle requests in the same way nslcd does: the request is already
+   waiting when it is read and the response is flushed in one go, returns
+   the number of system calls per request */
+static double run_requests(int tryfirst)
+{
+  int sp[2];
+  TFILE *fp;
+  uint8_t request[REQUEST_SIZE];
+  uint8_t response[RESPONSE_SIZE];
+  int i;
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+  fp = tio_fdopen(sp[0], 1000, 1000, 1024, 2 * 1024, 1024, 2 * 1024);
+  assert(fp != NULL);
+  fp->tryfirst = tryfirst;
+  memset(request, 'q', sizeof(request));
+  memset(response, 'r', sizeof(response));
+  num_syscalls = 0;
+  for (i = 0; i < NUM_REQUESTS; i++)
+  {
+    peer_write(sp[1], request, sizeof(request));
+    assert(tio_read(fp, request, sizeof(request)) == 0);
+    assert(tio_write(fp, response, sizeof(response)) == 0);
+    assert(tio_flush(fp) == 0);
+    peer_read(sp[1], response, sizeof(response));
+  }
+  (void)tio_close(fp);
+  close(sp[1]);
+  return (double)num_syscalls / NUM_REQUESTS;
+}
+
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  double pollfirst, tryfirst;
+  pollfirst = run_requests(0);
+  printf("test_tio_syscalls: poll first: %.2f syscalls per request\n",
+         pollfirst);
+  tryfirst = run_requests(1);
+  printf("test_tio_syscalls: try first:  %.2f syscalls per request\n",
+         tryfirst);
+#ifdef MSG_DONTWAIT
+  assert(tryfirst < pollfirst);
+#endif /* MSG_DONTWAIT */
+  return 0;
+}